@@ -0,0 +1,501 @@
+/*      LC-3 Simulator - benchmark
+*       Runs a set of synthetic workloads on every core and prints millions of LC-3
+*       instructions per second, ns per instruction and (on Linux, where perf counters are
+*       available) host branch misses, then times forking a loaded machine. Results can be
+*       written as JSON lines and checked against a stored baseline.
+*
+*       lc3_bench [--only=workload] [--scale=F] [--repeat=N] [--json=path] [--baseline=path] [--tolerance=percent]
+*/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__linux__)
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#include "lc3.h"
+#include "core.h"
+#include "vm.h"
+#include "memory.h"
+#include "asm.h"
+#include "platform.h"
+
+// @@diff : {Workloads}
+/*
+*   Each workload is an outer loop around a fixed inner loop; %d is the outer count, so
+*   --scale shrinks or grows a run without changing what it measures. Everything ends in
+*   HALT and leaves a result in registers that every core has to agree on.
+*/
+struct workload
+{
+    const char* name;
+    const char* source;
+    int outer;        // outer iterations at --scale=1, about 30M instructions
+};
+
+static const struct workload workloads[] =
+{
+    { "alu", // register-only ADD/AND/NOT with a counted loop
+        ".ORIG x3000\n"
+        "      LD R6, OUTER\n"
+        "OLOOP LD R5, INNER\n"
+        "LOOP  ADD R0, R0, R5\n"
+        "      AND R1, R0, #15\n"
+        "      NOT R2, R1\n"
+        "      ADD R3, R2, R0\n"
+        "      AND R4, R3, R5\n"
+        "      ADD R0, R0, R4\n"
+        "      ADD R5, R5, #-1\n"
+        "      BRp LOOP\n"
+        "      ADD R6, R6, #-1\n"
+        "      BRp OLOOP\n"
+        "      HALT\n"
+        "INNER .FILL #1000\n"
+        "OUTER .FILL #%d\n"
+        ".END\n", 4000 },
+    { "memory", // LDR/STR sweep over 8K words
+        ".ORIG x3000\n"
+        "      LD R6, OUTER\n"
+        "OLOOP LD R1, BASE\n"
+        "      LD R2, PAIRS\n"
+        "LOOP  LDR R3, R1, #0\n"
+        "      ADD R3, R3, R0\n"
+        "      STR R3, R1, #0\n"
+        "      LDR R4, R1, #1\n"
+        "      ADD R0, R4, R3\n"
+        "      STR R0, R1, #1\n"
+        "      ADD R1, R1, #2\n"
+        "      ADD R2, R2, #-1\n"
+        "      BRp LOOP\n"
+        "      ADD R6, R6, #-1\n"
+        "      BRp OLOOP\n"
+        "      HALT\n"
+        "BASE  .FILL x4000\n"
+        "PAIRS .FILL #4096\n"
+        "OUTER .FILL #%d\n"
+        ".END\n", 800 },
+    { "branch", // data dependent branches on the bits of a 16-bit LCG
+        ".ORIG x3000\n"
+        "      LD R6, OUTER\n"
+        "      LD R4, MASKA\n"
+        "      LD R5, MASKB\n"
+        "OLOOP LD R3, INNER\n"
+        "LOOP  ADD R1, R0, R0\n"
+        "      ADD R1, R1, R1\n"
+        "      ADD R0, R0, R1\n"
+        "      ADD R0, R0, #1\n"      // x = 5x + 1
+        "      AND R2, R0, R4\n"
+        "      BRz A\n"
+        "      ADD R7, R7, #1\n"
+        "A     AND R2, R0, R5\n"
+        "      BRnp B\n"
+        "      ADD R7, R7, #-1\n"
+        "B     ADD R0, R0, #0\n"
+        "      BRzp C\n"
+        "      ADD R7, R7, #2\n"
+        "C     ADD R3, R3, #-1\n"
+        "      BRp LOOP\n"
+        "      ADD R6, R6, #-1\n"
+        "      BRp OLOOP\n"
+        "      HALT\n"
+        "MASKA .FILL x0400\n"
+        "MASKB .FILL x2000\n"
+        "INNER .FILL #1000\n"
+        "OUTER .FILL #%d\n"
+        ".END\n", 2000 },
+    { "recursion", // recursive fib(15) with a stack in R6: JSR/RET and stack traffic
+        ".ORIG x3000\n"
+        "      LD R6, STACK\n"
+        "      LD R5, OUTER\n"
+        "OLOOP LD R0, N\n"
+        "      JSR FIB\n"
+        "      ADD R5, R5, #-1\n"
+        "      BRp OLOOP\n"
+        "      HALT\n"
+        "FIB   ADD R6, R6, #-1\n"     // R1 = fib(R0), clobbers R0 and R2
+        "      STR R7, R6, #0\n"
+        "      ADD R2, R0, #-2\n"
+        "      BRzp REC\n"
+        "      ADD R1, R0, #0\n"
+        "      BR DONE\n"
+        "REC   ADD R6, R6, #-1\n"
+        "      STR R0, R6, #0\n"
+        "      ADD R0, R0, #-1\n"
+        "      JSR FIB\n"
+        "      LDR R0, R6, #0\n"
+        "      STR R1, R6, #0\n"
+        "      ADD R0, R0, #-2\n"
+        "      JSR FIB\n"
+        "      LDR R2, R6, #0\n"
+        "      ADD R1, R1, R2\n"
+        "      ADD R6, R6, #1\n"
+        "DONE  LDR R7, R6, #0\n"
+        "      ADD R6, R6, #1\n"
+        "      RET\n"
+        "STACK .FILL xFD00\n"
+        "N     .FILL #15\n"
+        "OUTER .FILL #%d\n"
+        ".END\n", 1500 },
+    { "trap", // OUT to a null sink: the cost of leaving the core for a TRAP routine
+        ".ORIG x3000\n"
+        "      LD R6, OUTER\n"
+        "OLOOP LD R5, INNER\n"
+        "LOOP  ADD R0, R5, #0\n"
+        "      OUT\n"
+        "      ADD R5, R5, #-1\n"
+        "      BRp LOOP\n"
+        "      ADD R6, R6, #-1\n"
+        "      BRp OLOOP\n"
+        "      HALT\n"
+        "INNER .FILL #1000\n"
+        "OUTER .FILL #%d\n"
+        ".END\n", 2000 },
+    { "counter", // LD+ADD+ST on a memory counter inside an ADD/BRp loop, the block core's fused ops
+        ".ORIG x3000\n"
+        "      LD R2, OUTER\n"
+        "L1    LD R1, INNER\n"
+        "L2    LD R3, COUNT\n"
+        "      ADD R3, R3, #1\n"
+        "      ST R3, COUNT\n"
+        "      ADD R1, R1, #-1\n"
+        "      BRp L2\n"
+        "      ADD R2, R2, #-1\n"
+        "      BRp L1\n"
+        "      HALT\n"
+        "OUTER .FILL #%d\n"
+        "INNER .FILL #1000\n"
+        "COUNT .FILL #0\n"
+        ".END\n", 6000 },
+};
+
+enum { WORKLOAD_COUNT = sizeof(workloads) / sizeof(workloads[0]), CORE_TOTAL = 3 };
+
+static const int cores[CORE_TOTAL] = { CORE_SWITCH, CORE_THREADED, CORE_BLOCK };
+static const char* core_names[CORE_TOTAL] = { "switch", "threaded", "block" };
+
+static int null_getc(void* ctx) { return EOF; }
+static int null_poll(void* ctx) { return 0; }
+static void null_putc(void* ctx, char c) {}
+static const struct lc3_io quiet = { NULL, null_getc, null_poll, null_putc, NULL, NULL };
+
+// @@diff : {Branch Misses}
+/*
+*   Host branch misses of the whole process while vm_run() runs, from perf_event_open() on
+*   Linux. Containers and locked-down kernels refuse it; the column then reads n/a.
+*/
+#if defined(__linux__)
+static int branch_counter_open()
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static void branch_counter_start(int fd)
+{
+    ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+    ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+}
+
+static int64_t branch_counter_stop(int fd)
+{
+    uint64_t count = 0;
+    ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    return read(fd, &count, sizeof(count)) == sizeof(count) ? (int64_t)count : -1;
+}
+
+static void branch_counter_close(int fd)
+{
+    close(fd);
+}
+#else
+static int branch_counter_open() { return -1; }
+static void branch_counter_start(int fd) {}
+static int64_t branch_counter_stop(int fd) { return -1; }
+static void branch_counter_close(int fd) {}
+#endif
+
+// @@diff : {Runs}
+struct result
+{
+    uint64_t instret;
+    uint64_t best_ns;         // fastest of the repeats
+    int64_t branch_misses;    // in the fastest repeat, -1 = not available
+    uint16_t reg[R_COUNT];    // final registers, every core must agree
+};
+
+static int run_workload(const struct workload* w, double scale, int core, int repeat, int counter, struct result* r)
+{
+    int outer = (int)(w->outer * scale);
+    outer = outer < 1 ? 1 : outer > 32767 ? 32767 : outer;
+    char source[2048];
+    snprintf(source, sizeof(source), w->source, outer);
+
+    memset(r, 0, sizeof(*r));
+    r->branch_misses = -1;
+    for(int i = 0; i < repeat; i++)
+    {
+        struct lc3_vm* vm = vm_create();
+        struct asm_error err;
+        if(!vm || !asm_assemble(vm, source, strlen(source), &err))
+        {
+            printf("%s: %s\n", w->name, vm ? err.message : "out of memory");
+            vm_destroy(vm);
+            return 0;
+        }
+        vm_set_io(vm, &quiet);
+        vm_set_core(vm, core);
+        if(counter >= 0)
+        {
+            branch_counter_start(counter);
+        }
+        uint64_t start = time_ns();
+        int status = vm_run(vm, 0);
+        uint64_t elapsed = time_ns() - start;
+        int64_t misses = counter >= 0 ? branch_counter_stop(counter) : -1;
+        if(status != LC3_RUN_HALT)
+        {
+            printf("%s did not halt on the %s core\n", w->name, core_names[core]);
+            vm_destroy(vm);
+            return 0;
+        }
+        if(i == 0 || elapsed < r->best_ns)
+        {
+            r->best_ns = elapsed ? elapsed : 1;
+            r->branch_misses = misses;
+        }
+        r->instret = vm->instret;
+        memcpy(r->reg, vm->reg, sizeof(r->reg));
+        vm_destroy(vm);
+    }
+    return 1;
+}
+
+static double mips(const struct result* r)
+{
+    return (double)r->instret * 1000.0 / (double)r->best_ns;
+}
+
+// @@diff : {Baseline}
+/*
+*   One JSON object per line. Only the fields written by write_json() are understood, which
+*   is all a baseline needs: a previous --json output.
+*/
+static int json_string(const char* line, const char* key, char* out, size_t size)
+{
+    char pattern[64];
+    snprintf(pattern, sizeof(pattern), "\"%s\":\"", key);
+    const char* at = strstr(line, pattern);
+    if(!at)
+    {
+        return 0;
+    }
+    at += strlen(pattern);
+    size_t n = 0;
+    while(at[n] && at[n] != '"' && n + 1 < size)
+    {
+        out[n] = at[n];
+        n++;
+    }
+    out[n] = 0;
+    return 1;
+}
+
+static int json_number(const char* line, const char* key, double* out)
+{
+    char pattern[64];
+    snprintf(pattern, sizeof(pattern), "\"%s\":", key);
+    const char* at = strstr(line, pattern);
+    return at && sscanf(at + strlen(pattern), "%lf", out) == 1;
+}
+
+static int baseline_mips(const char* path, const char* workload, const char* core, double* out)
+{
+    FILE* file = fopen(path, "r");
+    if(!file)
+    {
+        return 0;
+    }
+    char line[512], w[64], c[64];
+    int found = 0;
+    while(!found && fgets(line, sizeof(line), file))
+    {
+        found = json_string(line, "workload", w, sizeof(w)) && json_string(line, "core", c, sizeof(c))
+            && strcmp(w, workload) == 0 && strcmp(c, core) == 0 && json_number(line, "mips", out);
+    }
+    fclose(file);
+    return found;
+}
+
+static void write_json(FILE* out, const char* workload, const char* core, const struct result* r)
+{
+    fprintf(out, "{\"workload\":\"%s\",\"core\":\"%s\",\"instret\":%llu,\"ns\":%llu,\"mips\":%.1f,\"ns_per_instruction\":%.3f,",
+        workload, core, (unsigned long long)r->instret, (unsigned long long)r->best_ns, mips(r), (double)r->best_ns / (double)r->instret);
+    if(r->branch_misses >= 0)
+    {
+        fprintf(out, "\"branch_misses\":%lld}\n", (long long)r->branch_misses);
+    }
+    else
+    {
+        fprintf(out, "\"branch_misses\":null}\n");
+    }
+}
+
+// @@diff : {Fork}
+static double fork_us(int forks)
+{
+    const char* source = ".ORIG x3000\nLD R0, N\nADD R0, R0, #1\nST R0, N\nHALT\nN .FILL #0\n.END\n"; // one page gets copied
+    struct lc3_vm* parent = vm_create();
+    struct asm_error err;
+    if(!parent || !asm_assemble(parent, source, strlen(source), &err))
+    {
+        vm_destroy(parent);
+        return -1;
+    }
+    vm_set_io(parent, &quiet);
+    vm_set_core(parent, CORE_SWITCH); // a handful of instructions, not worth building caches for
+    struct lc3_snapshot* snap = vm_snapshot(parent);
+    uint64_t start = time_ns();
+    for(int i = 0; i < forks && snap; i++)
+    {
+        struct lc3_vm* child = vm_fork(snap);
+        if(child)
+        {
+            vm_run(child, 0);
+        }
+        vm_destroy(child);
+    }
+    uint64_t elapsed = time_ns() - start;
+    snapshot_destroy(snap);
+    vm_destroy(parent);
+    return elapsed / 1000.0 / forks;
+}
+
+int main(int argc, char* argv[])
+{
+    const char* only = NULL;
+    const char* json_path = NULL;
+    const char* baseline_path = NULL;
+    double scale = 1.0, tolerance = 10.0;
+    int repeat = 3;
+    for(int i = 1; i < argc; i++)
+    {
+        const char* arg = argv[i];
+        if(strncmp(arg, "--only=", 7) == 0)
+        {
+            only = arg + 7;
+        }
+        else if(strncmp(arg, "--scale=", 8) == 0)
+        {
+            scale = atof(arg + 8);
+        }
+        else if(strncmp(arg, "--repeat=", 9) == 0)
+        {
+            repeat = atoi(arg + 9) > 0 ? atoi(arg + 9) : 1;
+        }
+        else if(strncmp(arg, "--json=", 7) == 0)
+        {
+            json_path = arg + 7;
+        }
+        else if(strncmp(arg, "--baseline=", 11) == 0)
+        {
+            baseline_path = arg + 11;
+        }
+        else if(strncmp(arg, "--tolerance=", 12) == 0)
+        {
+            tolerance = atof(arg + 12);
+        }
+        else
+        {
+            printf("lc3_bench [--only=workload] [--scale=F] [--repeat=N] [--json=path] [--baseline=path] [--tolerance=percent]\n");
+            return 2;
+        }
+    }
+
+    FILE* json = json_path ? fopen(json_path, "w") : NULL;
+    if(json_path && !json)
+    {
+        printf("failed to open %s\n", json_path);
+        return 2;
+    }
+    int counter = branch_counter_open();
+    int status = 0;
+
+    printf("%-10s %-9s %12s %9s %8s %14s\n", "workload", "core", "instructions", "MIPS", "ns/inst", "branch misses");
+    for(int w = 0; w < WORKLOAD_COUNT; w++)
+    {
+        if(only && strcmp(only, workloads[w].name) != 0)
+        {
+            continue;
+        }
+        struct result results[CORE_TOTAL];
+        for(int c = 0; c < CORE_TOTAL; c++)
+        {
+            struct result* r = &results[c];
+            if(!run_workload(&workloads[w], scale, cores[c], repeat, counter, r))
+            {
+                status = 1;
+                break;
+            }
+            char misses[32] = "n/a";
+            if(r->branch_misses >= 0)
+            {
+                snprintf(misses, sizeof(misses), "%lld", (long long)r->branch_misses);
+            }
+            printf("%-10s %-9s %12llu %9.1f %8.2f %14s", workloads[w].name, core_names[c], (unsigned long long)r->instret,
+                mips(r), (double)r->best_ns / (double)r->instret, misses);
+            if(c > 0 && (r->instret != results[0].instret || memcmp(r->reg, results[0].reg, sizeof(r->reg)) != 0))
+            {
+                printf("  MISMATCH with the switch core");
+                status = 1;
+            }
+            double base = 0;
+            if(baseline_path && baseline_mips(baseline_path, workloads[w].name, core_names[c], &base))
+            {
+                double change = (mips(r) - base) * 100.0 / base;
+                printf("  %+6.1f%% vs baseline", change);
+                if(change < -tolerance)
+                {
+                    printf("  REGRESSION");
+                    status = 1;
+                }
+            }
+            printf("\n");
+            if(json)
+            {
+                write_json(json, workloads[w].name, core_names[c], r);
+            }
+        }
+    }
+
+    if(!only || strcmp(only, "fork") == 0)
+    {
+        double us = fork_us(scale < 1.0 ? 1000 : 20000); // fork a loaded machine, run it to HALT, destroy it
+        printf("%-10s %8.2f us/fork (fork, run to HALT, destroy)\n", "fork", us);
+        if(json)
+        {
+            fprintf(json, "{\"workload\":\"fork\",\"us_per_fork\":%.3f}\n", us);
+        }
+    }
+
+    if(counter >= 0)
+    {
+        branch_counter_close(counter);
+    }
+    if(json)
+    {
+        fclose(json);
+    }
+    return status;
+}
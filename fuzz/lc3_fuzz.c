@@ -0,0 +1,361 @@
+/*      LC-3 Simulator - differential fuzzer
+*       Turns an input into an LC-3 program and runs it on the switch core and on every fast
+*       core in lockstep, comparing the machines after each slice of instructions. Any
+*       difference is a bug in a fast core (or in the reference).
+*
+*       Built as lc3_fuzz: a standalone driver that generates random programs, or replays
+*       inputs from files (AFL: afl-fuzz -i seeds -o out -- ./lc3_fuzz @@).
+*       With -DLC3_FUZZER=ON and Clang it is also built as lc3_fuzz_libfuzzer.
+*
+*       lc3_fuzz [--runs=N] [--seed=S] [--save=path] [file|- ...]
+*/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lc3.h"
+#include "core.h"
+#include "vm.h"
+#include "memory.h"
+
+// @@diff : {Fuzz Input}
+/*
+*   Input layout, zero filled when it runs short:
+*       byte 0       slice: the machines are compared every 1 + byte % 64 instructions
+*       byte 1       input length L (% 16), then L bytes GETC/IN/KBDR read
+*       16 bytes     R0-R7, big-endian
+*       the rest     program words, big-endian, loaded at x3000
+*   Random words mostly stop at once, so the program is nudged towards something that runs:
+*   RTI and the reserved opcode only stay when bits 11:8 are all set (otherwise they become
+*   ADD), and TRAP vectors are folded onto the six real routines.
+*/
+enum
+{
+    FUZZ_ORIGIN = 0x3000,
+    FUZZ_MAX_WORDS = 0x1000,  // program words taken from one input
+    FUZZ_MAX_INPUT = 16,      // characters the program can read
+    FUZZ_STEPS = 1 << 14,     // instructions each machine runs at most
+    FUZZ_HEADER = 2 + 16
+};
+
+static uint16_t fuzz_word(uint16_t w)
+{
+    int op = w >> 12;
+    if((op == OP_RTI || op == OP_RES) && (w & 0x0F00) != 0x0F00)
+    {
+        return (uint16_t)(OP_ADD << 12 | (w & 0x0FFF));
+    }
+    if(op == OP_TRAP)
+    {
+        return (uint16_t)(OP_TRAP << 12 | (TRAP_GETC + (w & 0xFF) % 6));
+    }
+    return w;
+}
+
+static uint8_t byte_at(const uint8_t* data, size_t size, size_t i)
+{
+    return i < size ? data[i] : 0;
+}
+
+// @@diff : {Fuzz I/O}
+/*
+*   Headless I/O with a clock that counts instructions instead of milliseconds, so the timer
+*   device fires at the same instruction on every core no matter how long each one takes.
+*/
+struct fuzz_io
+{
+    struct lc3_vm* vm;
+    const uint8_t* input;
+    size_t input_size;
+    size_t input_pos;
+    uint64_t output_size;
+    uint64_t output_hash;   // FNV-1a over everything printed
+};
+
+static int fuzz_getc(void* ctx)
+{
+    struct fuzz_io* f = ctx;
+    return f->input_pos < f->input_size ? f->input[f->input_pos++] : EOF;
+}
+
+static int fuzz_poll(void* ctx)
+{
+    struct fuzz_io* f = ctx;
+    return f->input_pos < f->input_size;
+}
+
+static void fuzz_putc(void* ctx, char c)
+{
+    struct fuzz_io* f = ctx;
+    f->output_hash = (f->output_hash ^ (uint8_t)c) * 0x100000001B3ull;
+    f->output_size++;
+}
+
+static uint64_t fuzz_clock(void* ctx)
+{
+    struct fuzz_io* f = ctx;
+    return f->vm->instret / 64; // a "millisecond" every 64 instructions
+}
+
+// @@diff : {Lockstep}
+static const int cores[] = { CORE_SWITCH, CORE_THREADED, CORE_BLOCK };
+static const char* core_names[] = { "switch", "threaded", "block" };
+enum { CORE_TOTAL = 3 };
+
+/*
+*   Everything a core could get wrong, checked after every slice. Memory is compared per
+*   page: pages still shared with the starting snapshot are the same pointer in both
+*   machines and are skipped, so a slice only pays for the pages the program wrote.
+*/
+static int same_state(struct lc3_vm* a, const struct fuzz_io* fa, int status_a,
+    struct lc3_vm* b, const struct fuzz_io* fb, int status_b, const char* name, uint64_t at)
+{
+    int same = 1;
+    if(status_a != status_b || a->running != b->running || a->fault != b->fault || a->instret != b->instret)
+    {
+        printf("after %llu: status %d/%d, running %d/%d, fault %d/%d, instret %llu/%llu (switch/%s)\n",
+            (unsigned long long)at, status_a, status_b, a->running, b->running, a->fault, b->fault,
+            (unsigned long long)a->instret, (unsigned long long)b->instret, name);
+        same = 0;
+    }
+    for(int i = 0; i < R_COUNT; i++)
+    {
+        if(a->reg[i] != b->reg[i])
+        {
+            printf("after %llu: register %d differs: switch x%04X, %s x%04X\n", (unsigned long long)at, i, a->reg[i], name, b->reg[i]);
+            same = 0;
+        }
+    }
+    struct lc3_stats sa, sb;
+    vm_stats(a, &sa);
+    vm_stats(b, &sb);
+    for(int op = 0; op < 16; op++)
+    {
+        if(sa.opcodes[op] != sb.opcodes[op])
+        {
+            printf("after %llu: opcode %d count differs: switch %llu, %s %llu\n", (unsigned long long)at, op,
+                (unsigned long long)sa.opcodes[op], name, (unsigned long long)sb.opcodes[op]);
+            same = 0;
+        }
+    }
+    if(memcmp(sa.traps, sb.traps, sizeof(sa.traps)) != 0 || sa.device_reads != sb.device_reads || sa.device_writes != sb.device_writes)
+    {
+        printf("after %llu: trap or device counts differ (switch/%s)\n", (unsigned long long)at, name);
+        same = 0;
+    }
+    for(int p = 0; p < PAGE_COUNT; p++)
+    {
+        if(a->pages[p] == b->pages[p] || memcmp(a->pages[p]->words, b->pages[p]->words, sizeof(a->pages[p]->words)) == 0)
+        {
+            continue;
+        }
+        for(int i = 0; i < PAGE_WORDS; i++)
+        {
+            uint16_t address = (uint16_t)(p << PAGE_SHIFT | i);
+            if(mem_peek(a, address) != mem_peek(b, address))
+            {
+                printf("after %llu: memory x%04X differs: switch x%04X, %s x%04X\n", (unsigned long long)at, address,
+                    mem_peek(a, address), name, mem_peek(b, address));
+                same = 0;
+                break; // one word per page is enough to go on
+            }
+        }
+    }
+    if(fa->input_pos != fb->input_pos || fa->output_size != fb->output_size || fa->output_hash != fb->output_hash)
+    {
+        printf("after %llu: I/O differs: read %zu/%zu, printed %llu/%llu (switch/%s)\n", (unsigned long long)at,
+            fa->input_pos, fb->input_pos, (unsigned long long)fa->output_size, (unsigned long long)fb->output_size, name);
+        same = 0;
+    }
+    return same;
+}
+
+/*
+*   Runs one input on every core, returns 0 if they disagreed. The machines start from
+*   forks of one snapshot, so memory is shared until a core writes to it.
+*/
+static int fuzz_one(const uint8_t* data, size_t size)
+{
+    struct lc3_vm* start = vm_create();
+    if(!start)
+    {
+        return 1; // out of memory is not a finding
+    }
+    uint64_t slice = 1 + byte_at(data, size, 0) % 64;
+    size_t input_size = byte_at(data, size, 1) % FUZZ_MAX_INPUT;
+    size_t header = FUZZ_HEADER + input_size;
+    uint8_t input[FUZZ_MAX_INPUT];
+    for(size_t i = 0; i < input_size; i++)
+    {
+        input[i] = byte_at(data, size, 2 + i);
+    }
+    for(int r = 0; r < 8; r++)
+    {
+        start->reg[R_R0 + r] = (uint16_t)(byte_at(data, size, 2 + input_size + 2 * r) << 8 | byte_at(data, size, 3 + input_size + 2 * r));
+    }
+    size_t words = size > header ? (size - header + 1) / 2 : 0;
+    for(size_t i = 0; i < words && i < FUZZ_MAX_WORDS; i++)
+    {
+        uint16_t w = (uint16_t)(byte_at(data, size, header + 2 * i) << 8 | byte_at(data, size, header + 2 * i + 1));
+        mem_poke(start, (uint16_t)(FUZZ_ORIGIN + i), fuzz_word(w));
+    }
+
+    struct lc3_snapshot* snap = vm_snapshot(start);
+    vm_destroy(start);
+    struct lc3_vm* vms[CORE_TOTAL] = { NULL };
+    struct fuzz_io io[CORE_TOTAL];
+    int ok = 1;
+    for(int c = 0; c < CORE_TOTAL; c++)
+    {
+        vms[c] = snap ? vm_fork(snap) : NULL;
+        if(!vms[c])
+        {
+            goto done;
+        }
+        io[c] = (struct fuzz_io){ vms[c], input, input_size, 0, 0, 0xCBF29CE484222325ull };
+        const struct lc3_io callbacks = { &io[c], fuzz_getc, fuzz_poll, fuzz_putc, NULL, fuzz_clock, "> ", NULL };
+        vm_set_io(vms[c], &callbacks);
+        vm_set_core(vms[c], cores[c]);
+    }
+
+    for(uint64_t ran = 0; ok && vms[0]->running && ran < FUZZ_STEPS; ran += slice)
+    {
+        int status[CORE_TOTAL];
+        for(int c = 0; c < CORE_TOTAL; c++)
+        {
+            status[c] = vm_run(vms[c], slice);
+        }
+        for(int c = 1; c < CORE_TOTAL; c++)
+        {
+            ok &= same_state(vms[0], &io[0], status[0], vms[c], &io[c], status[c], core_names[c], ran + slice);
+        }
+    }
+
+done:
+    for(int c = 0; c < CORE_TOTAL; c++)
+    {
+        if(vms[c])
+        {
+            vm_destroy(vms[c]);
+        }
+    }
+    snapshot_destroy(snap);
+    return ok;
+}
+
+#ifdef LC3_LIBFUZZER
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+    if(!fuzz_one(data, size))
+    {
+        abort(); // libFuzzer keeps the input that got here
+    }
+    return 0;
+}
+#else
+// @@diff : {Standalone Driver}
+static uint64_t rng_state;
+
+static uint64_t rng_next() // xorshift64*
+{
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545F4914F6CDD1Dull;
+}
+
+static int fuzz_file(const char* path)
+{
+    FILE* in = strcmp(path, "-") == 0 ? stdin : fopen(path, "rb");
+    if(!in)
+    {
+        printf("failed to open %s\n", path);
+        return 2;
+    }
+    static uint8_t data[FUZZ_HEADER + FUZZ_MAX_INPUT + 2 * FUZZ_MAX_WORDS];
+    size_t size = fread(data, 1, sizeof(data), in);
+    if(in != stdin)
+    {
+        fclose(in);
+    }
+    if(!fuzz_one(data, size))
+    {
+        printf("%s: cores differ\n", path);
+        abort(); // AFL counts crashes
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    long runs = 1000;
+    uint64_t seed = 1;
+    const char* save_path = "lc3_fuzz_failure.bin";
+    int files = 0;
+    for(int i = 1; i < argc; i++)
+    {
+        const char* arg = argv[i];
+        if(strncmp(arg, "--runs=", 7) == 0)
+        {
+            runs = atol(arg + 7);
+        }
+        else if(strncmp(arg, "--seed=", 7) == 0)
+        {
+            seed = strtoull(arg + 7, NULL, 0);
+        }
+        else if(strncmp(arg, "--save=", 7) == 0)
+        {
+            save_path = arg + 7;
+        }
+        else if(arg[0] != '-' || strcmp(arg, "-") == 0)
+        {
+            int status = fuzz_file(arg);
+            if(status)
+            {
+                return status;
+            }
+            files++;
+        }
+        else
+        {
+            printf("lc3_fuzz [--runs=N] [--seed=S] [--save=path] [file|- ...]\n");
+            return 2;
+        }
+    }
+    if(files)
+    {
+        return 0;
+    }
+
+    /*
+    *   Random inputs: short programs loop and branch back into themselves more often, so
+    *   sizes are spread from a few words to the full FUZZ_MAX_WORDS.
+    */
+    static uint8_t data[FUZZ_HEADER + FUZZ_MAX_INPUT + 2 * FUZZ_MAX_WORDS];
+    for(long run = 0; run < runs; run++)
+    {
+        rng_state = (seed + (uint64_t)run) * 0x9E3779B97F4A7C15ull | 1;
+        size_t size = FUZZ_HEADER + FUZZ_MAX_INPUT + 2 * ((size_t)1 << (rng_next() % 13));
+        size = size < sizeof(data) ? size : sizeof(data);
+        for(size_t i = 0; i < size; i++)
+        {
+            data[i] = (uint8_t)(rng_next() >> 56);
+        }
+        if(!fuzz_one(data, size))
+        {
+            FILE* out = fopen(save_path, "wb");
+            if(out)
+            {
+                fwrite(data, 1, size, out);
+                fclose(out);
+            }
+            printf("run %ld (--seed=%llu --runs=1 reproduces it): cores differ, input saved to %s\n", run,
+                (unsigned long long)(seed + (uint64_t)run), save_path);
+            return 1;
+        }
+    }
+    printf("%ld runs, cores agree\n", runs);
+    return 0;
+}
+#endif
@@ -0,0 +1,739 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <ctype.h>
+
+#include "lc3.h"
+#include "vm.h"
+#include "memory.h"
+#include "predecode.h"
+#include "block.h"
+#include "asm.h"
+
+enum
+{
+    ASM_TOKENS_MAX = 8 // label, opcode and up to 3 operands, with room to spare
+};
+
+// @@diff : {Symbol Table}
+/*
+*   Labels live in an open-addressing hash table (FNV-1a, linear probing) that doubles when
+*   it is half full. Names point into pass 1's copy of the source, so nothing is copied.
+*/
+struct asm_symbol
+{
+    const char* name;   // NULL = empty slot
+    size_t length;
+    uint16_t address;
+};
+
+struct asm_symbols
+{
+    struct asm_symbol* slots;
+    size_t capacity;    // power of two
+    size_t count;
+};
+
+static uint32_t symbol_hash(const char* name, size_t length)
+{
+    uint32_t h = 2166136261u;
+    for(size_t i = 0; i < length; i++)
+    {
+        h = (h ^ (unsigned char)name[i]) * 16777619u;
+    }
+    return h;
+}
+
+static struct asm_symbol* symbol_slot(struct asm_symbols* t, const char* name, size_t length)
+{
+    size_t i = symbol_hash(name, length) & (t->capacity - 1);
+    while(t->slots[i].name && (t->slots[i].length != length || memcmp(t->slots[i].name, name, length) != 0))
+    {
+        i = (i + 1) & (t->capacity - 1);
+    }
+    return &t->slots[i];
+}
+
+static int symbol_grow(struct asm_symbols* t)
+{
+    struct asm_symbols bigger = { calloc(t->capacity * 2, sizeof(struct asm_symbol)), t->capacity * 2, t->count };
+    if(!bigger.slots)
+    {
+        return 0;
+    }
+    for(size_t i = 0; i < t->capacity; i++)
+    {
+        if(t->slots[i].name)
+        {
+            *symbol_slot(&bigger, t->slots[i].name, t->slots[i].length) = t->slots[i];
+        }
+    }
+    free(t->slots);
+    *t = bigger;
+    return 1;
+}
+
+// @@diff : {Assembler State}
+struct asm_state
+{
+    struct lc3_vm* vm;
+    const char* source;
+    size_t length;
+    struct asm_error* err;
+    struct asm_symbols symbols;
+    int pass;           // 1 = collect labels, 2 = emit words
+    int line;
+    uint32_t pc;        // next address, 32 bits so running off the end of memory is caught
+    int in_block;       // between .ORIG and .END
+};
+
+static int fail(struct asm_state* st, const char* fmt, ...)
+{
+    if(st->err)
+    {
+        va_list args;
+        va_start(args, fmt);
+        st->err->line = st->line;
+        vsnprintf(st->err->message, sizeof(st->err->message), fmt, args);
+        va_end(args);
+    }
+    return 0;
+}
+
+enum
+{
+    K_ADD,      // ADD/AND: DR, SR1, SR2|imm5
+    K_NOT,      // DR, SR
+    K_BR,       // label|offset9, nzp in base
+    K_JMP,      // BaseR
+    K_JSR,      // label|offset11
+    K_JSRR,     // BaseR
+    K_PCREL,    // LD/LDI/LEA/ST/STI: R, label|offset9
+    K_BASE,     // LDR/STR: R, BaseR, offset6
+    K_TRAP,     // trapvect8
+    K_FIXED,    // RET, RTI and the TRAP aliases: no operands
+    K_ORIG,
+    K_FILL,
+    K_BLKW,
+    K_STRINGZ,
+    K_END
+};
+
+struct asm_opcode
+{
+    const char* name;   // upper case
+    int kind;
+    uint16_t base;      // opcode bits (and fixed fields)
+};
+
+static const struct asm_opcode opcodes[] =
+{
+    { "ADD", K_ADD, 0x1000 },   { "AND", K_ADD, 0x5000 },   { "NOT", K_NOT, 0x903F },
+    { "JMP", K_JMP, 0xC000 },   { "RET", K_FIXED, 0xC1C0 }, { "JSR", K_JSR, 0x4800 },
+    { "JSRR", K_JSRR, 0x4000 }, { "LD", K_PCREL, 0x2000 },  { "LDI", K_PCREL, 0xA000 },
+    { "LEA", K_PCREL, 0xE000 }, { "ST", K_PCREL, 0x3000 },  { "STI", K_PCREL, 0xB000 },
+    { "LDR", K_BASE, 0x6000 },  { "STR", K_BASE, 0x7000 },  { "TRAP", K_TRAP, 0xF000 },
+    { "RTI", K_FIXED, 0x8000 },
+    { "GETC", K_FIXED, 0xF000 | TRAP_GETC },   { "OUT", K_FIXED, 0xF000 | TRAP_OUT },
+    { "PUTS", K_FIXED, 0xF000 | TRAP_PUTS },   { "IN", K_FIXED, 0xF000 | TRAP_IN },
+    { "PUTSP", K_FIXED, 0xF000 | TRAP_PUTSP }, { "HALT", K_FIXED, 0xF000 | TRAP_HALT },
+    { ".ORIG", K_ORIG, 0 },     { ".FILL", K_FILL, 0 },     { ".BLKW", K_BLKW, 0 },
+    { ".STRINGZ", K_STRINGZ, 0 }, { ".END", K_END, 0 },
+};
+
+static int same_upper(const char* token, const char* upper)
+{
+    for(; *token && *upper; token++, upper++)
+    {
+        if(toupper((unsigned char)*token) != *upper)
+        {
+            return 0;
+        }
+    }
+    return *token == *upper;
+}
+
+static int find_opcode(const char* token, struct asm_opcode* out)
+{
+    if(toupper((unsigned char)token[0]) == 'B' && toupper((unsigned char)token[1]) == 'R') // BR, BRn, BRzp, ...
+    {
+        uint16_t nzp = 0;
+        const char* c = token + 2;
+        for(; *c; c++)
+        {
+            int ch = tolower((unsigned char)*c);
+            uint16_t bit = ch == 'n' ? 0x800 : ch == 'z' ? 0x400 : ch == 'p' ? 0x200 : 0;
+            if(!bit || (nzp & bit))
+            {
+                return 0; // a label that starts with BR
+            }
+            nzp |= bit;
+        }
+        out->name = token;
+        out->kind = K_BR;
+        out->base = nzp ? nzp : 0xE00; // plain BR branches always
+        return 1;
+    }
+    for(size_t i = 0; i < sizeof(opcodes) / sizeof(opcodes[0]); i++)
+    {
+        if(same_upper(token, opcodes[i].name))
+        {
+            *out = opcodes[i];
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// @@diff : {Operands}
+static int parse_number(const char* token, int32_t* value)
+{
+    const char* c = token;
+    int base = 10;
+    if(*c == '#')
+    {
+        c++;
+    }
+    else if((c[0] == 'x' || c[0] == 'X') && c[1])
+    {
+        base = 16;
+        c++;
+    }
+    else if(c[0] == '0' && (c[1] == 'x' || c[1] == 'X'))
+    {
+        base = 16;
+        c += 2;
+    }
+    int negative = *c == '-';
+    if(*c == '-' || *c == '+')
+    {
+        c++;
+    }
+    if(!*c)
+    {
+        return 0;
+    }
+    int32_t v = 0;
+    for(; *c; c++)
+    {
+        int digit = isdigit((unsigned char)*c) ? *c - '0'
+                  : (base == 16 && isxdigit((unsigned char)*c)) ? toupper((unsigned char)*c) - 'A' + 10 : -1;
+        if(digit < 0 || v > 0x7FFFFF)
+        {
+            return 0;
+        }
+        v = v * base + digit;
+    }
+    *value = negative ? -v : v;
+    return 1;
+}
+
+static int parse_register(struct asm_state* st, const char* token, uint16_t* r)
+{
+    if((token[0] == 'R' || token[0] == 'r') && token[1] >= '0' && token[1] <= '7' && !token[2])
+    {
+        *r = token[1] - '0';
+        return 1;
+    }
+    return fail(st, "expected a register, got '%s'", token);
+}
+
+static int fits(int32_t v, int bits) // representable as a signed bits-wide field
+{
+    return v >= -(1 << (bits - 1)) && v < (1 << (bits - 1));
+}
+
+static int parse_immediate(struct asm_state* st, const char* token, int bits, uint16_t* field)
+{
+    int32_t v;
+    if(!parse_number(token, &v))
+    {
+        return fail(st, "expected a number, got '%s'", token);
+    }
+    if(!fits(v, bits))
+    {
+        return fail(st, "%s does not fit in %d bits", token, bits);
+    }
+    *field = (uint16_t)v & ((1 << bits) - 1);
+    return 1;
+}
+
+static int parse_label_value(struct asm_state* st, const char* token, int32_t* value) // label address or number
+{
+    if(parse_number(token, value))
+    {
+        return 1;
+    }
+    if(st->pass == 1)
+    {
+        *value = 0; // labels may be defined further down
+        return 1;
+    }
+    struct asm_symbol* sym = symbol_slot(&st->symbols, token, strlen(token));
+    if(!sym->name)
+    {
+        return fail(st, "undefined label '%s'", token);
+    }
+    *value = sym->address;
+    return 1;
+}
+
+static int parse_pc_offset(struct asm_state* st, const char* token, int bits, uint16_t* field) // label or literal offset
+{
+    int32_t v;
+    if(parse_number(token, &v)) // a literal offset
+    {
+        return parse_immediate(st, token, bits, field);
+    }
+    if(!parse_label_value(st, token, &v))
+    {
+        return 0;
+    }
+    int32_t offset = v - (int32_t)(st->pc + 1);
+    if(st->pass == 2 && !fits(offset, bits))
+    {
+        return fail(st, "label '%s' is too far away (%d words) for a %d-bit offset", token, offset, bits);
+    }
+    *field = (uint16_t)offset & ((1 << bits) - 1);
+    return 1;
+}
+
+// @@diff : {Lines}
+static int emit(struct asm_state* st, uint16_t word)
+{
+    if(st->pc >= MEMORY_MAX)
+    {
+        return fail(st, "program runs past the end of memory");
+    }
+    if(st->pass == 2)
+    {
+        mem_poke(st->vm, (uint16_t)st->pc, word);
+    }
+    st->pc++;
+    return 1;
+}
+
+static int tokenize(struct asm_state* st, char* line, char** tokens, int* count)
+{
+    *count = 0;
+    char* c = line;
+    for(;;)
+    {
+        while(*c == ' ' || *c == '\t' || *c == ',' || *c == '\r')
+        {
+            c++;
+        }
+        if(!*c || *c == ';')
+        {
+            return 1;
+        }
+        if(*count == ASM_TOKENS_MAX)
+        {
+            return fail(st, "too many operands");
+        }
+        tokens[(*count)++] = c;
+        if(*c == '"') // string literal, kept with its quotes and escapes for .STRINGZ
+        {
+            for(c++; *c && *c != '"'; c++)
+            {
+                if(*c == '\\' && c[1])
+                {
+                    c++;
+                }
+            }
+            if(*c != '"')
+            {
+                return fail(st, "unterminated string");
+            }
+            c++;
+        }
+        else
+        {
+            while(*c && *c != ' ' && *c != '\t' && *c != ',' && *c != ';' && *c != '\r')
+            {
+                c++;
+            }
+        }
+        if(*c == ';')
+        {
+            *c = '\0';
+            return 1;
+        }
+        if(*c)
+        {
+            *c++ = '\0';
+        }
+    }
+}
+
+static int emit_string(struct asm_state* st, const char* token)
+{
+    if(token[0] != '"')
+    {
+        return fail(st, ".STRINGZ needs a quoted string");
+    }
+    for(const char* c = token + 1; *c != '"'; c++)
+    {
+        char ch = *c;
+        if(ch == '\\')
+        {
+            c++;
+            switch(*c)
+            {
+                case 'n': ch = '\n'; break;
+                case 't': ch = '\t'; break;
+                case 'r': ch = '\r'; break;
+                case 'e': ch = 27; break;
+                case '0': ch = '\0'; break;
+                default:  ch = *c; break; // \" \\ and anything else stand for themselves
+            }
+        }
+        if(!emit(st, (uint8_t)ch))
+        {
+            return 0;
+        }
+    }
+    return emit(st, 0);
+}
+
+static int expect_operands(struct asm_state* st, const struct asm_opcode* op, int got, int want)
+{
+    if(got != want)
+    {
+        return fail(st, "%s takes %d operand%s, got %d", op->name, want, want == 1 ? "" : "s", got);
+    }
+    return 1;
+}
+
+static int define_label(struct asm_state* st, const char* name) // name points into the pass 1 text, which outlives the table
+{
+    size_t length = strlen(name);
+    if(length && name[length - 1] == ':')
+    {
+        length--;
+    }
+    int32_t unused;
+    if(length == 0 || parse_number(name, &unused) || (length == 2 && (name[0] == 'R' || name[0] == 'r') && name[1] >= '0' && name[1] <= '7'))
+    {
+        return fail(st, "'%s' is not a valid label", name);
+    }
+    if(!st->in_block)
+    {
+        return fail(st, "label '%.*s' outside .ORIG/.END", (int)length, name);
+    }
+    if(st->symbols.count * 2 >= st->symbols.capacity && !symbol_grow(&st->symbols))
+    {
+        return fail(st, "out of memory");
+    }
+    struct asm_symbol* sym = symbol_slot(&st->symbols, name, length);
+    if(sym->name)
+    {
+        return fail(st, "label '%.*s' defined twice", (int)length, name);
+    }
+    sym->name = name;
+    sym->length = length;
+    sym->address = (uint16_t)st->pc;
+    st->symbols.count++;
+    return 1;
+}
+
+static int assemble_line(struct asm_state* st, char* line)
+{
+    char* tokens[ASM_TOKENS_MAX];
+    int count;
+    if(!tokenize(st, line, tokens, &count))
+    {
+        return 0;
+    }
+    if(count == 0)
+    {
+        return 1; // blank or comment
+    }
+
+    struct asm_opcode op;
+    int first = 0;
+    if(!find_opcode(tokens[0], &op)) // anything that is not an opcode in front is a label
+    {
+        if(st->pass == 1 && !define_label(st, tokens[0]))
+        {
+            return 0;
+        }
+        if(count == 1)
+        {
+            return 1;
+        }
+        first = 1;
+        if(!find_opcode(tokens[1], &op))
+        {
+            return fail(st, "unknown instruction '%s'", tokens[1]);
+        }
+    }
+    char** args = tokens + first + 1;
+    int nargs = count - first - 1;
+
+    if(op.kind == K_ORIG)
+    {
+        int32_t origin;
+        if(!expect_operands(st, &op, nargs, 1))
+        {
+            return 0;
+        }
+        if(!parse_number(args[0], &origin) || origin < 0 || origin >= MEMORY_MAX)
+        {
+            return fail(st, ".ORIG needs an address between x0000 and xFFFF");
+        }
+        if(st->in_block)
+        {
+            return fail(st, ".ORIG without .END for the previous block");
+        }
+        st->pc = (uint32_t)origin;
+        st->in_block = 1;
+        return 1;
+    }
+    if(!st->in_block)
+    {
+        return fail(st, "%s outside .ORIG/.END", op.name);
+    }
+    if(op.kind == K_END)
+    {
+        st->in_block = 0;
+        return 1;
+    }
+
+    uint16_t word = op.base, a = 0, b = 0, c = 0;
+    switch(op.kind)
+    {
+        case K_ADD:
+            if(!expect_operands(st, &op, nargs, 3) || !parse_register(st, args[0], &a) || !parse_register(st, args[1], &b))
+            {
+                return 0;
+            }
+            if(args[2][0] == 'R' || args[2][0] == 'r')
+            {
+                if(!parse_register(st, args[2], &c))
+                {
+                    return 0;
+                }
+                word |= a << 9 | b << 6 | c;
+            }
+            else
+            {
+                if(!parse_immediate(st, args[2], 5, &c))
+                {
+                    return 0;
+                }
+                word |= a << 9 | b << 6 | 0x20 | c;
+            }
+            return emit(st, word);
+
+        case K_NOT:
+            if(!expect_operands(st, &op, nargs, 2) || !parse_register(st, args[0], &a) || !parse_register(st, args[1], &b))
+            {
+                return 0;
+            }
+            return emit(st, word | a << 9 | b << 6);
+
+        case K_BR:
+            if(!expect_operands(st, &op, nargs, 1) || !parse_pc_offset(st, args[0], 9, &a))
+            {
+                return 0;
+            }
+            return emit(st, word | a);
+
+        case K_JMP:
+        case K_JSRR:
+            if(!expect_operands(st, &op, nargs, 1) || !parse_register(st, args[0], &b))
+            {
+                return 0;
+            }
+            return emit(st, word | b << 6);
+
+        case K_JSR:
+            if(!expect_operands(st, &op, nargs, 1) || !parse_pc_offset(st, args[0], 11, &a))
+            {
+                return 0;
+            }
+            return emit(st, word | a);
+
+        case K_PCREL:
+            if(!expect_operands(st, &op, nargs, 2) || !parse_register(st, args[0], &a) || !parse_pc_offset(st, args[1], 9, &b))
+            {
+                return 0;
+            }
+            return emit(st, word | a << 9 | b);
+
+        case K_BASE:
+            if(!expect_operands(st, &op, nargs, 3) || !parse_register(st, args[0], &a) || !parse_register(st, args[1], &b)
+                || !parse_immediate(st, args[2], 6, &c))
+            {
+                return 0;
+            }
+            return emit(st, word | a << 9 | b << 6 | c);
+
+        case K_TRAP:
+        {
+            int32_t v;
+            if(!expect_operands(st, &op, nargs, 1))
+            {
+                return 0;
+            }
+            if(!parse_number(args[0], &v) || v < 0 || v > 0xFF)
+            {
+                return fail(st, "TRAP needs a vector between x00 and xFF");
+            }
+            return emit(st, word | (uint16_t)v);
+        }
+
+        case K_FIXED:
+            return expect_operands(st, &op, nargs, 0) && emit(st, word);
+
+        case K_FILL:
+        {
+            int32_t v;
+            if(!expect_operands(st, &op, nargs, 1) || !parse_label_value(st, args[0], &v))
+            {
+                return 0;
+            }
+            if(v < -0x8000 || v > 0xFFFF)
+            {
+                return fail(st, "%s does not fit in 16 bits", args[0]);
+            }
+            return emit(st, (uint16_t)v);
+        }
+
+        case K_BLKW:
+        {
+            int32_t n;
+            if(!expect_operands(st, &op, nargs, 1))
+            {
+                return 0;
+            }
+            if(!parse_number(args[0], &n) || n < 0 || n > MEMORY_MAX)
+            {
+                return fail(st, ".BLKW needs a word count");
+            }
+            for(int32_t i = 0; i < n; i++)
+            {
+                if(!emit(st, 0))
+                {
+                    return 0;
+                }
+            }
+            return 1;
+        }
+
+        case K_STRINGZ:
+            return expect_operands(st, &op, nargs, 1) && emit_string(st, args[0]);
+    }
+    return fail(st, "unknown instruction '%s'", op.name);
+}
+
+static int assemble_pass(struct asm_state* st, char* text)
+{
+    st->pc = 0;
+    st->in_block = 0;
+    st->line = 0;
+    char* line = text;
+    char* end = text + st->length;
+    while(line < end)
+    {
+        char* newline = memchr(line, '\n', end - line);
+        if(!newline)
+        {
+            newline = end;
+        }
+        *newline = '\0';
+        st->line++;
+        if(!assemble_line(st, line))
+        {
+            return 0;
+        }
+        line = newline + 1;
+    }
+    return 1;
+}
+
+// @@diff : {Assemble}
+int asm_assemble(struct lc3_vm* vm, const char* source, size_t length, struct asm_error* err)
+{
+    struct asm_state st;
+    memset(&st, 0, sizeof(st));
+    st.vm = vm;
+    st.source = source;
+    st.length = length;
+    st.err = err;
+    if(err)
+    {
+        err->line = 0;
+        err->message[0] = '\0';
+    }
+
+    // pass 1 tokenizes its own copy in place and the symbol table points into it, so it stays
+    // alive until pass 2 (which tokenizes a second copy) is done
+    char* text1 = malloc(length + 1);
+    char* text2 = malloc(length + 1);
+    st.symbols.capacity = 64;
+    st.symbols.slots = calloc(st.symbols.capacity, sizeof(struct asm_symbol));
+    int ok = text1 && text2 && st.symbols.slots;
+    if(!ok)
+    {
+        fail(&st, "out of memory");
+    }
+    else
+    {
+        memcpy(text1, source, length);
+        text1[length] = '\0';
+        memcpy(text2, source, length);
+        text2[length] = '\0';
+        st.pass = 1;
+        ok = assemble_pass(&st, text1);
+        if(ok)
+        {
+            st.pass = 2;
+            ok = assemble_pass(&st, text2);
+        }
+    }
+    free(st.symbols.slots);
+    free(text1);
+    free(text2);
+    if(ok)
+    {
+        predecode_flush(vm); // memory was filled behind mem_write()'s back
+        block_flush(vm);
+    }
+    return ok;
+}
+
+int vm_load_asm(struct lc3_vm* vm, const char* path, struct asm_error* err)
+{
+    FILE* file = fopen(path, "rb");
+    if(!file)
+    {
+        if(err)
+        {
+            err->line = 0;
+            snprintf(err->message, sizeof(err->message), "cannot open %s", path);
+        }
+        return 0;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char* source = size >= 0 ? malloc((size_t)size + 1) : NULL;
+    size_t length = source ? fread(source, 1, (size_t)size, file) : 0; // one buffered read for the whole file
+    fclose(file);
+    if(!source)
+    {
+        if(err)
+        {
+            err->line = 0;
+            snprintf(err->message, sizeof(err->message), "out of memory reading %s", path);
+        }
+        return 0;
+    }
+    int ok = asm_assemble(vm, source, length, err);
+    free(source);
+    return ok;
+}
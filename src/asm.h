@@ -0,0 +1,29 @@
+/*      LC-3 Simulator - assembler
+*       Two-pass assembler that writes straight into a VM's memory, so .asm sources run
+*       without an external lc3as and without object files on disk.
+*/
+#ifndef LC3_ASM_H
+#define LC3_ASM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "lc3.h"
+
+// @@diff : {Assembler}
+/*
+*   Supported: every LC-3 instruction (BR with any nzp combination, RET, JSRR, RTI), the
+*   TRAP aliases GETC/OUT/PUTS/IN/PUTSP/HALT, and .ORIG/.FILL/.BLKW/.STRINGZ/.END.
+*   Labels may end in ':' and are case sensitive; opcodes, directives and registers are not.
+*   Numbers are #decimal, decimal, xHEX or 0xHEX. Comments start with ';'.
+*/
+struct asm_error
+{
+    int line;          // 1-based source line, 0 if the error is not tied to a line
+    char message[160];
+};
+
+int asm_assemble(struct lc3_vm* vm, const char* source, size_t length, struct asm_error* err); // 1 on success
+int vm_load_asm(struct lc3_vm* vm, const char* path, struct asm_error* err); // read the file in one go and assemble it
+
+#endif
@@ -0,0 +1,434 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lc3.h"
+#include "core.h"
+#include "vm.h"
+#include "batch.h"
+#include "stats.h"
+#include "disasm.h"
+#include "platform.h"
+
+// @@diff : {Batch}
+/*
+*   Jobs are dealt round-robin onto one queue per worker. A worker takes jobs from the back
+*   of its own queue and, once that is empty, steals from the front of the others, so a few
+*   long-running images do not leave the rest of the pool idle. Every queue has its own
+*   mutex; jobs are whole program runs, so the locking is nowhere near the hot path.
+*
+*   Each job runs on its own VM with its budget as the vm_run() step budget and its timeout
+*   as the VM's deadline. Output goes into an FNV-1a hash instead of a buffer.
+*/
+enum
+{
+    BATCH_LINE_MAX = 4096
+};
+
+enum
+{
+    EXIT_HALT = 0,
+    EXIT_FAULT,
+    EXIT_BUDGET,
+    EXIT_TIMEOUT,
+    EXIT_ERROR     // image or input could not be read, out of memory
+};
+
+static const char* exit_names[] = { "halt", "fault", "budget", "timeout", "error" };
+
+struct batch_job
+{
+    char* image;
+    char* input;          // NULL = no keyboard input
+    uint64_t budget;
+    uint64_t timeout_ms;
+
+    int exit;             // EXIT_*
+    uint64_t output_hash;
+    uint64_t output_bytes;
+    uint64_t instret;
+    uint64_t wall_ms;
+    struct lc3_stats* stats; // --stats only
+};
+
+struct batch_queue
+{
+    struct platform_mutex* lock;
+    int* jobs;            // job indices, [head, tail) are still waiting
+    int head;
+    int tail;
+};
+
+struct batch
+{
+    struct batch_job* jobs;
+    int job_count;
+    struct batch_queue* queues;
+    int queue_count;
+    int core;
+};
+
+// @@diff : {Batch I/O}
+struct batch_io
+{
+    const char* input;
+    size_t input_len;
+    size_t input_pos;
+    uint64_t hash;
+    uint64_t bytes;
+};
+
+static int batch_getc(void* ctx)
+{
+    struct batch_io* io = ctx;
+    return io->input_pos < io->input_len ? (unsigned char)io->input[io->input_pos++] : EOF;
+}
+
+static int batch_poll(void* ctx)
+{
+    struct batch_io* io = ctx;
+    return io->input_pos < io->input_len;
+}
+
+static void batch_putc(void* ctx, char c)
+{
+    struct batch_io* io = ctx;
+    io->hash = (io->hash ^ (unsigned char)c) * 1099511628211ULL; // FNV-1a, 64 bit
+    io->bytes++;
+}
+
+static char* read_file(const char* path, size_t* len)
+{
+    FILE* file = fopen(path, "rb");
+    if(!file)
+    {
+        return NULL;
+    }
+    size_t cap = 4096, n = 0;
+    char* data = malloc(cap);
+    while(data)
+    {
+        n += fread(data + n, 1, cap - n, file);
+        if(n < cap)
+        {
+            break;
+        }
+        char* bigger = realloc(data, cap * 2);
+        if(!bigger)
+        {
+            free(data);
+            data = NULL;
+            break;
+        }
+        data = bigger;
+        cap *= 2;
+    }
+    fclose(file);
+    *len = n;
+    return data;
+}
+
+// @@diff : {Batch Jobs}
+static void run_job(struct batch_job* job, int core)
+{
+    struct batch_io io = { NULL, 0, 0, 14695981039346656037ULL, 0 };
+    uint64_t start = time_ms();
+    job->exit = EXIT_ERROR;
+
+    struct lc3_vm* vm = vm_create();
+    if(job->input)
+    {
+        io.input = read_file(job->input, &io.input_len);
+    }
+    if(vm && (!job->input || io.input) && vm_load_image(vm, job->image))
+    {
+        const struct lc3_io callbacks = { &io, batch_getc, batch_poll, batch_putc, NULL, NULL, LC3_IN_PROMPT }; // same output as on the console
+        vm_set_io(vm, &callbacks);
+        vm_set_core(vm, core);
+        cfg_translate_loaded(vm); // the whole image before the clock matters, not block by block
+        vm_set_deadline(vm, job->timeout_ms ? start + job->timeout_ms : 0);
+        switch(vm_run(vm, job->budget))
+        {
+            case LC3_RUN_HALT: job->exit = EXIT_HALT; break;
+            case LC3_RUN_BUDGET: job->exit = EXIT_BUDGET; break;
+            case LC3_RUN_DEADLINE: job->exit = EXIT_TIMEOUT; break;
+            default: job->exit = EXIT_FAULT; break;
+        }
+        job->instret = vm->instret;
+        if(job->stats)
+        {
+            vm_stats(vm, job->stats);
+        }
+    }
+    job->output_hash = io.hash;
+    job->output_bytes = io.bytes;
+    job->wall_ms = time_ms() - start;
+    free((char*)io.input);
+    vm_destroy(vm);
+}
+
+static int queue_pop_back(struct batch_queue* q) // the owner's end
+{
+    int job = -1;
+    mutex_lock(q->lock);
+    if(q->head < q->tail)
+    {
+        job = q->jobs[--q->tail];
+    }
+    mutex_unlock(q->lock);
+    return job;
+}
+
+static int queue_steal_front(struct batch_queue* q) // everybody else's end
+{
+    int job = -1;
+    mutex_lock(q->lock);
+    if(q->head < q->tail)
+    {
+        job = q->jobs[q->head++];
+    }
+    mutex_unlock(q->lock);
+    return job;
+}
+
+static void batch_worker(void* arg, int index)
+{
+    struct batch* b = arg;
+    for(;;)
+    {
+        int job = queue_pop_back(&b->queues[index]);
+        for(int i = 1; job < 0 && i < b->queue_count; i++)
+        {
+            job = queue_steal_front(&b->queues[(index + i) % b->queue_count]);
+        }
+        if(job < 0)
+        {
+            return; // nothing is ever added, so empty queues stay empty
+        }
+        run_job(&b->jobs[job], b->core);
+    }
+}
+
+// @@diff : {Manifest}
+static char* join_path(const char* dir, size_t dir_len, const char* path)
+{
+    int absolute = path[0] == '/' || path[0] == '\\' || (path[0] && path[1] == ':');
+    if(absolute)
+    {
+        dir_len = 0;
+    }
+    char* joined = malloc(dir_len + strlen(path) + 1);
+    if(joined)
+    {
+        memcpy(joined, dir, dir_len);
+        strcpy(joined + dir_len, path);
+    }
+    return joined;
+}
+
+static int parse_count(const char* text, uint64_t* value) // decimal digits and nothing else, 0 otherwise
+{
+    char* end;
+    if(*text < '0' || *text > '9')
+    {
+        return 0;
+    }
+    *value = strtoull(text, &end, 10);
+    return *end == '\0';
+}
+
+static int parse_manifest(const char* manifest_path, const struct batch_options* options, struct batch* b)
+{
+    FILE* file = fopen(manifest_path, "r");
+    if(!file)
+    {
+        fprintf(stderr, "failed to open manifest: %s\n", manifest_path);
+        return 0;
+    }
+    const char* slash = strrchr(manifest_path, '/');
+    const char* backslash = strrchr(manifest_path, '\\');
+    if(backslash > slash)
+    {
+        slash = backslash;
+    }
+    size_t dir_len = slash ? (size_t)(slash - manifest_path + 1) : 0; // keeps the trailing separator
+
+    char line[BATCH_LINE_MAX];
+    int capacity = 0, line_no = 0, ok = 1;
+    while(ok && fgets(line, sizeof(line), file))
+    {
+        line_no++;
+        char* image = strtok(line, " \t\r\n");
+        if(!image || image[0] == '#')
+        {
+            continue;
+        }
+        if(b->job_count == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 64;
+            struct batch_job* jobs = realloc(b->jobs, capacity * sizeof(struct batch_job));
+            if(!jobs)
+            {
+                ok = 0;
+                break;
+            }
+            b->jobs = jobs;
+        }
+        struct batch_job* job = &b->jobs[b->job_count++];
+        memset(job, 0, sizeof(*job));
+        job->budget = options->budget;
+        job->timeout_ms = options->timeout_ms;
+        job->image = join_path(manifest_path, dir_len, image);
+        ok = job->image != NULL;
+        int i = 1;
+        for(char* field = strtok(NULL, " \t\r\n"); ok && field; field = strtok(NULL, " \t\r\n"), i++) // the whole line: every extra field is reported
+        {
+            if(strncmp(field, "budget=", 7) == 0 || strncmp(field, "timeout=", 8) == 0)
+            {
+                uint64_t* value = field[0] == 'b' ? &job->budget : &job->timeout_ms;
+                if(!parse_count(strchr(field, '=') + 1, value)) // "budget=" or "budget=1e6" must not mean no limit
+                {
+                    fprintf(stderr, "%s:%d: not a number: %s\n", manifest_path, line_no, field);
+                    ok = 0;
+                }
+            }
+            else if(i == 1 && strcmp(field, "-") != 0)
+            {
+                job->input = join_path(manifest_path, dir_len, field);
+                ok = job->input != NULL;
+            }
+            else if(i != 1)
+            {
+                fprintf(stderr, "%s:%d: unknown field: %s\n", manifest_path, line_no, field);
+                ok = 0;
+            }
+        }
+    }
+    fclose(file);
+    return ok;
+}
+
+static void write_json_string(FILE* out, const char* s)
+{
+    fputc('"', out);
+    for(; *s; s++)
+    {
+        unsigned char c = *s;
+        if(c == '"' || c == '\\')
+        {
+            fprintf(out, "\\%c", c);
+        }
+        else if(c < 0x20)
+        {
+            fprintf(out, "\\u%04x", c);
+        }
+        else
+        {
+            fputc(c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+// @@diff : {Batch Run}
+int batch_run(const char* manifest_path, const struct batch_options* options)
+{
+    struct batch b;
+    memset(&b, 0, sizeof(b));
+    b.core = options->core;
+    int status = 2;
+
+    FILE* out = options->out_path ? fopen(options->out_path, "w") : stdout;
+    if(!out)
+    {
+        fprintf(stderr, "failed to open batch output: %s\n", options->out_path);
+        return 2;
+    }
+    if(!parse_manifest(manifest_path, options, &b))
+    {
+        goto done;
+    }
+
+    b.queue_count = options->threads > 0 ? options->threads : cpu_count();
+    if(b.queue_count > b.job_count)
+    {
+        b.queue_count = b.job_count > 0 ? b.job_count : 1;
+    }
+    b.queues = calloc(b.queue_count, sizeof(struct batch_queue));
+    if(!b.queues)
+    {
+        goto done;
+    }
+    for(int q = 0; q < b.queue_count; q++)
+    {
+        b.queues[q].lock = mutex_create();
+        b.queues[q].jobs = malloc((b.job_count / b.queue_count + 1) * sizeof(int));
+        if(!b.queues[q].lock || !b.queues[q].jobs)
+        {
+            goto done;
+        }
+    }
+    for(int j = 0; options->stats && j < b.job_count; j++)
+    {
+        if(!(b.jobs[j].stats = calloc(1, sizeof(struct lc3_stats))))
+        {
+            goto done;
+        }
+    }
+    for(int j = 0; j < b.job_count; j++) // round-robin, each worker starts on a mix of the manifest
+    {
+        struct batch_queue* q = &b.queues[j % b.queue_count];
+        q->jobs[q->tail++] = j;
+    }
+
+    if(run_threads(b.queue_count, batch_worker, &b) == 0)
+    {
+        batch_worker(&b, 0); // no threads at all, the caller steals everything
+    }
+
+    status = 0;
+    for(int j = 0; j < b.job_count; j++) // manifest order, whatever order the jobs finished in
+    {
+        const struct batch_job* job = &b.jobs[j];
+        fputs("{\"image\":", out);
+        write_json_string(out, job->image);
+        fprintf(out, ",\"exit\":\"%s\",\"output_hash\":\"%016llx\",\"output_bytes\":%llu,\"instret\":%llu,\"wall_ms\":%llu",
+            exit_names[job->exit], (unsigned long long)job->output_hash, (unsigned long long)job->output_bytes,
+            (unsigned long long)job->instret, (unsigned long long)job->wall_ms);
+        if(job->stats)
+        {
+            fputs(",\"stats\":", out);
+            stats_print_json(job->stats, out);
+        }
+        fputs("}\n", out);
+        if(job->exit != EXIT_HALT)
+        {
+            status = 1;
+        }
+    }
+
+done:
+    for(int q = 0; b.queues && q < b.queue_count; q++)
+    {
+        mutex_destroy(b.queues[q].lock);
+        free(b.queues[q].jobs);
+    }
+    free(b.queues);
+    for(int j = 0; j < b.job_count; j++)
+    {
+        free(b.jobs[j].image);
+        free(b.jobs[j].input);
+        free(b.jobs[j].stats);
+    }
+    free(b.jobs);
+    if(out != stdout)
+    {
+        fclose(out);
+    }
+    else
+    {
+        fflush(out);
+    }
+    return status;
+}
@@ -0,0 +1,34 @@
+/*      LC-3 Simulator - batch runner
+*       Runs every job of a manifest on its own VM across a pool of threads and writes one
+*       JSON line of results per job.
+*/
+#ifndef LC3_BATCH_H
+#define LC3_BATCH_H
+
+#include <stdint.h>
+
+// @@diff : {Batch}
+/*
+*   Manifest lines look like
+*
+*       image.obj [input-file|-] [budget=N] [timeout=MS]
+*
+*   Blank lines and lines starting with '#' are skipped. Relative paths are taken relative to
+*   the manifest's directory. The input file is what the program reads from the keyboard;
+*   once it runs out, GETC/IN return EOF. budget= and timeout= override the defaults below.
+*   Any other field, wherever it is on the line, is an error, and so is a value that is not
+*   a decimal number.
+*/
+struct batch_options
+{
+    int threads;          // worker threads, 0 = one per processor
+    int core;             // CORE_* every job runs on
+    uint64_t budget;      // default instruction budget per job, 0 = none
+    uint64_t timeout_ms;  // default wall clock limit per job, 0 = none
+    const char* out_path; // JSONL results, NULL = stdout
+    int stats;            // add each job's struct lc3_stats to its line
+};
+
+int batch_run(const char* manifest_path, const struct batch_options* options); // 0 if every job halted, 1 if any did not, 2 on errors
+
+#endif
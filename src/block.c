@@ -0,0 +1,254 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lc3.h"
+#include "vm.h"
+#include "memory.h"
+#include "predecode.h"
+#include "block.h"
+
+enum
+{
+    BLOCK_POOL_INITIAL = 64 // the pool starts small, most programs are a few dozen blocks
+};
+
+int block_init(struct lc3_vm* vm)
+{
+    if(!vm->blocks)
+    {
+        vm->blocks = calloc(1, sizeof(struct block_cache));
+    }
+    return vm->blocks != NULL;
+}
+
+void block_free(struct lc3_vm* vm)
+{
+    if(vm->blocks)
+    {
+        free(vm->blocks->pool);
+        free(vm->blocks);
+        vm->blocks = NULL;
+    }
+}
+
+void block_flush(struct lc3_vm* vm) // drop every translated block
+{
+    if(!vm->blocks)
+    {
+        return;
+    }
+    block_count_opcodes(vm, vm->stats.opcodes); // the counts outlive the blocks
+    memset(vm->blocks->index, 0, sizeof(vm->blocks->index));
+    vm->blocks->used = 0;
+    for(int i = 0; i < MEMORY_MAX; i++)
+    {
+        vm->code_map[i] &= ~CODE_BLOCK;
+    }
+}
+
+/*
+*   The block core counts a block once when it enters it instead of every instruction, and
+*   takes back the instructions a store skipped when it leaves early. The per-opcode totals are
+*   only worked out here, when somebody asks for them or the blocks are thrown away.
+*/
+void block_count_opcodes(const struct lc3_vm* vm, uint64_t* opcodes)
+{
+    if(!vm->blocks)
+    {
+        return;
+    }
+    for(int b = 0; b < vm->blocks->used; b++)
+    {
+        const struct block* blk = &vm->blocks->pool[b];
+        for(int i = 0; blk->runs && i < blk->length; i++)
+        {
+            opcodes[blk->opcodes[i]] += blk->runs;
+        }
+    }
+}
+
+void block_invalidate(struct lc3_vm* vm, uint16_t address) // called for words marked CODE_BLOCK
+{
+    struct block_cache* cache = vm->blocks;
+    // only blocks starting up to BLOCK_MAX_LEN - 1 words before can cover the address
+    for(int i = 0; i < BLOCK_MAX_LEN; i++)
+    {
+        uint16_t start = address - i;
+        uint16_t index = cache->index[start];
+        if(index && cache->pool[index - 1].length > i)
+        {
+            cache->pool[index - 1].invalid = 1;
+            cache->index[start] = 0;
+        }
+    }
+}
+
+static int op_sets_flags(const struct block_op* op)
+{
+    switch(op->handler)
+    {
+        case B_ADD_REG: case B_ADD_IMM: case B_AND_REG: case B_AND_IMM: case B_NOT:
+        case B_LD: case B_LDI: case B_LDR: case B_LEA:
+            return 1;
+    }
+    return 0;
+}
+
+static int op_may_read_psr(const struct block_op* op) // loads that may hit the device page
+{
+    switch(op->handler)
+    {
+        case B_LD: case B_LD_NF:
+            return op->x >= MMIO_BASE;
+        case B_LDI: case B_LDI_NF: case B_LDR: case B_LDR_NF:
+            return 1;
+    }
+    return 0;
+}
+
+struct block* block_translate(struct lc3_vm* vm, uint16_t start)
+{
+    struct block_cache* cache = vm->blocks;
+    if(cache->used == cache->capacity)
+    {
+        if(cache->capacity == BLOCK_POOL_SIZE)
+        {
+            block_flush(vm);
+        }
+        else
+        {
+            int capacity = cache->capacity ? cache->capacity * 2 : BLOCK_POOL_INITIAL;
+            struct block* pool = realloc(cache->pool, capacity * sizeof(struct block)); // nothing holds a block pointer across translation
+            if(!pool)
+            {
+                return NULL;
+            }
+            cache->pool = pool;
+            cache->capacity = capacity;
+        }
+    }
+    struct block* blk = &cache->pool[cache->used];
+    struct block_op* ops = blk->ops;
+    int n = 0;
+    uint16_t pc = start;
+
+    for(;;)
+    {
+        if(pc >= MMIO_BASE || n == BLOCK_MAX_LEN - 1) // never translate the device page, leave room for B_EXIT
+        {
+            ops[n].handler = B_EXIT;
+            ops[n].x = pc;
+            n++;
+            break;
+        }
+
+        struct decoded_instr d;
+        decode_instr(mem_peek(vm, pc), &d);
+        blk->opcodes[pc - start] = mem_peek(vm, pc) >> 12;
+        struct block_op* op = &ops[n++];
+        memset(op, 0, sizeof(*op));
+        op->a = d.dr;
+        op->b = d.sr1;
+        op->c = d.sr2;
+        op->imm = d.imm;
+        pc++; // PC relative operands are relative to the next instruction
+        op->z = pc;
+
+        int ends_block = 1;
+        switch(d.handler)
+        {
+            case H_ADD_REG: op->handler = B_ADD_REG; ends_block = 0; break;
+            case H_ADD_IMM: op->handler = B_ADD_IMM; ends_block = 0; break;
+            case H_AND_REG: op->handler = B_AND_REG; ends_block = 0; break;
+            case H_AND_IMM: op->handler = B_AND_IMM; ends_block = 0; break;
+            case H_NOT:     op->handler = B_NOT; ends_block = 0; break;
+            case H_LD:      op->handler = B_LD; op->x = pc + d.imm; ends_block = 0; break;
+            case H_LDI:     op->handler = B_LDI; op->x = pc + d.imm; ends_block = 0; break;
+            case H_LDR:     op->handler = B_LDR; ends_block = 0; break;
+            case H_LEA:     op->handler = B_LEA; op->x = pc + d.imm; ends_block = 0; break;
+            case H_ST:      op->handler = B_ST; op->x = pc + d.imm; ends_block = 0; break;
+            case H_STI:     op->handler = B_STI; op->x = pc + d.imm; ends_block = 0; break;
+            case H_STR:     op->handler = B_STR; ends_block = 0; break;
+            case H_BR:      op->handler = B_BR; op->x = pc + d.imm; op->y = pc; break;
+            case H_JMP:     op->handler = B_JMP; break;
+            case H_JSR:     op->handler = B_JSR; op->x = pc + d.imm; op->y = pc; break;
+            case H_JSRR:    op->handler = B_JSRR; op->y = pc; break;
+            case H_TRAP:    op->handler = B_TRAP; op->y = pc; break;
+            default:        op->handler = B_BAD; op->y = pc - 1; break;
+        }
+        if(ends_block)
+        {
+            break;
+        }
+    }
+    blk->start = start;
+    blk->length = pc - start;
+    blk->invalid = 0;
+    blk->runs = 0;
+
+    // condition codes are live at the end of the block, after every store (a store can
+    // end the block early by overwriting it) and before every load (a load can read them
+    // through the PSR); everything else that is overwritten is dead
+    int flags_live = 1;
+    for(int i = n - 1; i >= 0; i--)
+    {
+        struct block_op* op = &ops[i];
+        if(op->handler == B_ST || op->handler == B_STI || op->handler == B_STR)
+        {
+            flags_live = 1;
+        }
+        else if(op_sets_flags(op))
+        {
+            if(!flags_live)
+            {
+                op->handler++; // the *_NF variant follows every flag setting op
+            }
+            flags_live = op_may_read_psr(op);
+        }
+    }
+
+    // fuse LD+ADD+ST and ADD+BR
+    int out = 0;
+    for(int i = 0; i < n; i++)
+    {
+        struct block_op* op = &ops[i];
+        if(i + 2 < n && (op->handler == B_LD || op->handler == B_LD_NF)
+            && (ops[i + 1].handler == B_ADD_IMM || ops[i + 1].handler == B_ADD_IMM_NF)
+            && ops[i + 2].handler == B_ST)
+        {
+            struct block_op fused = *op;
+            fused.handler = B_LD_ADD_ST;
+            fused.b = ops[i + 1].a; // ADD destination
+            fused.c = ops[i + 1].b; // ADD source
+            fused.imm = ops[i + 1].imm;
+            fused.d = ops[i + 2].a; // ST source
+            fused.y = ops[i + 2].x; // ST address
+            fused.z = ops[i + 2].z;
+            ops[out++] = fused;
+            i += 2;
+        }
+        else if(i + 1 < n && (op->handler == B_ADD_IMM || op->handler == B_ADD_IMM_NF)
+            && ops[i + 1].handler == B_BR)
+        {
+            struct block_op fused = ops[i + 1];
+            fused.handler = B_ADD_BR;
+            fused.b = op->a; // ADD destination
+            fused.c = op->b; // ADD source
+            fused.imm = op->imm;
+            ops[out++] = fused;
+            i += 1;
+        }
+        else
+        {
+            ops[out++] = *op;
+        }
+    }
+
+    for(uint16_t a = start; a != pc; a++)
+    {
+        vm->code_map[a] |= CODE_BLOCK;
+    }
+    cache->index[start] = ++cache->used;
+    return blk;
+}
@@ -0,0 +1,109 @@
+/*      LC-3 Simulator - basic block translation
+*/
+#ifndef LC3_BLOCK_H
+#define LC3_BLOCK_H
+
+#include <stdint.h>
+
+#include "lc3.h"
+
+// @@diff : {Basic Blocks}
+/*
+*   The block core goes one step further than the predecode table. It translates a whole
+*   basic block (a straight run of instructions that ends at BR, JMP/RET, JSR/JSRR or TRAP)
+*   into an array of block ops and runs it without going back to the dispatch loop in between.
+*
+*   While translating:
+*       - PC relative operands become absolute addresses, so the ops never touch R_PC;
+*         only the op that ends the block writes it.
+*       - condition codes that a later op in the same block overwrites before anything can
+*         read them are not computed at all (the *_NF ops).
+*       - common pairs are fused into one op: LD+ADD+ST (load, add an immediate, store back)
+*         and ADD+BR (the decrement-and-branch loop counter).
+*
+*   Blocks are looked up by start PC in the cache index. Every word that is part of a block is
+*   marked CODE_BLOCK in the VM's code map; mem_write() calls block_invalidate() when it hits
+*   one of those. When the pool is full every block is thrown away and translation starts over.
+*/
+enum
+{
+    BLOCK_MAX_LEN = 32,     // longest block in instructions, also bounds the invalidation scan
+    BLOCK_POOL_SIZE = 4096  // blocks translated before the whole cache is flushed
+};
+
+enum
+{
+    B_ADD_REG = 0,
+    B_ADD_REG_NF,
+    B_ADD_IMM,
+    B_ADD_IMM_NF,
+    B_AND_REG,
+    B_AND_REG_NF,
+    B_AND_IMM,
+    B_AND_IMM_NF,
+    B_NOT,
+    B_NOT_NF,
+    B_LD,
+    B_LD_NF,
+    B_LDI,
+    B_LDI_NF,
+    B_LDR,
+    B_LDR_NF,
+    B_LEA,
+    B_LEA_NF,
+    B_ST,
+    B_STI,
+    B_STR,
+    B_LD_ADD_ST,  // fused LD, ADD immediate, ST
+    // ops below end the block
+    B_BR,
+    B_ADD_BR,     // fused ADD immediate and BR
+    B_JMP,
+    B_JSR,
+    B_JSRR,
+    B_TRAP,
+    B_EXIT,       // block was cut short, continue at x
+    B_BAD,
+    B_COUNT
+};
+
+struct block_op
+{
+    uint8_t handler; // B_* value
+    uint8_t a;       // destination register (source for stores, nzp mask for branches)
+    uint8_t b;       // first operand / base register
+    uint8_t c;       // second operand register
+    uint8_t d;       // extra registers of fused ops
+    uint8_t e;
+    uint16_t imm;    // immediate / offset, trap vector
+    uint16_t x;      // absolute address, branch target
+    uint16_t y;      // second absolute address, fall through PC
+    uint16_t z;      // PC after this op, for stores that have to leave the block early
+};
+
+struct block
+{
+    uint16_t start;   // address of the first instruction
+    uint16_t length;  // number of LC-3 instructions covered
+    int invalid;      // set when a covered word was overwritten
+    uint64_t runs;    // times entered, for the opcode counts (see block_count_opcodes())
+    uint8_t opcodes[BLOCK_MAX_LEN]; // opcode of each covered instruction, as translated
+    struct block_op ops[BLOCK_MAX_LEN];
+};
+
+struct block_cache
+{
+    struct block* pool;          // grows up to BLOCK_POOL_SIZE blocks
+    int used;
+    int capacity;
+    uint16_t index[MEMORY_MAX];  // pool index + 1 of the block starting at each address, 0 = none
+};
+
+int block_init(struct lc3_vm* vm); // allocate the cache on first use, 0 if out of memory
+void block_free(struct lc3_vm* vm);
+void block_flush(struct lc3_vm* vm); // drop every translated block
+void block_invalidate(struct lc3_vm* vm, uint16_t address); // called for words marked CODE_BLOCK
+struct block* block_translate(struct lc3_vm* vm, uint16_t start); // NULL if out of memory
+void block_count_opcodes(const struct lc3_vm* vm, uint64_t* opcodes); // add what the cached blocks ran: runs times their opcodes
+
+#endif
@@ -0,0 +1,33 @@
+#include <stdio.h>
+#include <stdint.h>
+
+#include "lc3.h"
+
+// @@diff : {Buffer I/O}
+static int buffer_getc(void* ctx)
+{
+    struct lc3_buffer_io* b = ctx;
+    return b->input_pos < b->input_size ? (unsigned char)b->input[b->input_pos++] : EOF;
+}
+
+static int buffer_poll(void* ctx)
+{
+    struct lc3_buffer_io* b = ctx;
+    return b->input_pos < b->input_size;
+}
+
+static void buffer_putc(void* ctx, char c)
+{
+    struct lc3_buffer_io* b = ctx;
+    if(b->output_size < b->output_cap)
+    {
+        b->output[b->output_size] = c;
+    }
+    b->output_size++;
+}
+
+void vm_set_buffer_io(struct lc3_vm* vm, struct lc3_buffer_io* buffers)
+{
+    const struct lc3_io io = { buffers, buffer_getc, buffer_poll, buffer_putc, NULL, NULL, NULL };
+    vm_set_io(vm, &io);
+}
@@ -0,0 +1,420 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lc3.h"
+#include "vm.h"
+#include "memory.h"
+#include "predecode.h"
+#include "block.h"
+#include "image.h"
+#include "system.h"
+#include "checkpoint.h"
+#include "platform.h"
+
+enum
+{
+    CHECKPOINT_STATE_BYTES = 8 + 2 * R_COUNT + 4 + 6 + 2, // instret ... page count
+    CHECKPOINT_PAGE_BYTES = 4,                             // number, encoding, data size
+    CHECKPOINT_MAX_PAYLOAD = CHECKPOINT_STATE_BYTES + PAGE_COUNT * (CHECKPOINT_PAGE_BYTES + 2 * PAGE_WORDS)
+};
+
+struct lc3_checkpoint
+{
+    struct lc3_vm* vm;
+    FILE* file;
+    struct lc3_snapshot* base;  // the machine as of the last record; pages that differ from it are dirty
+    uint8_t* payload;           // CHECKPOINT_MAX_PAYLOAD bytes, a record is built here before it is written
+    uint64_t bytes;
+};
+
+static void put16(uint8_t* p, uint16_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static void put32(uint8_t* p, uint32_t v)
+{
+    put16(p, (uint16_t)v);
+    put16(p + 2, (uint16_t)(v >> 16));
+}
+
+static uint16_t get16(const uint8_t* p)
+{
+    return (uint16_t)(p[0] | p[1] << 8);
+}
+
+static uint32_t get32(const uint8_t* p)
+{
+    return get16(p) | (uint32_t)get16(p + 2) << 16;
+}
+
+// @@diff : {Page Encoding}
+/*
+*   Runs of three or more equal words become a run token, everything else goes out as
+*   literals. Programs leave most of a page zero or filled with one value, so a typical dirty
+*   page shrinks to a few dozen bytes; a page that does not get smaller is stored raw.
+*/
+static size_t encode_rle(const uint16_t* words, uint8_t* out)
+{
+    size_t at = 0;
+    int i = 0;
+    while(i < PAGE_WORDS)
+    {
+        int run = 1;
+        while(i + run < PAGE_WORDS && words[i + run] == words[i])
+        {
+            run++;
+        }
+        if(run >= 3)
+        {
+            put16(out + at, (uint16_t)(0x8000 | run));
+            put16(out + at + 2, words[i]);
+            at += 4;
+            i += run;
+            continue;
+        }
+        int start = i; // literals up to the next run of three
+        while(i < PAGE_WORDS && !(i + 2 < PAGE_WORDS && words[i] == words[i + 1] && words[i] == words[i + 2]))
+        {
+            i++;
+        }
+        put16(out + at, (uint16_t)(i - start));
+        at += 2;
+        for(int w = start; w < i; w++, at += 2)
+        {
+            put16(out + at, words[w]);
+        }
+    }
+    return at;
+}
+
+static int decode_page(int encoding, const uint8_t* data, size_t size, uint16_t* words) // words may be NULL to only check, 1 if valid
+{
+    if(encoding == CHECKPOINT_PAGE_ZERO)
+    {
+        if(words)
+        {
+            memset(words, 0, PAGE_WORDS * sizeof(uint16_t));
+        }
+        return size == 0;
+    }
+    if(encoding == CHECKPOINT_PAGE_RAW)
+    {
+        for(int i = 0; words && i < PAGE_WORDS; i++)
+        {
+            words[i] = get16(data + 2 * i);
+        }
+        return size == 2 * PAGE_WORDS;
+    }
+    if(encoding != CHECKPOINT_PAGE_RLE)
+    {
+        return 0;
+    }
+    size_t at = 0;
+    int filled = 0;
+    while(at + 2 <= size)
+    {
+        uint16_t token = get16(data + at);
+        int count = token & 0x7FFF;
+        size_t need = token & 0x8000 ? 2 : 2 * (size_t)count;
+        at += 2;
+        if(filled + count > PAGE_WORDS || at + need > size)
+        {
+            return 0;
+        }
+        for(int i = 0; words && i < count; i++)
+        {
+            words[filled + i] = get16(data + at + (token & 0x8000 ? 0 : 2 * i));
+        }
+        filled += count;
+        at += need;
+    }
+    return at == size && filled == PAGE_WORDS;
+}
+
+static int page_is_zero(const struct lc3_page* page)
+{
+    if(page == &zero_page)
+    {
+        return 1;
+    }
+    for(int i = 0; i < PAGE_WORDS; i++)
+    {
+        if(page->words[i])
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// @@diff : {Write}
+static size_t put_page(uint8_t* out, int p, const struct lc3_page* page)
+{
+    out[0] = (uint8_t)p;
+    size_t size = 0;
+    if(page_is_zero(page))
+    {
+        out[1] = CHECKPOINT_PAGE_ZERO;
+    }
+    else
+    {
+        uint8_t rle[4 * PAGE_WORDS]; // worst case: a literal token per word
+        size = encode_rle(page->words, rle);
+        if(size < 2 * PAGE_WORDS)
+        {
+            out[1] = CHECKPOINT_PAGE_RLE;
+            memcpy(out + CHECKPOINT_PAGE_BYTES, rle, size);
+        }
+        else
+        {
+            out[1] = CHECKPOINT_PAGE_RAW;
+            size = 2 * PAGE_WORDS;
+            for(int i = 0; i < PAGE_WORDS; i++)
+            {
+                put16(out + CHECKPOINT_PAGE_BYTES + 2 * i, page->words[i]);
+            }
+        }
+    }
+    put16(out + 2, (uint16_t)size);
+    return CHECKPOINT_PAGE_BYTES + size;
+}
+
+static int write_record(struct lc3_checkpoint* cp, int kind)
+{
+    struct lc3_vm* vm = cp->vm;
+    uint8_t* out = cp->payload;
+    for(int i = 0; i < 8; i++)
+    {
+        out[i] = (uint8_t)(vm->instret >> 8 * i);
+    }
+    for(int r = 0; r < R_COUNT; r++)
+    {
+        put16(out + 8 + 2 * r, vm->reg[r]);
+    }
+    uint8_t* state = out + 8 + 2 * R_COUNT;
+    state[0] = (uint8_t)vm->running;
+    state[1] = (uint8_t)vm->fault;
+    state[2] = (uint8_t)vm->system.enabled;
+    state[3] = 0;
+    put16(state + 4, vm->system.psr);
+    put16(state + 6, vm->system.saved_ssp);
+    put16(state + 8, vm->system.saved_usp);
+
+    size_t at = CHECKPOINT_STATE_BYTES;
+    int pages = 0;
+    for(int p = 0; p < PAGE_COUNT; p++)
+    {
+        const struct lc3_page* page = vm->pages[p];
+        int dirty = kind == CHECKPOINT_FULL ? !page_is_zero(page)
+            : page != cp->base->pages[p] && memcmp(page->words, cp->base->pages[p]->words, sizeof(page->words)) != 0;
+        if(dirty)
+        {
+            at += put_page(out + at, p, page);
+            pages++;
+        }
+    }
+    put16(out + CHECKPOINT_STATE_BYTES - 2, (uint16_t)pages);
+
+    uint8_t header[CHECKPOINT_HEADER_BYTES];
+    memcpy(header, "LC3K", 4);
+    put16(header + 4, CHECKPOINT_VERSION);
+    put16(header + 6, (uint16_t)kind);
+    put32(header + 8, (uint32_t)at);
+    put32(header + 12, image_checksum(out, at));
+    if(fwrite(header, 1, sizeof(header), cp->file) != sizeof(header) || fwrite(out, 1, at, cp->file) != at || fflush(cp->file) != 0)
+    {
+        return 0;
+    }
+    cp->bytes += sizeof(header) + at;
+
+    struct lc3_snapshot* base = vm_snapshot(vm); // the next record is relative to this one
+    if(!base)
+    {
+        return 0;
+    }
+    snapshot_destroy(cp->base);
+    cp->base = base;
+    return 1;
+}
+
+struct lc3_checkpoint* checkpoint_open(struct lc3_vm* vm, const char* path, int append)
+{
+    struct lc3_checkpoint* cp = calloc(1, sizeof(struct lc3_checkpoint));
+    if(!cp)
+    {
+        return NULL;
+    }
+    cp->vm = vm;
+    cp->payload = malloc(CHECKPOINT_MAX_PAYLOAD);
+    cp->file = cp->payload ? fopen(path, append ? "ab" : "wb") : NULL;
+    if(cp->file && append)
+    {
+        cp->base = vm_snapshot(vm); // vm was just loaded from this file, so that is what the file holds
+    }
+    if(!cp->file || (append ? !cp->base : !write_record(cp, CHECKPOINT_FULL)))
+    {
+        checkpoint_close(cp);
+        return NULL;
+    }
+    return cp;
+}
+
+int checkpoint_write(struct lc3_checkpoint* cp)
+{
+    return write_record(cp, CHECKPOINT_INCREMENTAL);
+}
+
+uint64_t checkpoint_bytes(const struct lc3_checkpoint* cp)
+{
+    return cp->bytes;
+}
+
+void checkpoint_close(struct lc3_checkpoint* cp)
+{
+    if(!cp)
+    {
+        return;
+    }
+    if(cp->file)
+    {
+        fclose(cp->file);
+    }
+    snapshot_destroy(cp->base);
+    free(cp->payload);
+    free(cp);
+}
+
+// @@diff : {Load}
+/*
+*   Each record is checked completely (header, checksum, every page) before any of it is
+*   applied, so a damaged record leaves the machine in the state of the one before.
+*/
+static int check_record(const uint8_t* data, size_t size, int first)
+{
+    if(size < CHECKPOINT_HEADER_BYTES || memcmp(data, "LC3K", 4) != 0 || get16(data + 4) != CHECKPOINT_VERSION)
+    {
+        return 0;
+    }
+    int kind = get16(data + 6);
+    size_t payload = get32(data + 8);
+    if((kind != CHECKPOINT_FULL && (first || kind != CHECKPOINT_INCREMENTAL)) || payload < CHECKPOINT_STATE_BYTES
+        || payload > size - CHECKPOINT_HEADER_BYTES)
+    {
+        return 0;
+    }
+    const uint8_t* p = data + CHECKPOINT_HEADER_BYTES;
+    if(image_checksum(p, payload) != get32(data + 12))
+    {
+        return 0;
+    }
+    size_t at = CHECKPOINT_STATE_BYTES;
+    for(int n = get16(p + CHECKPOINT_STATE_BYTES - 2); n > 0; n--)
+    {
+        if(payload - at < CHECKPOINT_PAGE_BYTES)
+        {
+            return 0;
+        }
+        size_t page_size = get16(p + at + 2);
+        if(payload - at - CHECKPOINT_PAGE_BYTES < page_size || !decode_page(p[at + 1], p + at + CHECKPOINT_PAGE_BYTES, page_size, NULL))
+        {
+            return 0;
+        }
+        at += CHECKPOINT_PAGE_BYTES + page_size;
+    }
+    return at == payload;
+}
+
+static int apply_record(struct lc3_vm* vm, const uint8_t* data) // 0 if out of memory
+{
+    const uint8_t* p = data + CHECKPOINT_HEADER_BYTES;
+    if(get16(data + 6) == CHECKPOINT_FULL)
+    {
+        vm_reset(vm); // pages it does not list are zero
+    }
+    vm->instret = 0;
+    for(int i = 7; i >= 0; i--)
+    {
+        vm->instret = vm->instret << 8 | p[i];
+    }
+    for(int r = 0; r < R_COUNT; r++)
+    {
+        vm->reg[r] = get16(p + 8 + 2 * r);
+    }
+    const uint8_t* state = p + 8 + 2 * R_COUNT;
+    vm->running = state[0];
+    vm->fault = state[1];
+    vm->system.enabled = state[2];
+    vm->system.psr = get16(state + 4);
+    vm->system.saved_ssp = get16(state + 6);
+    vm->system.saved_usp = get16(state + 8);
+
+    size_t at = CHECKPOINT_STATE_BYTES;
+    for(int n = get16(p + CHECKPOINT_STATE_BYTES - 2); n > 0; n--)
+    {
+        int page = p[at];
+        size_t page_size = get16(p + at + 2);
+        if(p[at + 1] != CHECKPOINT_PAGE_ZERO || vm->pages[page] != &zero_page)
+        {
+            uint16_t* words = vm->writable[page] ? vm->writable[page] : page_unshare(vm, page);
+            if(words == vm->discard)
+            {
+                return 0;
+            }
+            decode_page(p[at + 1], p + at + CHECKPOINT_PAGE_BYTES, page_size, words);
+        }
+        at += CHECKPOINT_PAGE_BYTES + page_size;
+    }
+    return 1;
+}
+
+int checkpoint_load(struct lc3_vm* vm, const char* path, struct checkpoint_report* report)
+{
+    memset(report, 0, sizeof(*report));
+    size_t size = 0;
+    const uint8_t* data = map_file(path, &size);
+    if(!data)
+    {
+        snprintf(report->message, sizeof(report->message), "cannot open");
+        return 0;
+    }
+    size_t at = 0;
+    while(at < size)
+    {
+        if(!check_record(data + at, size - at, report->records == 0))
+        {
+            if(report->records == 0)
+            {
+                snprintf(report->message, sizeof(report->message), "not a checkpoint, or its first record is damaged");
+                unmap_file(data, size);
+                return 0;
+            }
+            snprintf(report->message, sizeof(report->message), "damaged record at byte %llu ignored, with everything after it", (unsigned long long)at);
+            report->truncated = 1;
+            break;
+        }
+        if(!apply_record(vm, data + at))
+        {
+            snprintf(report->message, sizeof(report->message), "out of memory");
+            unmap_file(data, size);
+            return 0;
+        }
+        report->records++;
+        report->instret = vm->instret;
+        at += CHECKPOINT_HEADER_BYTES + get32(data + at + 8);
+    }
+    unmap_file(data, size);
+    if(report->records == 0)
+    {
+        snprintf(report->message, sizeof(report->message), "empty file");
+        return 0;
+    }
+    predecode_flush(vm); // memory changed behind mem_write()'s back
+    block_flush(vm);
+    memset(vm->loaded, 0, sizeof(vm->loaded));
+    vm->timer_last_ms = vm->io.clock ? vm->io.clock(vm->io.ctx) : time_ms(); // the timer interval starts over
+    return 1;
+}
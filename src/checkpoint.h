@@ -0,0 +1,68 @@
+/*      LC-3 Simulator - checkpoints
+*       Saves a machine to disk and brings it back, so a long run can be paused, moved to
+*       another host or picked up again after a crash. Later checkpoints of the same run only
+*       write the pages that changed.
+*/
+#ifndef LC3_CHECKPOINT_H
+#define LC3_CHECKPOINT_H
+
+#include <stdint.h>
+
+#include "lc3.h"
+
+// @@diff : {Checkpoints}
+/*
+*   A checkpoint file is a sequence of records, each one complete on its own:
+*       "LC3K", version (u16), kind (u16), payload size (u32), Adler-32 of the payload (u32)
+*   followed by the payload:
+*       instret (u64), R0-R7, PC and COND (u16 each), running, fault and full-system mode
+*       (u8 each, one byte of padding), PSR, saved SSP and saved USP (u16 each), the page
+*       count (u16), then per page its number (u8), encoding (u8), data size in bytes (u16)
+*       and the data.
+*   Everything is little endian. A CHECKPOINT_FULL record holds every page that is not all
+*   zero; a CHECKPOINT_INCREMENTAL record only the pages written since the record before it.
+*   Device registers live in the device page, so they come with the memory.
+*
+*   Pages are CHECKPOINT_PAGE_ZERO (no data), CHECKPOINT_PAGE_RAW (256 words) or
+*   CHECKPOINT_PAGE_RLE: tokens of one u16 each, either a run (bit 15 set, the low bits
+*   count, one word follows) or literals (the count, then that many words).
+*
+*   Dirty pages cost nothing to track: memory is copy-on-write (see {Memory Pages}), and the
+*   writer keeps a snapshot of the machine as of its last record, so a page that the program
+*   wrote since is exactly one whose pointer differs from the snapshot's. The first write to
+*   each page after a record copies it once, like after any snapshot.
+*
+*   Loading maps the file and applies the records in order; a damaged or torn record (a
+*   worker that died while appending) ends the file there, and the machine is left in the
+*   state of the last good record. Translation caches are rebuilt, and the I/O callbacks,
+*   core and host side device state (the timer restarts its interval) are not saved.
+*/
+enum
+{
+    CHECKPOINT_VERSION = 1,
+    CHECKPOINT_FULL = 1,
+    CHECKPOINT_INCREMENTAL = 2,
+    CHECKPOINT_HEADER_BYTES = 16,
+
+    CHECKPOINT_PAGE_ZERO = 0,
+    CHECKPOINT_PAGE_RAW,
+    CHECKPOINT_PAGE_RLE
+};
+
+struct checkpoint_report
+{
+    char message[160];      // why the file could not be used, or that its tail was damaged
+    uint64_t records;       // records applied
+    uint64_t instret;       // instruction count of the last of them
+    int truncated;          // records after those were damaged and ignored
+};
+
+struct lc3_checkpoint;
+
+struct lc3_checkpoint* checkpoint_open(struct lc3_vm* vm, const char* path, int append); // new file with a full record, or (append) add to the file vm was loaded from; NULL on failure
+int checkpoint_write(struct lc3_checkpoint* cp); // append a record of what changed since the last one, 1 on success
+uint64_t checkpoint_bytes(const struct lc3_checkpoint* cp); // written so far
+void checkpoint_close(struct lc3_checkpoint* cp);
+int checkpoint_load(struct lc3_vm* vm, const char* path, struct checkpoint_report* report); // put vm in the state of the file's last good record, 1 on success
+
+#endif
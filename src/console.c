@@ -0,0 +1,114 @@
+#include <stdio.h>
+#include <stdint.h>
+
+#include "console.h"
+#include "platform.h"
+
+// @@diff : {Console}
+/*
+*   TRAP output and DDR writes go into a ring buffer instead of one putc()+fflush() per
+*   character. The buffer is written out when a newline is printed, when the program asks
+*   for input (so prompts show up), when it is full, when CONSOLE_FLUSH_MS have passed since
+*   the last flush, and at HALT/exit.
+*/
+enum
+{
+    CONSOLE_BUFFER_SIZE = 4096,
+    CONSOLE_FLUSH_MS = 50
+};
+
+static char console_buffer[CONSOLE_BUFFER_SIZE];
+static unsigned console_head = 0; // next byte to write out
+static unsigned console_tail = 0; // next free byte, head == tail means empty
+static uint64_t console_last_flush = 0;
+
+void console_flush()
+{
+    while(console_head != console_tail)
+    {
+        unsigned end = console_tail > console_head ? console_tail : CONSOLE_BUFFER_SIZE; // contiguous part
+        fwrite(console_buffer + console_head, 1, end - console_head, stdout);
+        console_head = end % CONSOLE_BUFFER_SIZE;
+    }
+    console_head = console_tail = 0;
+    fflush(stdout);
+    console_last_flush = time_ms();
+}
+
+void console_putc(char c)
+{
+    unsigned next = (console_tail + 1) % CONSOLE_BUFFER_SIZE;
+    if(next == console_head)
+    {
+        console_flush(); // full
+        next = 1;
+    }
+    console_buffer[console_tail] = c;
+    console_tail = next;
+    if(c == '\n' || time_ms() - console_last_flush >= CONSOLE_FLUSH_MS)
+    {
+        console_flush();
+    }
+}
+
+void console_puts(const char* s)
+{
+    while(*s)
+    {
+        console_putc(*s++);
+    }
+}
+
+uint16_t console_poll() // non-blocking: is there a key to read?
+{
+    if(console_head != console_tail)
+    {
+        console_flush(); // the program is waiting on the user, show what it printed
+    }
+    return check_key();
+}
+
+int console_getc() // blocking read of one key
+{
+    if(console_head != console_tail)
+    {
+        console_flush();
+    }
+    return read_key();
+}
+
+void console_wait(int timeout_ms)
+{
+    if(console_head != console_tail)
+    {
+        console_flush();
+    }
+    wait_key(timeout_ms);
+}
+
+static int console_io_getc(void* ctx)
+{
+    return console_getc();
+}
+
+static int console_io_poll(void* ctx)
+{
+    return console_poll();
+}
+
+static void console_io_putc(void* ctx, char c)
+{
+    console_putc(c);
+}
+
+static void console_io_flush(void* ctx)
+{
+    console_flush();
+}
+
+static void console_io_wait(void* ctx, int timeout_ms)
+{
+    console_wait(timeout_ms);
+}
+
+const struct lc3_io console_io = { NULL, console_io_getc, console_io_poll, console_io_putc, console_io_flush, NULL, LC3_IN_PROMPT, console_io_wait };
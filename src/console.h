@@ -0,0 +1,25 @@
+/*      LC-3 Simulator - console
+*       Buffered terminal output and non-blocking keyboard input for the TRAP routines and
+*       the memory-mapped keyboard/display.
+*/
+#ifndef LC3_CONSOLE_H
+#define LC3_CONSOLE_H
+
+#include <stdint.h>
+
+#include "lc3.h"
+
+void console_flush(); // write out everything buffered so far
+void console_putc(char c);
+void console_puts(const char* s);
+uint16_t console_poll(); // non-blocking: is there a key to read?
+int console_getc(); // blocking read of one key
+void console_wait(int timeout_ms); // show what was printed, then sleep until a key arrives or timeout_ms pass
+
+/*
+*   struct lc3_io that routes a VM to the console; vm_create() installs it.
+*   The console itself is process wide, so only one VM should use it at a time.
+*/
+extern const struct lc3_io console_io;
+
+#endif
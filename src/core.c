@@ -0,0 +1,260 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lc3.h"
+#include "core.h"
+#include "vm.h"
+#include "trace.h"
+#include "profile.h"
+#include "predecode.h"
+#include "block.h"
+#include "mmio.h"
+#include "console.h"
+#include "memory.h"
+#include "system.h"
+#include "debug.h"
+#include "undo.h"
+#include "platform.h"
+
+// @@diff : {VM Lifetime}
+struct lc3_vm* vm_create()
+{
+    struct lc3_vm* vm = calloc(1, sizeof(struct lc3_vm)); // the caches are allocated later, on first use
+    if(!vm)
+    {
+        return NULL;
+    }
+    pages_release(vm); // every page starts out as the shared zero page
+    vm->io = console_io;
+    vm->core = CORE_THREADED;
+    vm_reset(vm);
+    return vm;
+}
+
+void vm_destroy(struct lc3_vm* vm)
+{
+    if(!vm)
+    {
+        return;
+    }
+    trace_close(vm);
+    profile_close(vm);
+    debug_close(vm);
+    undo_close(vm);
+    pages_release(vm);
+    predecode_free(vm);
+    block_free(vm);
+    free(vm);
+}
+
+// @@diff : {Reset}
+void vm_reset(struct lc3_vm* vm) // clear memory, registers and every cache, ready to load an image
+{
+    pages_release(vm);
+    memset(vm->loaded, 0, sizeof(vm->loaded));
+    memset(vm->reg, 0, sizeof(vm->reg));
+    predecode_flush(vm);
+    block_flush(vm);
+    memset(&vm->stats, 0, sizeof(vm->stats)); // after the flush, which folds the block counts into them
+    mmio_init(vm); // register the devices in the 0xFE00 page
+    vm->timer_last_ms = 0;
+    system_reset(vm); // full-system mode stays on or off, the machine starts in user mode
+
+    /*   since exactly one condition flag should be set at any 
+    *    given time, set the Z flag 
+    */
+    vm->reg[R_COND] = FL_ZRO;
+    vm->reg[R_PC] = PC_START; // default PC starting position
+    vm->running = 1;
+    vm->fault = 0;
+    vm->instret = 0;
+    undo_clear(vm); // nothing before a reset can be undone
+}
+
+void vm_set_io(struct lc3_vm* vm, const struct lc3_io* io)
+{
+    vm->io = *io;
+}
+
+void vm_set_core(struct lc3_vm* vm, int core)
+{
+    vm->core = core;
+}
+
+void vm_set_system(struct lc3_vm* vm, int on)
+{
+    vm->system.enabled = on;
+}
+
+int vm_run_result(struct lc3_vm* vm, uint64_t n_steps, struct lc3_run_result* result)
+{
+    uint64_t start = vm->instret;
+    result->status = vm_run(vm, n_steps);
+    result->fault = vm->fault;
+    result->pc = vm->reg[R_PC];
+    result->instructions = vm->instret - start;
+    result->instret = vm->instret;
+    return result->status;
+}
+
+void vm_stats(struct lc3_vm* vm, struct lc3_stats* stats)
+{
+    *stats = vm->stats;
+    block_count_opcodes(vm, stats->opcodes);
+    stats->instructions = vm->instret;
+    const uint64_t* op = stats->opcodes;
+    stats->loads = op[OP_LD] + op[OP_LDR] + 2 * op[OP_LDI] + op[OP_STI];
+    stats->stores = op[OP_ST] + op[OP_STR] + op[OP_STI];
+}
+
+const char* vm_fault_name(int fault)
+{
+    static const char* names[] = { "none", "bad opcode", "privileged instruction", "out of memory", "no handler in the vector table" };
+    return fault >= 0 && fault <= LC3_FAULT_VECTOR ? names[fault] : "unknown";
+}
+
+void vm_set_deadline(struct lc3_vm* vm, uint64_t deadline_ms)
+{
+    vm->deadline_ms = deadline_ms;
+}
+
+// @@diff : {Core Selection}
+static void run_core(struct lc3_vm* vm, uint64_t n_steps)
+{
+    if(vm->trace.level || vm->undo || vm->system.enabled || vm->core == CORE_SWITCH || (vm->debug && vm->debug->read_watches))
+    {
+        run_switch(vm, n_steps); // only the switch core calls the trace and undo hooks, runs full-system mode and sees every read
+    }
+    else if(vm->core == CORE_BLOCK && !vm->debug && !vm->profile) // blocks do not stop at breakpoints or count single instructions, the threaded core does
+    {
+        run_block(vm, n_steps);
+    }
+    else
+    {
+        run_threaded(vm, n_steps);
+    }
+}
+
+/*
+*   The step budget is counted inside the cores (per block on the block core). A deadline
+*   is checked between slices of VM_DEADLINE_SLICE instructions, a few milliseconds on the
+*   fast cores, so the clock is read a few hundred times a second at most. The slice is well
+*   above the last RUN_MAX instructions the threaded core counts one by one. A TRAP that
+*   blocks on input is not interrupted.
+*/
+enum
+{
+    VM_DEADLINE_SLICE = 1 << 20
+};
+
+int vm_run(struct lc3_vm* vm, uint64_t n_steps)
+{
+    if(vm->debug)
+    {
+        debug_begin_run(vm);
+    }
+    if(vm->running && !vm->deadline_ms)
+    {
+        run_core(vm, n_steps);
+    }
+    else if(vm->running)
+    {
+        uint64_t left = n_steps ? n_steps : UINT64_MAX;
+        while(vm->running && left)
+        {
+            if(time_ms() >= vm->deadline_ms)
+            {
+                return LC3_RUN_DEADLINE;
+            }
+            uint64_t before = vm->instret;
+            run_core(vm, left < VM_DEADLINE_SLICE ? left : VM_DEADLINE_SLICE);
+            left -= vm->instret - before;
+        }
+    }
+    if(vm->fault)
+    {
+        return LC3_RUN_FAULT;
+    }
+    if(vm->debug && vm->debug->hit)
+    {
+        vm->running = 1; // debug_hit() stopped the core, the machine itself goes on
+        return LC3_RUN_BREAK;
+    }
+    return vm->running ? LC3_RUN_BUDGET : LC3_RUN_HALT;
+}
+
+/*
+*   Runs the loaded image on the switch core and, from the same starting state, on a fork of
+*   the machine for each of the fast cores, and compares the final registers and memory against
+*   the switch core. Programs that read input will see it once per core, so this is meant for
+*   batch images. vm is left in the state the switch core ended in.
+*/
+int compare_cores(struct lc3_vm* vm)
+{
+    const int fast_cores[] = { CORE_THREADED, CORE_BLOCK };
+    const char* names[] = { "threaded", "block" };
+    struct lc3_vm* copies[2];
+
+    struct lc3_snapshot* start = vm_snapshot(vm);
+    for(int c = 0; c < 2; c++)
+    {
+        copies[c] = start ? vm_fork(start) : NULL; // fresh caches, memory shared until written
+        if(!copies[c])
+        {
+            printf("out of memory\n");
+            while(c--)
+            {
+                vm_destroy(copies[c]);
+            }
+            snapshot_destroy(start);
+            return 0;
+        }
+        vm_set_core(copies[c], fast_cores[c]);
+    }
+    snapshot_destroy(start);
+
+    vm_set_core(vm, CORE_SWITCH);
+    vm_run(vm, 0);
+
+    int mismatches = 0;
+    for(int c = 0; c < 2; c++)
+    {
+        struct lc3_vm* copy = copies[c];
+        vm_run(copy, 0);
+
+        for(int i = 0; i < R_COUNT; i++)
+        {
+            if(copy->reg[i] != vm->reg[i])
+            {
+                printf("register R%d differs: switch 0x%04X, %s 0x%04X\n", i, vm->reg[i], names[c], copy->reg[i]);
+                mismatches++;
+            }
+        }
+        for(int i = 0; i < MEMORY_MAX; i++)
+        {
+            if(mem_peek(copy, i) != mem_peek(vm, i))
+            {
+                printf("memory 0x%04X differs: switch 0x%04X, %s 0x%04X\n", i, mem_peek(vm, i), names[c], mem_peek(copy, i));
+                mismatches++;
+            }
+        }
+        if(copy->instret != vm->instret)
+        {
+            printf("instruction count differs: switch %llu, %s %llu\n", (unsigned long long)vm->instret, names[c], (unsigned long long)copy->instret);
+            mismatches++;
+        }
+        struct lc3_stats expect, got;
+        vm_stats(vm, &expect);
+        vm_stats(copy, &got);
+        if(memcmp(got.opcodes, expect.opcodes, sizeof(got.opcodes)) != 0 || memcmp(got.traps, expect.traps, sizeof(got.traps)) != 0)
+        {
+            printf("opcode or trap counts differ: switch, %s\n", names[c]);
+            mismatches++;
+        }
+        vm_destroy(copy);
+    }
+    printf(mismatches ? "cores differ\n" : "cores match\n");
+    return mismatches == 0;
+}
@@ -0,0 +1,51 @@
+/*      LC-3 Simulator - interpreter cores
+*       The switch core is the reference; the threaded and block cores are the fast ones
+*       and are checked against it by compare_cores().
+*/
+#ifndef LC3_CORE_H
+#define LC3_CORE_H
+
+#include <stdint.h>
+
+#include "lc3.h"
+
+// @@diff : {Core Selection}
+enum
+{
+    CORE_SWITCH = 0, // reference switch core
+    CORE_THREADED,   // computed-goto core (switch fallback without GCC/Clang)
+    CORE_BLOCK       // basic block translator
+};
+
+/*
+*   Computed goto is used when the compiler supports it. Configure with
+*   -DLC3_THREADED=OFF (or compile with -DLC3_THREADED=0) to get the switch fallback.
+*/
+#ifndef LC3_THREADED
+#if defined(__GNUC__) || defined(__clang__)
+#define LC3_THREADED 1
+#else
+#define LC3_THREADED 0
+#endif
+#endif
+
+#define SET_FLAGS(v) (reg[R_COND] = (v) == 0 ? FL_ZRO : ((v) >> 15 ? FL_NEG : FL_POS)) // needs a local reg = vm->reg
+
+/*
+*   Every core runs until the machine stops or n_steps instructions have retired (0 = no
+*   limit) and adds what it ran to vm->instret. None of them overshoots the budget: the block
+*   core runs the last few instructions of a budget on step_switch().
+*/
+static inline int bad_instruction_fault(uint16_t instr) // LC3_FAULT_* for an instruction the cores refuse
+{
+    return (instr >> 12) == OP_RTI ? LC3_FAULT_PRIVILEGE : LC3_FAULT_OPCODE;
+}
+
+void execute_trap(struct lc3_vm* vm, uint16_t instr); // TRAP routines, R7 must already hold the return address
+void step_switch(struct lc3_vm* vm); // execute exactly one instruction on the reference core
+void run_switch(struct lc3_vm* vm, uint64_t n_steps);
+void run_threaded(struct lc3_vm* vm, uint64_t n_steps);
+void run_block(struct lc3_vm* vm, uint64_t n_steps);
+int compare_cores(struct lc3_vm* vm); // nonzero if every fast core ends in the same state as the switch core
+
+#endif
@@ -0,0 +1,216 @@
+#include <stdint.h>
+
+#include "lc3.h"
+#include "core.h"
+#include "memory.h"
+#include "block.h"
+#include "vm.h"
+
+// @@diff : {Block Core}
+/*
+*   Runs translated blocks (see {Basic Blocks}). Ops inside a block are threaded the same
+*   way as the threaded core; the op that ends a block sets R_PC and goes back to the block
+*   lookup. Instructions in the device page are run one at a time by step_switch(), and so
+*   is the tail of a step budget that is too short for the next whole block.
+*
+*   A block is charged to the budget in full when it is entered; a store that leaves the
+*   block early gives back the instructions it skipped. Device reads and traps take back the
+*   part of the block that has not run yet for the duration of the call (PENDING), so they
+*   see the same vm->instret as on the switch core.
+*/
+#if LC3_THREADED
+#define CASE(h) L_##h:
+#define NEXT_OP() goto *dispatch_table[(++op)->handler]
+#else
+#define CASE(h) case h:
+#define NEXT_OP() do { ++op; goto redispatch; } while(0)
+#endif
+
+#define LEAVE_EARLY() do { \
+        uint16_t skipped = blk->start + blk->length - op->z; /* give back the rest of the block */ \
+        left += skipped; vm->instret -= skipped; reg[R_PC] = op->z; \
+        for(int i = blk->length - skipped; i < blk->length; i++) vm->stats.opcodes[blk->opcodes[i]]--; } while(0)
+
+#define PENDING(back) ((uint64_t)(op->z - blk->start - blk->length - 1 - (back))) /* back: instructions of a fused op after the read */
+#define READ(address, back) mem_read_sync(vm, (address), PENDING(back))
+
+#define ALU_CASE(h, expr) \
+    CASE(h) { uint16_t v = (expr); reg[op->a] = v; SET_FLAGS(v); } NEXT_OP(); \
+    CASE(h##_NF) { reg[op->a] = (expr); } NEXT_OP();
+
+void run_block(struct lc3_vm* vm, uint64_t n_steps)
+{
+    if(!block_init(vm))
+    {
+        run_switch(vm, n_steps); // no memory for the cache, the reference core needs none
+        return;
+    }
+    uint16_t* reg = vm->reg;
+    uint64_t left = n_steps ? n_steps : UINT64_MAX;
+    const struct block_op* op;
+#if LC3_THREADED
+    static void* const dispatch_table[B_COUNT] =
+    {
+        &&L_B_ADD_REG, &&L_B_ADD_REG_NF, &&L_B_ADD_IMM, &&L_B_ADD_IMM_NF,
+        &&L_B_AND_REG, &&L_B_AND_REG_NF, &&L_B_AND_IMM, &&L_B_AND_IMM_NF,
+        &&L_B_NOT, &&L_B_NOT_NF, &&L_B_LD, &&L_B_LD_NF,
+        &&L_B_LDI, &&L_B_LDI_NF, &&L_B_LDR, &&L_B_LDR_NF,
+        &&L_B_LEA, &&L_B_LEA_NF, &&L_B_ST, &&L_B_STI,
+        &&L_B_STR, &&L_B_LD_ADD_ST, &&L_B_BR, &&L_B_ADD_BR,
+        &&L_B_JMP, &&L_B_JSR, &&L_B_JSRR, &&L_B_TRAP,
+        &&L_B_EXIT, &&L_B_BAD
+    };
+#endif
+    while(vm->running && left)
+    {
+        uint16_t pc = reg[R_PC];
+        uint16_t index = pc < MMIO_BASE ? vm->blocks->index[pc] : 0;
+        struct block* blk = index ? &vm->blocks->pool[index - 1] : NULL;
+        if(!blk && pc < MMIO_BASE)
+        {
+            blk = block_translate(vm, pc);
+        }
+        if(!blk || blk->length > left) // device page, out of memory or not enough budget left
+        {
+            step_switch(vm);
+            left--;
+            continue;
+        }
+        left -= blk->length;
+        vm->instret += blk->length;
+        blk->runs++;
+        op = blk->ops;
+#if LC3_THREADED
+        goto *dispatch_table[op->handler];
+#else
+    redispatch:
+        switch(op->handler)
+        {
+#endif
+        ALU_CASE(B_ADD_REG, reg[op->b] + reg[op->c])
+        ALU_CASE(B_ADD_IMM, reg[op->b] + op->imm)
+        ALU_CASE(B_AND_REG, reg[op->b] & reg[op->c])
+        ALU_CASE(B_AND_IMM, reg[op->b] & op->imm)
+        ALU_CASE(B_NOT, ~reg[op->b])
+        ALU_CASE(B_LD, READ(op->x, 0))
+        ALU_CASE(B_LDI, READ(READ(op->x, 0), 0))
+        ALU_CASE(B_LDR, READ(reg[op->b] + op->imm, 0))
+        ALU_CASE(B_LEA, op->x)
+
+        CASE(B_ST)
+        {
+            mem_write(vm, op->x, reg[op->a]);
+            if(blk->invalid || !vm->running) // the block overwrote itself (pick up the new code) or MCR halted
+            {
+                LEAVE_EARLY();
+                continue;
+            }
+        }
+        NEXT_OP();
+
+        CASE(B_STI)
+        {
+            mem_write(vm, READ(op->x, 0), reg[op->a]);
+            if(blk->invalid || !vm->running)
+            {
+                LEAVE_EARLY();
+                continue;
+            }
+        }
+        NEXT_OP();
+
+        CASE(B_STR)
+        {
+            mem_write(vm, reg[op->b] + op->imm, reg[op->a]);
+            if(blk->invalid || !vm->running)
+            {
+                LEAVE_EARLY();
+                continue;
+            }
+        }
+        NEXT_OP();
+
+        CASE(B_LD_ADD_ST)
+        {
+            reg[op->a] = READ(op->x, 2); // flags of the LD are always overwritten by the ADD
+            uint16_t v = reg[op->c] + op->imm;
+            reg[op->b] = v;
+            SET_FLAGS(v);
+            mem_write(vm, op->y, reg[op->d]);
+            if(blk->invalid || !vm->running)
+            {
+                LEAVE_EARLY();
+                continue;
+            }
+        }
+        NEXT_OP();
+
+        CASE(B_BR)
+        {
+            reg[R_PC] = (op->a & reg[R_COND]) ? op->x : op->y;
+        }
+        continue;
+
+        CASE(B_ADD_BR)
+        {
+            uint16_t v = reg[op->c] + op->imm;
+            reg[op->b] = v;
+            SET_FLAGS(v);
+            reg[R_PC] = (op->a & reg[R_COND]) ? op->x : op->y;
+        }
+        continue;
+
+        CASE(B_JMP)
+        {
+            reg[R_PC] = reg[op->b];
+        }
+        continue;
+
+        CASE(B_JSR)
+        {
+            reg[R_R7] = op->y;
+            reg[R_PC] = op->x;
+        }
+        continue;
+
+        CASE(B_JSRR)
+        {
+            reg[R_R7] = op->y; // R7 is written first, exactly like the switch core
+            reg[R_PC] = reg[op->b];
+        }
+        continue;
+
+        CASE(B_TRAP)
+        {
+            reg[R_R7] = op->y;
+            reg[R_PC] = op->y;
+            vm->instret += PENDING(0);
+            execute_trap(vm, op->imm);
+            vm->instret -= PENDING(0);
+        }
+        continue;
+
+        CASE(B_EXIT)
+        {
+            reg[R_PC] = op->x;
+        }
+        continue;
+
+        CASE(B_BAD)
+        {
+            reg[R_PC] = op->y + 1;
+            vm->running = 0; // bad opcode, same as the switch core
+            vm->fault = bad_instruction_fault(mem_peek(vm, op->y));
+        }
+#if !LC3_THREADED
+        }
+#endif
+    }
+}
+
+#undef ALU_CASE
+#undef READ
+#undef PENDING
+#undef LEAVE_EARLY
+#undef CASE
+#undef NEXT_OP
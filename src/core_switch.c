@@ -0,0 +1,283 @@
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "lc3.h"
+#include "core.h"
+#include "memory.h"
+#include "trace.h"
+#include "profile.h"
+#include "vm.h"
+#include "system.h"
+#include "debug.h"
+#include "undo.h"
+
+// @@diff : {Switch Core}
+/*
+*   The reference interpreter core: fetch, decode with one switch over the opcode, execute.
+*   Every other core is checked against this one (see --compare-cores), and it is the
+*   only core that calls the trace, profile and undo hooks and that runs full-system mode. The
+*   block core also borrows step_switch() for the odd instruction it cannot translate.
+*/
+void step_switch(struct lc3_vm* vm) // execute exactly one instruction
+{
+    uint16_t* reg = vm->reg;
+    if(vm->trace.level)
+    {
+        trace_begin(vm);
+    }
+    if(vm->undo)
+    {
+        undo_begin(vm);
+    }
+    if(vm->system.enabled)
+    {
+        system_interrupts(vm); // an interrupt moves PC to its handler first, the trace shows both as one step
+        if(!vm->running)
+        {
+            return; // no handler for it
+        }
+    }
+    uint16_t pc = reg[R_PC]; // address of the instruction, kept for the trace
+
+    //Fetch
+    uint16_t instr = mem_read(vm, reg[R_PC]++);
+    uint16_t op = instr >> 12;
+    vm->stats.opcodes[op]++;
+    if(vm->profile)
+    {
+        profile_count(vm->profile, pc, instr); // charged before a JSR moves to the callee
+    }
+
+    switch(op)
+    {
+        case OP_ADD:
+            // @@ diff : {ADD}
+            {
+                uint16_t r0 = (instr >> 9) & 0x7; // The shift moves the register field to the lowest three bits. // 0x7(111 in binary) ensures only those three bits are preserved.
+                uint16_t r1 = (instr >> 6) & 0x7; // first operand (SR1)
+                uint16_t imm_flag = (instr >> 5) & 0x1; // immediate flag (0 = register, 1 = immediate) // 0x1 ensures only the lowest bit is preserved.
+            
+                if(imm_flag)
+                {
+                    uint16_t imm5 = sign_extend(instr & 0x1F, 5); // sign extend the 5-bit immediate to 16 bits
+                    reg[r0] = reg[r1] + imm5; // perform the addition
+                }
+                else
+                {
+                    uint16_t r2 = instr & 0x7; // second operand (SR2)
+                    reg[r0] = reg[r1] + reg[r2]; // perform the addition
+                }
+
+                update_flags(vm, r0); // update the condition flags
+
+            }
+
+        break;
+
+        case OP_AND:
+            {
+                // @@ diff : {AND}
+                uint16_t r0 = (instr >> 9) & 0x7; // destination register
+                uint16_t r1 = (instr >> 6) & 0x7; // first operand
+                uint16_t imm_flag = (instr >> 5) & 0x1; // immediate flag
+                if(imm_flag)
+                {
+                    uint16_t imm5 = sign_extend(instr & 0x1F, 5); // sign-extend the 5-bit immediate to 16 bits
+                    reg[r0] = reg[r1] & imm5; // perform the AND
+                }
+                else
+                {
+                    uint16_t r2 = instr & 0x7; // second operand
+                    reg[r0] = reg[r1] & reg[r2]; // perform the AND
+                }
+                update_flags(vm, r0); // update the condition flags
+            }
+        break;
+
+        case OP_NOT:      
+        {
+            // @@ diff : {NOT}
+            uint16_t r0 = (instr >> 9) & 0x7; // destination register
+            uint16_t r1 = (instr >> 6) & 0x7; // source register
+            reg[r0] = ~reg[r1]; // perform the NOT
+            update_flags(vm, r0); // update the condition flags
+        }
+        break;
+
+        case OP_BR:   // Branch
+        {   // @@ diff : {BR}
+            uint16_t pc_offset = sign_extend(instr & 0x1FF, 9); // sign-extend the offset to 16 bits
+            uint16_t cond_flag = (instr >> 9) & 0x7; // condition flag
+            if(cond_flag & reg[R_COND]) // if the condition flag is set
+            {
+                reg[R_PC] += pc_offset; // branch to the location
+            }
+        }    
+        break;
+
+        case OP_JMP:    // Jump
+        {
+            // @@ diff : {JMP}
+            uint16_t r1 = (instr >> 6) & 0x7; // base register
+            reg[R_PC] = reg[r1]; // set the PC to the base register
+            if(vm->profile && r1 == R_R7)
+            {
+                profile_return(vm); // RET
+            }
+        }    
+        break;
+
+        case OP_JSR: // Jump to Subroutine/Register
+        {
+            // @@ diff : {JSR}
+            uint16_t long_flag = (instr >> 11) & 1; // long flag (1 = long, 0 = short)
+            reg[R_R7] = reg[R_PC]; // store the return address in R7
+        
+            if(long_flag) // if the long flag is set
+            {
+                uint16_t pc_offset = sign_extend(instr & 0x7FF, 11); // sign-extend the offset to 16 bits
+                reg[R_PC] += pc_offset; // branch to the location / JSR
+            }
+            else
+            {
+                uint16_t r1 = (instr >> 6) & 0x7; // base register
+                reg[R_PC] = reg[r1]; // set the PC to the base register / JSRR
+            }
+            if(vm->profile)
+            {
+                profile_call(vm, reg[R_PC]);
+            }
+
+        }    
+        break;
+
+        case OP_LD:   // Load
+        {    // @@ diff : {LD}
+            uint16_t r0 = (instr >> 9) & 0x7; // destination register
+            uint16_t pc_offset = sign_extend(instr & 0x1FF, 9); // sign-extend the offset to 16 bits
+        
+            reg[r0] = mem_read(vm, reg[R_PC] + pc_offset); // read the value from the address in memory
+            update_flags(vm, r0); // update the condition flags
+        }   
+        break;
+
+        case OP_LDI:    // Load Indirect
+        {    // @@ diff : {LDI}
+            uint16_t r0 = (instr >> 9) & 0x7; // destination register
+            uint16_t pc_offset = sign_extend(instr & 0x1FF, 9); // sign-extend the offset to 16 bits
+            // add pc_offset to the current PC, look at that memory location to get the final address
+            reg[r0] = mem_read(vm, mem_read(vm, reg[R_PC] + pc_offset)); // read the value from the address in memory
+            update_flags(vm, r0); // update the condition flags
+        }    
+        break;
+
+        case OP_LDR:    // Load Register
+        {    // @@ diff : {LDR}
+            uint16_t r0 = (instr >> 9) & 0x7; //destination register
+            uint16_t r1 = (instr >> 6) & 0x7; // base register
+
+            uint16_t offset = sign_extend(instr & 0x3F, 6); // sign-extend the offset to 16 bits
+            reg[r0] = mem_read(vm, reg[r1]+offset); // read the value from the address in memory
+            update_flags(vm, r0); // update the condition flags
+        }    
+        break;
+
+        case OP_LEA: // Load Effective Address
+        { // @@ diff : {LEA}
+            uint16_t r0 = (instr >> 9) & 0x7; // destination register
+            uint16_t pc_offset = sign_extend(instr & 0x1FF, 9); // sign-extend the offset to 16 bits.
+            reg[r0] = reg[R_PC] + pc_offset; // load the effective address
+            update_flags(vm, r0); // update the condition flags
+        }
+        break;
+
+        case OP_ST:   // Store
+        {
+            // @@ diff : {ST}
+            uint16_t r0 = (instr >> 9) & 0x7; // source register
+            uint16_t pc_offset = sign_extend(instr & 0x1FF, 9); // sign-extend the offset to 16 bits
+            mem_write(vm, reg[R_PC] + pc_offset, reg[r0]); // write the value to the address in memory
+        }    
+        break;
+
+        case OP_STI:
+            // @@ diff : {STI}
+            {
+                uint16_t r0 = (instr >> 9) & 0x7;   // Extracts the destination register (r0) from the instruction
+                uint16_t pc_offset = sign_extend(instr & 0x1FF, 9); 
+                mem_write(vm, mem_read(vm, reg[R_PC] + pc_offset), reg[r0]);
+            }
+        break;
+
+        case OP_STR:
+            // @@ diff : {STR}
+            {
+                uint16_t r0 = (instr >> 9) & 0x7;
+                uint16_t r1 = (instr >> 6) & 0x7;
+                uint16_t offset = sign_extend(instr & 0x3F, 6);
+                mem_write(vm, reg[r1] + offset, reg[r0]);
+            }
+        break;
+
+        case OP_TRAP:
+            // @@ diff : {TRAP}
+            {
+                if(vm->profile)
+                {
+                    vm->profile->trap_count[instr & 0xFF]++;
+                }
+                if(vm->system.enabled)
+                {
+                    system_trap(vm, instr); // into the OS image, which returns with RTI
+                    break;
+                }
+                reg[R_R7] = reg[R_PC];
+                execute_trap(vm, instr); // shared with the threaded core
+            }
+        break;
+
+        case OP_RTI:
+            if(vm->system.enabled)
+            {
+                system_rti(vm); // a privilege exception in user mode
+                break;
+            }
+            // fall through
+        case OP_RES:
+            if(vm->system.enabled)
+            {
+                system_exception(vm, VEC_OPCODE);
+                break;
+            }
+            // fall through
+        default:
+            // @@ diff : {BAD OPCODE}
+            vm->running = 0; // stop with a fault instead of taking the whole process down
+            vm->fault = bad_instruction_fault(instr);
+        break;
+    }
+
+    vm->instret++;
+    if(vm->trace.level)
+    {
+        trace_end(vm, pc, instr); // record what the instruction did
+    }
+    if(vm->undo)
+    {
+        undo_end(vm);
+    }
+    // @@ diff : {Shutdown}
+}
+
+void run_switch(struct lc3_vm* vm, uint64_t n_steps)
+{
+    uint64_t left = n_steps ? n_steps : UINT64_MAX;
+    while(vm->running && left--)
+    {
+        if(vm->debug && debug_break_check(vm))
+        {
+            break;
+        }
+        step_switch(vm);
+    }
+}
@@ -0,0 +1,425 @@
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "lc3.h"
+#include "core.h"
+#include "memory.h"
+#include "predecode.h"
+#include "vm.h"
+#include "debug.h"
+#include "profile.h"
+
+// @@diff : {Threaded Core}
+/*
+*   The fast interpreter core. With GCC/Clang every handler ends by jumping straight to the
+*   handler of the next instruction through a table of label addresses (computed goto /
+*   direct threading), so there is no central switch for the branch predictor to miss on.
+*   Other compilers get the same handlers wrapped in a switch. Build with -DLC3_THREADED=0
+*   to force the switch fallback.
+*
+*   Instructions come from the predecode table (predecode.h); H_DECODE decodes the word on the way.
+*   Words in the device page (0xFE00 and up) are never cached, so fetching from there still
+*   goes through mem_read() every time.
+*
+*   The budget is not checked per instruction. Straight-line code runs from run_start with
+*   the PC going up by one per instruction, so the handlers that can leave a straight run
+*   (BR, JMP, JSR/JSRR, TRAP) and H_DECODE charge the whole run to left in one subtraction.
+*   A run can't be longer than RUN_MAX: the device page is never cached, so code running into
+*   it goes through H_DECODE. While more than RUN_MAX instructions are left the budget can't
+*   run out inside a run; for the last RUN_MAX the core dispatches through H_HOOKS first,
+*   which stops at the exact instruction.
+*
+*   --profile dispatches every instruction through H_HOOKS too, which counts it per PC and
+*   per opcode (H_DECODE and H_BREAK are counted once they know what they run, H_BAD counts
+*   itself). JSR/JSRR, RET and TRAP call the profiler from their own handlers. Without a
+*   profile and with more than RUN_MAX instructions left, H_HOOKS is never reached.
+*/
+#define RUN_MAX MEMORY_MAX
+#define PENDING() (budget - left + (uint16_t)(reg[R_PC] - 1 - run_start)) // instructions this call ran before the current one
+#define CHARGE() (left -= (uint16_t)(reg[R_PC] - run_start)) // the run up to and including the current instruction
+#define READ(address) mem_read_sync(vm, (address), PENDING())
+
+#if LC3_THREADED
+#define CASE(h) L_##h:
+#define DISPATCH() do { d = &decoded[reg[R_PC]++]; goto *table[d->handler]; } while(0)
+#define REDISPATCH() goto *dispatch_table[d->handler]
+#define REDISPATCH_HOOKS() goto *table[d->handler]
+#define HOOKS_ON() (table = hook_table)
+#else
+#define CASE(h) case h:
+#define DISPATCH() continue
+#define REDISPATCH() do { handler = d->handler; goto redispatch; } while(0)
+#define REDISPATCH_HOOKS() do { handler = d->handler + hooks; goto redispatch; } while(0)
+#define HOOKS_ON() (hooks = H_COUNT)
+#endif
+
+#define NEW_RUN() do                    \
+    {                                   \
+        run_start = reg[R_PC];          \
+        if(left <= RUN_MAX)             \
+        {                               \
+            if(!left)                   \
+            {                           \
+                goto out;               \
+            }                           \
+            counting = 1;               \
+            HOOKS_ON();                 \
+        }                               \
+    } while(0)
+
+void run_threaded(struct lc3_vm* vm, uint64_t n_steps)
+{
+    if(!vm->running)
+    {
+        return;
+    }
+    if(!predecode_init(vm))
+    {
+        run_switch(vm, n_steps); // no memory for the table, the reference core needs none
+        return;
+    }
+    uint16_t* reg = vm->reg;
+    uint64_t* opcodes = vm->stats.opcodes;
+    struct decoded_instr* decoded = vm->decoded;
+    uint64_t budget = n_steps ? n_steps : UINT64_MAX;
+    uint64_t left = budget; // instructions this call may still start, as of run_start
+    uint16_t run_start; // first instruction of the current straight run
+    const struct decoded_instr* d;
+    struct decoded_instr scratch; // decoded copy of a device page word
+    struct lc3_profile* profile = vm->profile;
+    int counting = 0; // the last RUN_MAX instructions of the budget, H_HOOKS checks each one
+#if LC3_THREADED
+    static void* const dispatch_table[H_COUNT] =
+    {
+        &&L_H_DECODE, &&L_H_BR, &&L_H_ADD_REG, &&L_H_ADD_IMM,
+        &&L_H_AND_REG, &&L_H_AND_IMM, &&L_H_NOT, &&L_H_JMP,
+        &&L_H_JSR, &&L_H_JSRR, &&L_H_LD, &&L_H_LDI,
+        &&L_H_LDR, &&L_H_LEA, &&L_H_ST, &&L_H_STI,
+        &&L_H_STR, &&L_H_TRAP, &&L_H_BAD, &&L_H_BREAK
+    };
+    static void* const hook_table[H_COUNT] = { [0 ... H_COUNT - 1] = &&L_H_HOOKS };
+    void* const* table = dispatch_table;
+#else
+    int hooks = 0; // H_COUNT while every handler goes through H_HOOKS first
+    int handler;
+#endif
+    static const uint8_t handler_op[H_COUNT] = // what H_HOOKS counts a handler as, 16 = not here
+    {
+        16, OP_BR, OP_ADD, OP_ADD, OP_AND, OP_AND, OP_NOT, OP_JMP, OP_JSR, OP_JSR,
+        OP_LD, OP_LDI, OP_LDR, OP_LEA, OP_ST, OP_STI, OP_STR, OP_TRAP, 16, 16
+    };
+    if(profile)
+    {
+        HOOKS_ON();
+    }
+    NEW_RUN();
+#if LC3_THREADED
+    DISPATCH();
+#endif
+    for(;;)
+    {
+#if !LC3_THREADED
+        d = &decoded[reg[R_PC]++];
+        handler = d->handler + hooks;
+    redispatch:
+        switch(handler)
+        {
+        default: // H_COUNT and up
+#else
+        L_H_HOOKS:
+#endif
+        {
+            if(counting && (uint16_t)(reg[R_PC] - 1 - run_start) >= left) // the budget ends before this instruction
+            {
+                reg[R_PC]--;
+                CHARGE();
+                goto out;
+            }
+            if(profile && handler_op[d->handler] < 16)
+            {
+                profile->pc_count[(uint16_t)(reg[R_PC] - 1)]++;
+                profile->op_count[handler_op[d->handler]]++;
+            }
+            REDISPATCH();
+        }
+
+        CASE(H_DECODE)
+        {
+            uint16_t pc = reg[R_PC] - 1;
+            left -= (uint16_t)(pc - run_start); // start a new run here, more than RUN_MAX words may follow
+            run_start = pc;
+            if(left <= RUN_MAX)
+            {
+                counting = 1; // left > 0: H_HOOKS let this one through, or it was more than RUN_MAX
+                HOOKS_ON();
+            }
+            if(pc >= MMIO_BASE && (vm->code_map[pc] & CODE_BREAK)) // never cached, so there is no H_BREAK to land on
+            {
+                if(!vm->debug->skip)
+                {
+                    reg[R_PC] = pc; // stop before it, before the fetch reads a device register
+                    debug_hit(vm, DEBUG_BREAK, pc);
+                    goto out;
+                }
+                vm->debug->skip = 0;
+            }
+            uint16_t instr = READ(pc); // fetch through mem_read() like the switch core does
+            if(pc >= MMIO_BASE)
+            {
+                decode_instr(instr, &scratch); // device registers change under us, don't cache them
+                d = &scratch;
+            }
+            else
+            {
+                decode_instr(instr, &decoded[pc]);
+                vm->code_map[pc] |= CODE_DECODED; // mem_write() resets it from now on
+                if(vm->code_map[pc] & CODE_BREAK)
+                {
+                    decoded[pc].handler = H_BREAK; // debug_set() resets it when the breakpoint goes
+                }
+            }
+            REDISPATCH_HOOKS(); // the profile counts it there, checking the budget again is harmless
+        }
+
+        CASE(H_ADD_REG)
+        {
+            opcodes[OP_ADD]++;
+            uint16_t v = reg[d->sr1] + reg[d->sr2];
+            reg[d->dr] = v;
+            SET_FLAGS(v);
+        }
+        DISPATCH();
+
+        CASE(H_ADD_IMM)
+        {
+            opcodes[OP_ADD]++;
+            uint16_t v = reg[d->sr1] + d->imm;
+            reg[d->dr] = v;
+            SET_FLAGS(v);
+        }
+        DISPATCH();
+
+        CASE(H_AND_REG)
+        {
+            opcodes[OP_AND]++;
+            uint16_t v = reg[d->sr1] & reg[d->sr2];
+            reg[d->dr] = v;
+            SET_FLAGS(v);
+        }
+        DISPATCH();
+
+        CASE(H_AND_IMM)
+        {
+            opcodes[OP_AND]++;
+            uint16_t v = reg[d->sr1] & d->imm;
+            reg[d->dr] = v;
+            SET_FLAGS(v);
+        }
+        DISPATCH();
+
+        CASE(H_NOT)
+        {
+            opcodes[OP_NOT]++;
+            uint16_t v = ~reg[d->sr1];
+            reg[d->dr] = v;
+            SET_FLAGS(v);
+        }
+        DISPATCH();
+
+        CASE(H_BR)
+        {
+            opcodes[OP_BR]++;
+            CHARGE();
+            if(d->dr & reg[R_COND]) // nzp bits line up with the FL_* flags
+            {
+                reg[R_PC] += d->imm;
+            }
+            NEW_RUN();
+        }
+        DISPATCH();
+
+        CASE(H_JMP)
+        {
+            opcodes[OP_JMP]++;
+            if(profile && d->sr1 == R_R7)
+            {
+                vm->instret += PENDING();
+                profile_return(vm); // RET
+                vm->instret -= PENDING();
+            }
+            CHARGE();
+            reg[R_PC] = reg[d->sr1];
+            NEW_RUN();
+        }
+        DISPATCH();
+
+        CASE(H_JSR)
+        {
+            opcodes[OP_JSR]++;
+            if(profile)
+            {
+                vm->instret += PENDING(); // the profiler charges calls from instret
+                profile_call(vm, reg[R_PC] + d->imm);
+                vm->instret -= PENDING();
+            }
+            CHARGE();
+            reg[R_R7] = reg[R_PC];
+            reg[R_PC] += d->imm;
+            NEW_RUN();
+        }
+        DISPATCH();
+
+        CASE(H_JSRR)
+        {
+            opcodes[OP_JSR]++;
+            reg[R_R7] = reg[R_PC]; // R7 is written first, exactly like the switch core (JSRR R7 sees the new value)
+            if(profile)
+            {
+                vm->instret += PENDING();
+                profile_call(vm, reg[d->sr1]);
+                vm->instret -= PENDING();
+            }
+            CHARGE();
+            reg[R_PC] = reg[d->sr1];
+            NEW_RUN();
+        }
+        DISPATCH();
+
+        CASE(H_LD)
+        {
+            opcodes[OP_LD]++;
+            uint16_t v = READ(reg[R_PC] + d->imm);
+            reg[d->dr] = v;
+            SET_FLAGS(v);
+        }
+        DISPATCH();
+
+        CASE(H_LDI)
+        {
+            opcodes[OP_LDI]++;
+            uint16_t v = READ(READ(reg[R_PC] + d->imm));
+            reg[d->dr] = v;
+            SET_FLAGS(v);
+        }
+        DISPATCH();
+
+        CASE(H_LDR)
+        {
+            opcodes[OP_LDR]++;
+            uint16_t v = READ(reg[d->sr1] + d->imm);
+            reg[d->dr] = v;
+            SET_FLAGS(v);
+        }
+        DISPATCH();
+
+        CASE(H_LEA)
+        {
+            opcodes[OP_LEA]++;
+            uint16_t v = reg[R_PC] + d->imm;
+            reg[d->dr] = v;
+            SET_FLAGS(v);
+        }
+        DISPATCH();
+
+        CASE(H_ST)
+        {
+            opcodes[OP_ST]++;
+            mem_write(vm, reg[R_PC] + d->imm, reg[d->dr]);
+            if(!vm->running) // a store to MCR halts the machine
+            {
+                CHARGE();
+                goto out;
+            }
+        }
+        DISPATCH();
+
+        CASE(H_STI)
+        {
+            opcodes[OP_STI]++;
+            mem_write(vm, READ(reg[R_PC] + d->imm), reg[d->dr]);
+            if(!vm->running)
+            {
+                CHARGE();
+                goto out;
+            }
+        }
+        DISPATCH();
+
+        CASE(H_STR)
+        {
+            opcodes[OP_STR]++;
+            mem_write(vm, reg[d->sr1] + d->imm, reg[d->dr]);
+            if(!vm->running)
+            {
+                CHARGE();
+                goto out;
+            }
+        }
+        DISPATCH();
+
+        CASE(H_TRAP)
+        {
+            opcodes[OP_TRAP]++;
+            if(profile)
+            {
+                profile->trap_count[d->imm]++;
+            }
+            reg[R_R7] = reg[R_PC];
+            vm->instret += PENDING(); // GETC/IN see the exact count, like devices
+            execute_trap(vm, d->imm);
+            vm->instret -= PENDING();
+            CHARGE();
+            if(!vm->running)
+            {
+                goto out;
+            }
+            NEW_RUN();
+        }
+        DISPATCH();
+
+        CASE(H_BAD)
+        {
+            opcodes[d->imm >> 12]++;
+            if(profile)
+            {
+                profile_count(profile, reg[R_PC] - 1, d->imm);
+            }
+            vm->running = 0; // bad opcode, same as the switch core
+            vm->fault = bad_instruction_fault(d->imm); // the word as fetched, a device register may read differently now
+            CHARGE();
+            goto out;
+        }
+
+        CASE(H_BREAK)
+        {
+            if(vm->debug->skip) // the run started here: execute the instruction under the breakpoint
+            {
+                vm->debug->skip = 0;
+                uint16_t instr = mem_peek(vm, reg[R_PC] - 1);
+                decode_instr(instr, &scratch);
+                d = &scratch;
+                REDISPATCH_HOOKS();
+            }
+            reg[R_PC]--; // stop before it
+            CHARGE();
+            debug_hit(vm, DEBUG_BREAK, reg[R_PC]);
+            goto out;
+        }
+#if !LC3_THREADED
+        }
+#endif
+    }
+out:
+    vm->instret += budget - left;
+}
+
+#undef CASE
+#undef DISPATCH
+#undef REDISPATCH
+#undef REDISPATCH_HOOKS
+#undef HOOKS_ON
+#undef NEW_RUN
+#undef READ
+#undef CHARGE
+#undef PENDING
+#undef RUN_MAX
@@ -0,0 +1,487 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lc3.h"
+#include "vm.h"
+#include "memory.h"
+#include "predecode.h"
+#include "system.h"
+#include "debug.h"
+#include "undo.h"
+#include "disasm.h"
+#include "platform.h"
+
+int debug_open(struct lc3_vm* vm)
+{
+    if(vm->debug)
+    {
+        return 1;
+    }
+    vm->debug = calloc(1, sizeof(struct lc3_debug));
+    return vm->debug != NULL;
+}
+
+void debug_close(struct lc3_vm* vm)
+{
+    if(!vm->debug)
+    {
+        return;
+    }
+    for(int a = 0; a < MEMORY_MAX; a++)
+    {
+        if(vm->code_map[a] & CODE_DEBUG)
+        {
+            debug_set(vm, (uint16_t)a, CODE_DEBUG, 0);
+        }
+    }
+    free(vm->debug);
+    vm->debug = NULL;
+}
+
+void debug_set(struct lc3_vm* vm, uint16_t address, int mark, int on)
+{
+    uint8_t before = vm->code_map[address];
+    vm->code_map[address] = on ? before | mark : before & ~mark;
+    uint8_t after = vm->code_map[address];
+    if((before ^ after) & CODE_RWATCH)
+    {
+        vm->debug->read_watches += on ? 1 : -1;
+    }
+    if(((before ^ after) & CODE_BREAK) && (before & CODE_DECODED))
+    {
+        vm->decoded[address].handler = H_DECODE; // the threaded core picks H_BREAK up, or drops it, on the next fetch
+    }
+}
+
+void debug_hit(struct lc3_vm* vm, int hit, uint16_t address)
+{
+    struct lc3_debug* d = vm->debug;
+    if(!d || d->hit)
+    {
+        return; // the first hit of an instruction is the one reported
+    }
+    d->hit = hit;
+    d->address = address;
+    vm->running = 0; // every core stops on that, vm_run() turns it back on
+}
+
+void debug_begin_run(struct lc3_vm* vm)
+{
+    vm->debug->hit = DEBUG_NONE;
+    vm->debug->skip = (vm->code_map[vm->reg[R_PC]] & CODE_BREAK) != 0;
+}
+
+// @@diff : {Debugger Commands}
+static const char* debug_help =
+    "commands (numbers: x3000, 0x3000, #12 or 12):\n"
+    "  s, step [n]          run n instructions (1)\n"
+    "  c, continue          run until a breakpoint, watchpoint, HALT or fault; Ctrl-C stops it\n"
+    "  rs, rstep [n]        undo the last n instructions (1), needs --undo\n"
+    "  rc, rcontinue        undo back to a breakpoint or a write to a watched word\n"
+    "  b, break ADDR        stop before the instruction at ADDR\n"
+    "  w, watch ADDR        stop after an instruction writes ADDR\n"
+    "  rw, rwatch ADDR      stop after an instruction reads ADDR (runs the switch core while set)\n"
+    "  d, delete [ADDR]     remove the breakpoint and watchpoints at ADDR, or all of them\n"
+    "  i, info              list breakpoints and watchpoints\n"
+    "  r, regs              show the registers\n"
+    "  x ADDR [n]           show n memory words (8)\n"
+    "  l, list [ADDR] [n]   disassemble n words (10) from ADDR or the PC\n"
+    "  set R0-R7|PC|ADDR V  change a register or a memory word\n"
+    "  q, quit\n";
+
+static int parse_value(const char* s, uint16_t* v)
+{
+    char* end;
+    long n;
+    if(s[0] == 'x' || s[0] == 'X')
+    {
+        n = strtol(s + 1, &end, 16);
+    }
+    else if(s[0] == '#')
+    {
+        n = strtol(s + 1, &end, 10);
+    }
+    else
+    {
+        n = strtol(s, &end, 0);
+    }
+    if(end == s || *end || n < -0x8000 || n > 0xFFFF)
+    {
+        return 0;
+    }
+    *v = (uint16_t)n;
+    return 1;
+}
+
+static int parse_register(const char* s) // R_* index, -1 if s is not a register name
+{
+    if((s[0] == 'R' || s[0] == 'r') && s[1] >= '0' && s[1] <= '7' && !s[2])
+    {
+        return s[1] - '0';
+    }
+    if((s[0] == 'P' || s[0] == 'p') && (s[1] == 'C' || s[1] == 'c') && !s[2])
+    {
+        return R_PC;
+    }
+    return -1;
+}
+
+static char cond_name(uint16_t cond)
+{
+    return cond == FL_NEG ? 'N' : cond == FL_POS ? 'P' : 'Z';
+}
+
+static void show_location(struct lc3_vm* vm, FILE* out) // the next instruction and the registers on one line
+{
+    uint16_t* reg = vm->reg;
+    char text[32];
+    disasm_instr(reg[R_PC], mem_peek(vm, reg[R_PC]), text, sizeof(text));
+    fprintf(out, "x%04X: x%04X %-16s", reg[R_PC], mem_peek(vm, reg[R_PC]), text);
+    for(int i = 0; i < R_PC; i++)
+    {
+        fprintf(out, " R%d=x%04X", i, reg[i]);
+    }
+    fprintf(out, " %c  instret %llu\n", cond_name(reg[R_COND]), (unsigned long long)vm->instret);
+}
+
+static void show_registers(struct lc3_vm* vm, FILE* out)
+{
+    uint16_t* reg = vm->reg;
+    for(int i = 0; i < R_PC; i++)
+    {
+        fprintf(out, "R%d x%04X %6d%s", i, reg[i], (int16_t)reg[i], i % 4 == 3 ? "\n" : "   ");
+    }
+    fprintf(out, "PC x%04X   COND %c   instret %llu\n", reg[R_PC], cond_name(reg[R_COND]), (unsigned long long)vm->instret);
+    if(vm->system.enabled)
+    {
+        fprintf(out, "PSR x%04X (%s mode, priority %d)   saved USP x%04X   saved SSP x%04X\n", system_psr(vm),
+            vm->system.psr & PSR_USER ? "user" : "supervisor", (vm->system.psr & PSR_PRIORITY) >> 8,
+            vm->system.saved_usp, vm->system.saved_ssp);
+    }
+}
+
+static void show_marks(struct lc3_vm* vm, FILE* out)
+{
+    int n = 0;
+    for(int a = 0; a < MEMORY_MAX; a++)
+    {
+        uint8_t marks = vm->code_map[a];
+        if(marks & CODE_DEBUG)
+        {
+            fprintf(out, "  x%04X%s%s%s\n", a, marks & CODE_BREAK ? "  break" : "", marks & CODE_WATCH ? "  watch" : "",
+                marks & CODE_RWATCH ? "  rwatch" : "");
+            n++;
+        }
+    }
+    if(!n)
+    {
+        fprintf(out, "no breakpoints or watchpoints\n");
+    }
+}
+
+/*
+*   Runs in slices of DEBUG_SLICE instructions so Ctrl-C is noticed. A slice that ends right
+*   on a breakpoint reports it: the next vm_run() would step over it.
+*/
+static void run(struct lc3_vm* vm, FILE* out, uint64_t n_steps, int raw_terminal)
+{
+    struct lc3_debug* d = vm->debug;
+    if(!vm->running)
+    {
+        fprintf(out, "the machine has stopped\n");
+        return;
+    }
+    d->interrupted = 0;
+    if(raw_terminal)
+    {
+        disable_input_buffering(); // the program gets the keys while it runs
+    }
+    uint64_t left = n_steps;
+    int status;
+    for(;;)
+    {
+        uint64_t before = vm->instret;
+        status = vm_run(vm, n_steps && left < DEBUG_SLICE ? left : DEBUG_SLICE);
+        left -= n_steps ? vm->instret - before : 0;
+        if(status != LC3_RUN_BUDGET || (n_steps && !left) || d->interrupted)
+        {
+            break;
+        }
+        if(vm->code_map[vm->reg[R_PC]] & CODE_BREAK)
+        {
+            d->hit = DEBUG_BREAK;
+            d->address = vm->reg[R_PC];
+            status = LC3_RUN_BREAK;
+            break;
+        }
+    }
+    if(raw_terminal)
+    {
+        restore_input_buffering();
+    }
+    if(vm->io.flush)
+    {
+        vm->io.flush(vm->io.ctx); // the program's output before ours
+    }
+
+    if(status == LC3_RUN_BREAK)
+    {
+        if(d->hit == DEBUG_BREAK)
+        {
+            fprintf(out, "breakpoint x%04X\n", d->address);
+        }
+        else
+        {
+            fprintf(out, "watchpoint x%04X %s: x%04X\n", d->address, d->hit == DEBUG_WATCH ? "written" : "read", mem_peek(vm, d->address));
+        }
+    }
+    else if(status == LC3_RUN_HALT)
+    {
+        fprintf(out, "halted\n");
+    }
+    else if(status == LC3_RUN_FAULT)
+    {
+        fprintf(out, "%s at x%04X\n", vm_fault_name(vm->fault), (uint16_t)(vm->reg[R_PC] - 1));
+    }
+    else if(d->interrupted)
+    {
+        fprintf(out, "interrupted\n");
+    }
+    show_location(vm, out);
+}
+
+/*
+*   Steps back through the undo log. Going backwards, a breakpoint stops once the PC is back
+*   on it and a watchpoint once the instruction that wrote the word is undone, so the machine
+*   is left where a forward run would have stopped just before.
+*/
+static void reverse(struct lc3_vm* vm, FILE* out, uint64_t n_steps) // 0 = until a mark or the start of the log
+{
+    if(!vm->undo)
+    {
+        fprintf(out, "no undo log, start with --undo\n");
+        return;
+    }
+    uint16_t watched = 0;
+    int status = UNDO_NONE;
+    for(uint64_t done = 0; !n_steps || done < n_steps; done++)
+    {
+        if((status = undo_step(vm, &watched)) == UNDO_NONE)
+        {
+            break;
+        }
+        if(!n_steps && (status == UNDO_WATCH || (vm->code_map[vm->reg[R_PC]] & CODE_BREAK)))
+        {
+            break;
+        }
+    }
+    if(status == UNDO_NONE)
+    {
+        fprintf(out, "start of the undo log\n");
+    }
+    else if(!n_steps && status == UNDO_WATCH)
+    {
+        fprintf(out, "watchpoint x%04X written here, was x%04X\n", watched, mem_peek(vm, watched));
+    }
+    else if(!n_steps)
+    {
+        fprintf(out, "breakpoint x%04X\n", vm->reg[R_PC]);
+    }
+    show_location(vm, out);
+}
+
+static void set_marks(struct lc3_vm* vm, FILE* out, const char* arg, int mark)
+{
+    uint16_t address;
+    if(!arg || !parse_value(arg, &address))
+    {
+        fprintf(out, "needs an address\n");
+    }
+    else if(mark != CODE_BREAK && address >= MMIO_BASE)
+    {
+        fprintf(out, "device registers cannot be watched\n");
+    }
+    else
+    {
+        debug_set(vm, address, mark, 1);
+    }
+}
+
+int debug_repl(struct lc3_vm* vm, FILE* in, FILE* out, int raw_terminal)
+{
+    if(!debug_open(vm))
+    {
+        fprintf(out, "out of memory\n");
+        return 1;
+    }
+    char line[256];
+    fprintf(out, "lc3 debugger, 'help' lists the commands\n");
+    show_location(vm, out);
+    for(;;)
+    {
+        fprintf(out, "(lc3) ");
+        fflush(out);
+        if(!fgets(line, sizeof(line), in))
+        {
+            fprintf(out, "\n");
+            return 0;
+        }
+        char* args[4] = { NULL, NULL, NULL, NULL };
+        int count = 0;
+        for(char* tok = strtok(line, " \t\r\n"); tok && count < 4; tok = strtok(NULL, " \t\r\n"))
+        {
+            args[count++] = tok;
+        }
+        if(!count)
+        {
+            continue;
+        }
+        const char* cmd = args[0];
+        uint16_t a, v;
+        if(strcmp(cmd, "s") == 0 || strcmp(cmd, "step") == 0)
+        {
+            uint16_t n = 1;
+            if(args[1] && (!parse_value(args[1], &n) || !n))
+            {
+                fprintf(out, "step needs a count of at least 1\n");
+                continue;
+            }
+            run(vm, out, n, raw_terminal);
+        }
+        else if(strcmp(cmd, "c") == 0 || strcmp(cmd, "continue") == 0)
+        {
+            run(vm, out, 0, raw_terminal);
+        }
+        else if(strcmp(cmd, "rs") == 0 || strcmp(cmd, "rstep") == 0)
+        {
+            uint16_t n = 1;
+            if(args[1] && (!parse_value(args[1], &n) || !n))
+            {
+                fprintf(out, "rstep needs a count of at least 1\n");
+                continue;
+            }
+            reverse(vm, out, n);
+        }
+        else if(strcmp(cmd, "rc") == 0 || strcmp(cmd, "rcontinue") == 0)
+        {
+            reverse(vm, out, 0);
+        }
+        else if(strcmp(cmd, "b") == 0 || strcmp(cmd, "break") == 0)
+        {
+            set_marks(vm, out, args[1], CODE_BREAK);
+        }
+        else if(strcmp(cmd, "w") == 0 || strcmp(cmd, "watch") == 0)
+        {
+            set_marks(vm, out, args[1], CODE_WATCH);
+        }
+        else if(strcmp(cmd, "rw") == 0 || strcmp(cmd, "rwatch") == 0)
+        {
+            set_marks(vm, out, args[1], CODE_RWATCH);
+        }
+        else if(strcmp(cmd, "d") == 0 || strcmp(cmd, "delete") == 0)
+        {
+            if(!args[1])
+            {
+                for(int i = 0; i < MEMORY_MAX; i++)
+                {
+                    debug_set(vm, (uint16_t)i, CODE_DEBUG, 0);
+                }
+            }
+            else if(parse_value(args[1], &a))
+            {
+                debug_set(vm, a, CODE_DEBUG, 0);
+            }
+            else
+            {
+                fprintf(out, "needs an address\n");
+            }
+        }
+        else if(strcmp(cmd, "i") == 0 || strcmp(cmd, "info") == 0)
+        {
+            show_marks(vm, out);
+            if(vm->undo)
+            {
+                fprintf(out, "undo log: %llu instructions, %zu of %zu bytes\n", (unsigned long long)undo_depth(vm),
+                    vm->undo->used, vm->undo->capacity);
+            }
+        }
+        else if(strcmp(cmd, "r") == 0 || strcmp(cmd, "regs") == 0)
+        {
+            show_registers(vm, out);
+        }
+        else if(strcmp(cmd, "x") == 0)
+        {
+            uint16_t n = 8;
+            if(!args[1] || !parse_value(args[1], &a) || (args[2] && !parse_value(args[2], &n)))
+            {
+                fprintf(out, "x needs an address and an optional count\n");
+                continue;
+            }
+            for(uint16_t i = 0; i < n; i++)
+            {
+                uint16_t at = (uint16_t)(a + i);
+                if(i % 8 == 0)
+                {
+                    fprintf(out, "x%04X:", at);
+                }
+                fprintf(out, " x%04X%s", mem_peek(vm, at), i % 8 == 7 || i + 1 == n ? "\n" : "");
+            }
+        }
+        else if(strcmp(cmd, "l") == 0 || strcmp(cmd, "list") == 0)
+        {
+            uint16_t n = 10;
+            a = vm->reg[R_PC];
+            if((args[1] && !parse_value(args[1], &a)) || (args[2] && !parse_value(args[2], &n)))
+            {
+                fprintf(out, "list takes an optional address and count\n");
+                continue;
+            }
+            char text[32];
+            for(uint16_t i = 0; i < n; i++)
+            {
+                uint16_t at = (uint16_t)(a + i);
+                disasm_instr(at, mem_peek(vm, at), text, sizeof(text));
+                fprintf(out, "%s x%04X: x%04X  %s\n", at == vm->reg[R_PC] ? "=>" : vm->code_map[at] & CODE_BREAK ? " b" : "  ",
+                    at, mem_peek(vm, at), text);
+            }
+        }
+        else if(strcmp(cmd, "set") == 0)
+        {
+            int r = args[1] ? parse_register(args[1]) : -1;
+            if(!args[2] || !parse_value(args[2], &v) || (r < 0 && !parse_value(args[1], &a)))
+            {
+                fprintf(out, "set needs a register or address and a value\n");
+            }
+            else if(r >= 0)
+            {
+                vm->reg[r] = v;
+                undo_clear(vm); // history from before a change by hand would not add up
+            }
+            else
+            {
+                int running = vm->running;
+                mem_write(vm, a, v); // through the caches, like a store
+                if(vm->debug->hit) // our own write is not a watchpoint hit
+                {
+                    vm->debug->hit = DEBUG_NONE;
+                    vm->running = running;
+                }
+                undo_clear(vm);
+            }
+        }
+        else if(strcmp(cmd, "q") == 0 || strcmp(cmd, "quit") == 0)
+        {
+            return 0;
+        }
+        else if(strcmp(cmd, "h") == 0 || strcmp(cmd, "help") == 0)
+        {
+            fputs(debug_help, out);
+        }
+        else
+        {
+            fprintf(out, "unknown command '%s', 'help' lists the commands\n", cmd);
+        }
+    }
+}
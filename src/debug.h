@@ -0,0 +1,68 @@
+/*      LC-3 Simulator - debugger
+*       Breakpoints and watchpoints that cost nothing until they hit, and the --debug command
+*       line on top of them.
+*/
+#ifndef LC3_DEBUG_H
+#define LC3_DEBUG_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <signal.h>
+
+#include "lc3.h"
+#include "vm.h"
+
+// @@diff : {Debugger}
+/*
+*   Breakpoints and watchpoints are bits in vm->code_map[], next to the cache bits:
+*       - CODE_BREAK  : the threaded core's predecode record for the word becomes H_BREAK, so
+*                       a breakpoint is one more handler and every other instruction runs at
+*                       full speed. The switch core checks the bit before each instruction.
+*       - CODE_WATCH  : mem_write() already leaves its fast path for any marked word, and
+*                       reports the write once it is done.
+*       - CODE_RWATCH : checked in mem_read(). Loads on the fast cores do not look, so a read
+*                       watchpoint moves the VM to the switch core while it is set.
+*   A hit stops the machine after the instruction that wrote or read the word, or before the
+*   instruction at a breakpoint, and vm_run() returns LC3_RUN_BREAK. A breakpoint at the PC
+*   vm_run() starts from is stepped over, so running again continues past it. The block core
+*   is swapped for the threaded one while a VM has a debugger, and device page words
+*   (xFE00 and up) cannot be watched.
+*/
+enum
+{
+    DEBUG_NONE = 0,
+    DEBUG_BREAK,         // reached a breakpoint
+    DEBUG_WATCH,         // wrote a watched word
+    DEBUG_RWATCH,        // read a watched word
+    DEBUG_SLICE = 1 << 20 // instructions the command line runs between checks for Ctrl-C
+};
+
+struct lc3_debug
+{
+    int hit;                           // DEBUG_* that stopped the last vm_run()
+    uint16_t address;                  // breakpoint or watched word
+    int skip;                          // vm_run() started on a breakpoint, let it run once
+    int read_watches;                  // CODE_RWATCH words, they need the switch core
+    volatile sig_atomic_t interrupted; // Ctrl-C while the command line runs the machine
+};
+
+int debug_open(struct lc3_vm* vm); // 0 if out of memory
+void debug_close(struct lc3_vm* vm); // also clears every breakpoint and watchpoint
+void debug_set(struct lc3_vm* vm, uint16_t address, int mark, int on); // mark: CODE_BREAK, CODE_WATCH or CODE_RWATCH
+void debug_hit(struct lc3_vm* vm, int hit, uint16_t address); // stop the machine for a DEBUG_* reason
+void debug_begin_run(struct lc3_vm* vm); // vm_run() is about to start
+int debug_repl(struct lc3_vm* vm, FILE* in, FILE* out, int raw_terminal); // command line until quit or end of input, returns a process exit status
+
+static inline int debug_break_check(struct lc3_vm* vm) // switch core, before each instruction: 1 = stop here
+{
+    struct lc3_debug* d = vm->debug;
+    if(!(vm->code_map[vm->reg[R_PC]] & CODE_BREAK) || d->skip)
+    {
+        d->skip = 0; // only the first instruction of a run may step over a breakpoint
+        return 0;
+    }
+    debug_hit(vm, DEBUG_BREAK, vm->reg[R_PC]);
+    return 1;
+}
+
+#endif
@@ -0,0 +1,535 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lc3.h"
+#include "core.h"
+#include "vm.h"
+#include "memory.h"
+#include "predecode.h"
+#include "block.h"
+#include "disasm.h"
+
+static const char* trap_name(int vector)
+{
+    static const char* names[] = { "GETC", "OUT", "PUTS", "IN", "PUTSP", "HALT" };
+    return vector >= TRAP_GETC && vector <= TRAP_HALT ? names[vector - TRAP_GETC] : NULL;
+}
+
+// @@diff : {Disassembler}
+void disasm_instr(uint16_t address, uint16_t instr, char* text, size_t size)
+{
+    static const char* names[H_COUNT] =
+    {
+        [H_ADD_REG] = "ADD", [H_ADD_IMM] = "ADD", [H_AND_REG] = "AND", [H_AND_IMM] = "AND",
+        [H_LD] = "LD", [H_LDI] = "LDI", [H_LEA] = "LEA", [H_ST] = "ST", [H_STI] = "STI",
+        [H_LDR] = "LDR", [H_STR] = "STR"
+    };
+    struct decoded_instr d;
+    decode_instr(instr, &d);
+    uint16_t next = address + 1; // PC relative operands are relative to the next instruction
+    switch(d.handler)
+    {
+        case H_ADD_REG:
+        case H_AND_REG:
+            snprintf(text, size, "%s R%d, R%d, R%d", names[d.handler], d.dr, d.sr1, d.sr2);
+            break;
+        case H_ADD_IMM:
+        case H_AND_IMM:
+            snprintf(text, size, "%s R%d, R%d, #%d", names[d.handler], d.dr, d.sr1, (int16_t)d.imm);
+            break;
+        case H_NOT:
+            snprintf(text, size, "NOT R%d, R%d", d.dr, d.sr1);
+            break;
+        case H_BR:
+            if(!d.dr)
+            {
+                snprintf(text, size, "NOP");
+            }
+            else
+            {
+                snprintf(text, size, "BR%s%s%s x%04X", d.dr & FL_NEG ? "n" : "", d.dr & FL_ZRO ? "z" : "", d.dr & FL_POS ? "p" : "",
+                    (uint16_t)(next + d.imm));
+            }
+            break;
+        case H_JMP:
+            snprintf(text, size, d.sr1 == R_R7 ? "RET" : "JMP R%d", d.sr1);
+            break;
+        case H_JSR:
+            snprintf(text, size, "JSR x%04X", (uint16_t)(next + d.imm));
+            break;
+        case H_JSRR:
+            snprintf(text, size, "JSRR R%d", d.sr1);
+            break;
+        case H_LD:
+        case H_LDI:
+        case H_LEA:
+        case H_ST:
+        case H_STI:
+            snprintf(text, size, "%s R%d, x%04X", names[d.handler], d.dr, (uint16_t)(next + d.imm));
+            break;
+        case H_LDR:
+        case H_STR:
+            snprintf(text, size, "%s R%d, R%d, #%d", names[d.handler], d.dr, d.sr1, (int16_t)d.imm);
+            break;
+        case H_TRAP:
+            if(trap_name(d.imm))
+            {
+                snprintf(text, size, "%s", trap_name(d.imm));
+            }
+            else
+            {
+                snprintf(text, size, "TRAP x%02X", d.imm);
+            }
+            break;
+        default:
+            snprintf(text, size, (instr >> 12) == OP_RTI ? "RTI" : ".FILL x%04X", instr);
+            break;
+    }
+}
+
+// @@diff : {Control Flow}
+enum
+{
+    CFG_QUEUED = 1 << 7 // word[] while walking: on the stack
+};
+
+struct cfg_walk
+{
+    const struct lc3_vm* vm;
+    struct lc3_cfg* cfg;
+    uint16_t* stack;           // addresses still to follow
+    int depth;
+};
+
+static void push(struct cfg_walk* w, uint16_t address, uint8_t mark)
+{
+    uint8_t* word = &w->cfg->word[address];
+    *word |= mark | CFG_LEADER;
+    if(!(*word & (CFG_CODE | CFG_QUEUED))) // every word is queued at most once, so the stack never overflows
+    {
+        *word |= CFG_QUEUED;
+        w->stack[w->depth++] = address;
+    }
+}
+
+static void follow(struct cfg_walk* w, uint16_t pc) // one straight run of instructions
+{
+    uint8_t* word = w->cfg->word;
+    while(pc < MMIO_BASE && !(word[pc] & CFG_CODE))
+    {
+        word[pc] |= CFG_CODE;
+        struct decoded_instr d;
+        decode_instr(mem_peek(w->vm, pc), &d);
+        uint16_t next = pc + 1;
+        switch(d.handler)
+        {
+            case H_BR:
+                if(d.dr)
+                {
+                    push(w, (uint16_t)(next + d.imm), CFG_LEADER);
+                }
+                if(d.dr != (FL_NEG | FL_ZRO | FL_POS))
+                {
+                    push(w, next, CFG_LEADER);
+                }
+                return;
+            case H_JSR:
+                push(w, (uint16_t)(next + d.imm), CFG_ENTRY);
+                push(w, next, CFG_LEADER);
+                return;
+            case H_JSRR:
+                push(w, next, CFG_LEADER);
+                return;
+            case H_TRAP:
+                if(d.imm != TRAP_HALT)
+                {
+                    push(w, next, CFG_LEADER);
+                }
+                return;
+            case H_JMP:
+            case H_BAD:
+                return;
+            default:
+                pc = next;
+                break;
+        }
+    }
+    if(pc < MMIO_BASE)
+    {
+        word[pc] |= CFG_LEADER; // ran into code an earlier run already took
+    }
+}
+
+static int block_end(uint16_t instr, struct cfg_block* b, uint16_t address) // fills end, next[] and call; 1 if instr ends a block
+{
+    struct decoded_instr d;
+    decode_instr(instr, &d);
+    uint16_t next = address + 1;
+    b->next_count = 0;
+    switch(d.handler)
+    {
+        case H_BR:
+            b->end = CFG_END_BRANCH;
+            if(d.dr != (FL_NEG | FL_ZRO | FL_POS))
+            {
+                b->next[b->next_count++] = next;
+            }
+            if(d.dr)
+            {
+                b->next[b->next_count++] = (uint16_t)(next + d.imm);
+            }
+            return 1;
+        case H_JMP:
+            b->end = d.sr1 == R_R7 ? CFG_END_RETURN : CFG_END_JUMP;
+            return 1;
+        case H_JSR:
+            b->end = CFG_END_CALL;
+            b->call = (uint16_t)(next + d.imm);
+            b->next[b->next_count++] = next;
+            return 1;
+        case H_JSRR:
+            b->end = CFG_END_CALL_REG;
+            b->next[b->next_count++] = next;
+            return 1;
+        case H_TRAP:
+            b->end = d.imm == TRAP_HALT ? CFG_END_HALT : CFG_END_TRAP;
+            if(d.imm != TRAP_HALT)
+            {
+                b->next[b->next_count++] = next;
+            }
+            return 1;
+        case H_BAD:
+            b->end = (instr >> 12) == OP_RTI ? CFG_END_RETURN : CFG_END_BAD;
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+static int split_blocks(const struct lc3_vm* vm, struct lc3_cfg* cfg)
+{
+    int capacity = 0;
+    for(int a = 0; a < MMIO_BASE; a++)
+    {
+        if(!(cfg->word[a] & CFG_LEADER) || !(cfg->word[a] & CFG_CODE))
+        {
+            continue;
+        }
+        if(cfg->block_count == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 64;
+            struct cfg_block* blocks = realloc(cfg->blocks, capacity * sizeof(struct cfg_block));
+            if(!blocks)
+            {
+                return 0;
+            }
+            cfg->blocks = blocks;
+        }
+        struct cfg_block* b = &cfg->blocks[cfg->block_count++];
+        memset(b, 0, sizeof(*b));
+        b->start = (uint16_t)a;
+        int pc = a;
+        for(;;)
+        {
+            b->length++;
+            if(block_end(mem_peek(vm, (uint16_t)pc), b, (uint16_t)pc))
+            {
+                break;
+            }
+            if(++pc >= MMIO_BASE)
+            {
+                b->end = CFG_END_BAD;
+                break;
+            }
+            if(cfg->word[pc] & CFG_LEADER)
+            {
+                b->end = CFG_END_FALL;
+                b->next[b->next_count++] = (uint16_t)pc;
+                break;
+            }
+        }
+    }
+    return 1;
+}
+
+static int find_block(const struct lc3_cfg* cfg, uint16_t start) // index, -1 if no block starts there
+{
+    int lo = 0;
+    int hi = cfg->block_count - 1;
+    while(lo <= hi)
+    {
+        int mid = (lo + hi) / 2;
+        if(cfg->blocks[mid].start == start)
+        {
+            return mid;
+        }
+        if(cfg->blocks[mid].start < start)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid - 1;
+        }
+    }
+    return -1;
+}
+
+static void assign_subroutine(struct lc3_cfg* cfg, uint16_t entry, uint8_t* owned, int* stack)
+{
+    int depth = 0;
+    int first = find_block(cfg, entry);
+    if(first < 0 || owned[first])
+    {
+        return;
+    }
+    owned[first] = 1;
+    stack[depth++] = first;
+    cfg->sub_count++;
+    while(depth)
+    {
+        struct cfg_block* b = &cfg->blocks[stack[--depth]];
+        b->sub = entry;
+        for(int i = 0; i < b->next_count; i++)
+        {
+            int n = find_block(cfg, b->next[i]);
+            if(n >= 0 && !owned[n])
+            {
+                owned[n] = 1;
+                stack[depth++] = n;
+            }
+        }
+    }
+}
+
+struct lc3_cfg* cfg_build(const struct lc3_vm* vm, const uint16_t* entries, int count)
+{
+    struct lc3_cfg* cfg = calloc(1, sizeof(struct lc3_cfg));
+    struct cfg_walk w = { vm, cfg, malloc(MEMORY_MAX * sizeof(uint16_t)), 0 };
+    if(!cfg || !w.stack)
+    {
+        free(w.stack);
+        free(cfg);
+        return NULL;
+    }
+    for(int i = 0; i < count; i++)
+    {
+        push(&w, entries[i], CFG_ENTRY);
+    }
+    while(w.depth)
+    {
+        follow(&w, w.stack[--w.depth]);
+    }
+    free(w.stack);
+    for(int a = 0; a < MEMORY_MAX; a++)
+    {
+        cfg->word[a] &= ~CFG_QUEUED;
+    }
+
+    uint8_t* owned = NULL;
+    int* stack = NULL;
+    if(!split_blocks(vm, cfg) || (cfg->block_count && (!(owned = calloc(cfg->block_count, 1)) || !(stack = malloc(cfg->block_count * sizeof(int))))))
+    {
+        free(owned);
+        cfg_free(cfg);
+        return NULL;
+    }
+    for(int i = 0; i < count; i++) // the entry points first, so a subroutine that is also called stays theirs
+    {
+        assign_subroutine(cfg, entries[i], owned, stack);
+    }
+    for(int i = 0; i < cfg->block_count; i++)
+    {
+        if(cfg->word[cfg->blocks[i].start] & CFG_ENTRY)
+        {
+            assign_subroutine(cfg, cfg->blocks[i].start, owned, stack);
+        }
+    }
+    for(int i = 0; i < cfg->block_count; i++) // only reached through a JSRR or JMP target we could not see
+    {
+        if(!owned[i])
+        {
+            assign_subroutine(cfg, cfg->blocks[i].start, owned, stack);
+        }
+    }
+    free(owned);
+    free(stack);
+    return cfg;
+}
+
+static int is_loaded(const struct lc3_vm* vm, uint16_t address)
+{
+    return (vm->loaded[address >> 3] >> (address & 7)) & 1;
+}
+
+struct lc3_cfg* cfg_build_loaded(const struct lc3_vm* vm)
+{
+    uint16_t entries[CFG_MAX_ENTRIES];
+    int count = 0;
+    entries[count++] = vm->reg[R_PC];
+    for(uint16_t v = 0; vm->system.enabled && v < 0x200; v++) // trap vectors, then exception and interrupt vectors
+    {
+        uint16_t handler = mem_peek(vm, v);
+        if(is_loaded(vm, v) && handler && handler < MMIO_BASE)
+        {
+            entries[count++] = handler;
+        }
+    }
+    return cfg_build(vm, entries, count);
+}
+
+void cfg_free(struct lc3_cfg* cfg)
+{
+    if(cfg)
+    {
+        free(cfg->blocks);
+        free(cfg);
+    }
+}
+
+// @@diff : {Control Flow Output}
+static const char* end_names[] = { "falls through", "BR", "JMP", "RET", "JSR", "JSRR", "TRAP", "HALT", "bad" };
+
+void cfg_write_listing(const struct lc3_vm* vm, const struct lc3_cfg* cfg, FILE* out)
+{
+    char text[32];
+    int gap = 0;
+    for(int a = 0; a < MEMORY_MAX; a++)
+    {
+        uint8_t marks = cfg->word[a];
+        if(!(marks & CFG_CODE) && !is_loaded(vm, (uint16_t)a))
+        {
+            gap = 1;
+            continue;
+        }
+        if(gap)
+        {
+            fprintf(out, "\n");
+            gap = 0;
+        }
+        uint16_t instr = mem_peek(vm, (uint16_t)a);
+        if(marks & CFG_CODE)
+        {
+            disasm_instr((uint16_t)a, instr, text, sizeof(text));
+        }
+        else
+        {
+            snprintf(text, sizeof(text), ".FILL x%04X", instr);
+        }
+        fprintf(out, "%s x%04X: x%04X  %s\n", marks & CFG_ENTRY ? "sub" : marks & CFG_LEADER ? "  >" : "   ", a, instr, text);
+    }
+}
+
+void cfg_write_summary(const struct lc3_vm* vm, const struct lc3_cfg* cfg, FILE* out)
+{
+    (void)vm;
+    fprintf(out, "%d blocks in %d subroutines\n", cfg->block_count, cfg->sub_count);
+    for(int i = 0; i < cfg->block_count; i++)
+    {
+        const struct cfg_block* b = &cfg->blocks[i];
+        fprintf(out, "x%04X-x%04X %3d instructions  in x%04X  ends %-13s", b->start, (uint16_t)(b->start + b->length - 1),
+            b->length, b->sub, end_names[b->end]);
+        if(b->end == CFG_END_CALL)
+        {
+            fprintf(out, " calls x%04X", b->call);
+        }
+        for(int n = 0; n < b->next_count; n++)
+        {
+            fprintf(out, "%s x%04X", n ? "," : " ->", b->next[n]);
+        }
+        fprintf(out, "\n");
+    }
+}
+
+void cfg_write_dot(const struct lc3_vm* vm, const struct lc3_cfg* cfg, FILE* out)
+{
+    char text[32];
+    fprintf(out, "digraph lc3 {\n    node [shape=box fontname=\"monospace\"];\n");
+    for(int i = 0; i < cfg->block_count; i++) // blocks come in address order, a subroutine's are not always together
+    {
+        uint16_t sub = cfg->blocks[i].sub;
+        if(cfg->blocks[i].start != sub)
+        {
+            continue;
+        }
+        fprintf(out, "    subgraph cluster_x%04X {\n        label=\"x%04X\";\n", sub, sub);
+        for(int j = 0; j < cfg->block_count; j++)
+        {
+            const struct cfg_block* b = &cfg->blocks[j];
+            if(b->sub != sub)
+            {
+                continue;
+            }
+            fprintf(out, "        b%04X [label=\"", b->start);
+            for(int k = 0; k < b->length; k++)
+            {
+                uint16_t a = (uint16_t)(b->start + k);
+                disasm_instr(a, mem_peek(vm, a), text, sizeof(text));
+                fprintf(out, "x%04X  %s\\l", a, text);
+            }
+            fprintf(out, "\"];\n");
+        }
+        fprintf(out, "    }\n");
+    }
+    for(int i = 0; i < cfg->block_count; i++)
+    {
+        const struct cfg_block* b = &cfg->blocks[i];
+        for(int n = 0; n < b->next_count; n++)
+        {
+            int taken = b->end == CFG_END_BRANCH && n == b->next_count - 1 && b->next[n] != (uint16_t)(b->start + b->length);
+            fprintf(out, "    b%04X -> b%04X%s;\n", b->start, b->next[n], taken ? " [color=blue]" : "");
+        }
+        if(b->end == CFG_END_CALL && find_block(cfg, b->call) >= 0)
+        {
+            fprintf(out, "    b%04X -> b%04X [style=dashed];\n", b->start, b->call);
+        }
+    }
+    fprintf(out, "}\n");
+}
+
+// @@diff : {Block Prebuild}
+/*
+*   Block starts are exactly the addresses the block core looks blocks up at, so translating
+*   one block at each of them before the run leaves it nothing to discover in code the
+*   analysis reached. Half the pool is left for what it could not see (JSRR and JMP targets,
+*   code written at run time).
+*/
+int cfg_translate_blocks(struct lc3_vm* vm, const struct lc3_cfg* cfg)
+{
+    if(!block_init(vm))
+    {
+        return 0;
+    }
+    int translated = 0;
+    for(int i = 0; i < cfg->block_count && vm->blocks->used < BLOCK_POOL_SIZE / 2; i++)
+    {
+        uint16_t start = cfg->blocks[i].start;
+        if(!vm->blocks->index[start])
+        {
+            if(!block_translate(vm, start))
+            {
+                break;
+            }
+            translated++;
+        }
+    }
+    return translated;
+}
+
+int cfg_translate_loaded(struct lc3_vm* vm)
+{
+    if(vm->core != CORE_BLOCK || vm->system.enabled || vm->debug || vm->profile || vm->trace.level || vm->undo)
+    {
+        return 0; // those runs never reach the block core
+    }
+    struct lc3_cfg* cfg = cfg_build_loaded(vm);
+    if(!cfg)
+    {
+        return 0; // out of memory only means the blocks are found during the run
+    }
+    int translated = cfg_translate_blocks(vm, cfg);
+    cfg_free(cfg);
+    return translated;
+}
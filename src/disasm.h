@@ -0,0 +1,79 @@
+/*      LC-3 Simulator - disassembler and control flow analysis
+*       Turns loaded memory back into instructions and recovers basic blocks and subroutines
+*       from it, for listings, DOT graphs and for translating blocks before a run.
+*/
+#ifndef LC3_DISASM_H
+#define LC3_DISASM_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "lc3.h"
+
+// @@diff : {Disassembler}
+/*
+*   disasm_instr() writes one instruction in assembler syntax with PC relative operands
+*   resolved to absolute addresses ("BRz x3005", "LD R1, x3010"), the TRAP aliases by name,
+*   JMP R7 as RET, BR with no condition bits as NOP and the reserved opcode as a .FILL.
+*/
+void disasm_instr(uint16_t address, uint16_t instr, char* text, size_t size);
+
+// @@diff : {Control Flow}
+/*
+*   cfg_build() follows the code from its entry points the way the machine would (recursive
+*   descent, not a linear sweep), so data between routines is never taken for instructions.
+*   Every branch target, JSR target and word after a BR, JMP, JSR/JSRR or TRAP starts a new
+*   block; those are also the addresses the block core looks blocks up at. HALT, RET, JMP and
+*   RTI end a path, a JSRR or JMP through any other register is a call or jump to an unknown
+*   target. Subroutines are the entry points and every JSR target; a block belongs to the
+*   first of them that reaches it without following calls.
+*/
+enum
+{
+    CFG_CODE = 1 << 0,       // word[]: reached as an instruction
+    CFG_LEADER = 1 << 1,     // starts a block
+    CFG_ENTRY = 1 << 2,      // starts a subroutine (or is an entry point)
+
+    CFG_END_FALL = 0,        // runs into the next block
+    CFG_END_BRANCH,          // BR, next[] holds the taken target last
+    CFG_END_JUMP,            // JMP to a register other than R7
+    CFG_END_RETURN,          // RET or RTI
+    CFG_END_CALL,            // JSR, call holds the target
+    CFG_END_CALL_REG,        // JSRR
+    CFG_END_TRAP,            // any TRAP but HALT
+    CFG_END_HALT,
+    CFG_END_BAD,             // reserved opcode, or the code runs into the device page
+
+    CFG_MAX_ENTRIES = 1 + 0x200 // the PC and, in full-system mode, the trap and interrupt vectors
+};
+
+struct cfg_block
+{
+    uint16_t start;
+    uint16_t length;         // instructions
+    uint16_t next[2];        // successors within the subroutine
+    uint8_t next_count;
+    uint8_t end;             // CFG_END_*
+    uint16_t call;           // JSR target for CFG_END_CALL
+    uint16_t sub;            // entry of the subroutine the block belongs to
+};
+
+struct lc3_cfg
+{
+    uint8_t word[MEMORY_MAX];  // CFG_CODE, CFG_LEADER and CFG_ENTRY bits
+    struct cfg_block* blocks;  // in address order
+    int block_count;
+    int sub_count;
+};
+
+struct lc3_cfg* cfg_build(const struct lc3_vm* vm, const uint16_t* entries, int count); // NULL if out of memory
+struct lc3_cfg* cfg_build_loaded(const struct lc3_vm* vm); // from the PC and, in full-system mode, the vector tables an image filled
+void cfg_free(struct lc3_cfg* cfg);
+void cfg_write_listing(const struct lc3_vm* vm, const struct lc3_cfg* cfg, FILE* out); // every loaded or reached word
+void cfg_write_summary(const struct lc3_vm* vm, const struct lc3_cfg* cfg, FILE* out); // one line per block
+void cfg_write_dot(const struct lc3_vm* vm, const struct lc3_cfg* cfg, FILE* out); // Graphviz, one cluster per subroutine
+int cfg_translate_blocks(struct lc3_vm* vm, const struct lc3_cfg* cfg); // fill the block cache ahead of a run, returns the blocks translated
+int cfg_translate_loaded(struct lc3_vm* vm); // cfg_build_loaded() + cfg_translate_blocks() if the next run will use the block core
+
+#endif
@@ -0,0 +1,259 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdarg.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define IMAGE_SSE2 1 // every x86-64 has it, no runtime check needed
+#else
+#define IMAGE_SSE2 0
+#endif
+
+#include "lc3.h"
+#include "vm.h"
+#include "memory.h"
+#include "predecode.h"
+#include "block.h"
+#include "image.h"
+#include "asm.h"
+#include "platform.h"
+
+// @@diff : {Byte Swap}
+/*
+*   Eight words at a time: shifting each 16-bit lane left and right by 8 and OR-ing the two
+*   swaps its bytes, which only needs SSE2 (no pshufb). The tail, and other CPUs, take the
+*   scalar loop, which compilers vectorize on their own at -O3.
+*/
+void swap_words(uint16_t* dst, const uint8_t* src, size_t count)
+{
+    size_t i = 0;
+#if IMAGE_SSE2
+    for(; i + 8 <= count; i += 8)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + 2 * i));
+        v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+        _mm_storeu_si128((__m128i*)(dst + i), v);
+    }
+#endif
+    for(; i < count; i++)
+    {
+        dst[i] = (uint16_t)(src[2 * i] << 8 | src[2 * i + 1]);
+    }
+}
+
+uint32_t image_checksum(const uint8_t* data, size_t size)
+{
+    uint32_t a = 1, b = 0;
+    while(size > 0)
+    {
+        size_t n = size < 5552 ? size : 5552; // largest run before b can overflow
+        size -= n;
+        while(n--)
+        {
+            a += *data++;
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+    return b << 16 | a;
+}
+
+static uint16_t be16(const uint8_t* p)
+{
+    return (uint16_t)(p[0] << 8 | p[1]);
+}
+
+static uint32_t be32(const uint8_t* p)
+{
+    return (uint32_t)be16(p) << 16 | be16(p + 2);
+}
+
+// @@diff : {Segments}
+struct image_segment
+{
+    uint16_t origin;
+    uint32_t length;          // words, up to MEMORY_MAX
+    const uint8_t* data;
+};
+
+static int fail(struct image_report* report, const char* message, ...)
+{
+    va_list args;
+    va_start(args, message);
+    vsnprintf(report->message, sizeof(report->message), message, args);
+    va_end(args);
+    return 0;
+}
+
+static int parse_segments(const uint8_t* data, size_t size, struct image_segment* segments, int* count, struct image_report* report)
+{
+    if(size >= 4 && memcmp(data, "LC3S", 4) == 0)
+    {
+        if(size < IMAGE_HEADER_BYTES)
+        {
+            return fail(report, "truncated container header");
+        }
+        if(be16(data + 4) != IMAGE_CONTAINER_VERSION)
+        {
+            return fail(report, "unsupported container version %u", be16(data + 4));
+        }
+        int n = be16(data + 6);
+        if(n > IMAGE_MAX_SEGMENTS)
+        {
+            return fail(report, "%d segments, at most %d are supported", n, IMAGE_MAX_SEGMENTS);
+        }
+        size_t at = IMAGE_HEADER_BYTES;
+        for(int s = 0; s < n; s++)
+        {
+            if(size - at < IMAGE_SEGMENT_BYTES)
+            {
+                return fail(report, "truncated header of segment %d", s);
+            }
+            segments[s].origin = be16(data + at);
+            segments[s].length = be16(data + at + 2);
+            uint32_t checksum = be32(data + at + 4);
+            at += IMAGE_SEGMENT_BYTES;
+            if(size - at < 2 * (size_t)segments[s].length)
+            {
+                return fail(report, "segment %d at 0x%04X is truncated: %u of %u words", s, segments[s].origin,
+                    (unsigned)((size - at) / 2), (unsigned)segments[s].length);
+            }
+            segments[s].data = data + at;
+            if(image_checksum(segments[s].data, 2 * (size_t)segments[s].length) != checksum)
+            {
+                return fail(report, "segment %d at 0x%04X fails its checksum", s, segments[s].origin);
+            }
+            at += 2 * (size_t)segments[s].length;
+        }
+        if(at != size)
+        {
+            return fail(report, "%u bytes after the last segment", (unsigned)(size - at));
+        }
+        *count = n;
+    }
+    else // plain object file
+    {
+        if(size < 2)
+        {
+            return fail(report, "truncated: no origin");
+        }
+        if(size & 1)
+        {
+            return fail(report, "truncated: odd number of bytes");
+        }
+        segments[0].origin = be16(data);
+        segments[0].length = (uint32_t)((size - 2) / 2 < MEMORY_MAX + 1 ? (size - 2) / 2 : MEMORY_MAX + 1);
+        segments[0].data = data + 2;
+        *count = 1;
+    }
+
+    uint8_t used[MEMORY_MAX / 8];
+    memset(used, 0, sizeof(used));
+    for(int s = 0; s < *count; s++)
+    {
+        if(segments[s].origin + segments[s].length > MEMORY_MAX)
+        {
+            return fail(report, "segment at 0x%04X runs %u words past the end of memory", segments[s].origin,
+                (unsigned)(segments[s].origin + segments[s].length - MEMORY_MAX));
+        }
+        for(uint32_t a = segments[s].origin; a < segments[s].origin + segments[s].length; a++)
+        {
+            if(used[a >> 3] & (1 << (a & 7)))
+            {
+                return fail(report, "segments overlap at 0x%04X", (unsigned)a);
+            }
+            used[a >> 3] |= 1 << (a & 7);
+        }
+    }
+    return 1;
+}
+
+// @@diff : {Load Image}
+int image_load(struct lc3_vm* vm, const void* data, size_t size, struct image_report* report)
+{
+    struct image_segment segments[IMAGE_MAX_SEGMENTS];
+    memset(report, 0, sizeof(*report));
+    int count = 0;
+    if(!parse_segments(data, size, segments, &count, report))
+    {
+        return 0;
+    }
+
+    for(int s = 0; s < count; s++)
+    {
+        uint32_t address = segments[s].origin;
+        uint32_t end = address + segments[s].length;
+        const uint8_t* src = segments[s].data;
+        for(uint32_t a = address; a < end; a++) // report words an earlier image put there
+        {
+            if(vm->loaded[a >> 3] & (1 << (a & 7)))
+            {
+                if(report->overlap_words++ == 0 || a < report->overlap_first)
+                {
+                    report->overlap_first = (uint16_t)a;
+                }
+            }
+            vm->loaded[a >> 3] |= 1 << (a & 7);
+        }
+        while(address < end) // a page at a time, straight into the VM's own copy of it
+        {
+            uint32_t offset = address & (PAGE_WORDS - 1);
+            uint32_t n = PAGE_WORDS - offset < end - address ? PAGE_WORDS - offset : end - address;
+            swap_words(page_unshare(vm, address >> PAGE_SHIFT) + offset, src, n);
+            src += 2 * n;
+            address += n;
+        }
+    }
+    if(vm->fault == LC3_FAULT_MEMORY)
+    {
+        return fail(report, "out of memory");
+    }
+    report->segments = count;
+    predecode_flush(vm); // memory was filled behind mem_write()'s back
+    block_flush(vm);
+    return 1;
+}
+
+int image_load_file(struct lc3_vm* vm, const char* path, struct image_report* report)
+{
+    size_t size = 0;
+    const void* data = map_file(path, &size);
+    if(!data)
+    {
+        memset(report, 0, sizeof(*report));
+        return fail(report, "cannot open");
+    }
+    int ok = image_load(vm, data, size, report);
+    unmap_file(data, size);
+    return ok;
+}
+
+int vm_load_image(struct lc3_vm* vm, const char* image_path)
+{
+    size_t n = strlen(image_path);
+    if(n > 4 && (strcmp(image_path + n - 4, ".asm") == 0 || strcmp(image_path + n - 4, ".ASM") == 0)) // source: assemble it in place
+    {
+        struct asm_error err;
+        if(!vm_load_asm(vm, image_path, &err))
+        {
+            fprintf(stderr, "%s:%d: %s\n", image_path, err.line, err.message);
+            return 0;
+        }
+        return 1;
+    }
+
+    struct image_report report;
+    if(!image_load_file(vm, image_path, &report))
+    {
+        fprintf(stderr, "%s: %s\n", image_path, report.message);
+        return 0;
+    }
+    if(report.overlap_words)
+    {
+        fprintf(stderr, "%s: warning: overwrites %d word%s loaded by an earlier image, starting at 0x%04X\n",
+            image_path, report.overlap_words, report.overlap_words == 1 ? "" : "s", report.overlap_first);
+    }
+    return 1;
+}
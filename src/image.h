@@ -0,0 +1,46 @@
+/*      LC-3 Simulator - image loader
+*       Maps object files and copies (byte swapping on the way) straight into a VM's memory.
+*/
+#ifndef LC3_IMAGE_H
+#define LC3_IMAGE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "lc3.h"
+
+// @@diff : {Image Formats}
+/*
+*   Two formats are accepted, told apart by the first four bytes:
+*       - plain object file (what lc3as writes): the origin, then the words to place there.
+*       - segment container: "LC3S", version, segment count, then for each segment its origin,
+*         length in words, the Adler-32 checksum of its data bytes and the data itself.
+*   Every field is big-endian, like the words themselves.
+*
+*   A file is validated completely before anything is written, so a truncated file, a bad
+*   checksum, a segment that runs off the end of memory or two segments of one file that
+*   overlap leave memory untouched. Words that an earlier image of the same VM already loaded
+*   are overwritten, but counted in the report so the caller can warn about it.
+*/
+enum
+{
+    IMAGE_CONTAINER_VERSION = 1,
+    IMAGE_HEADER_BYTES = 8,   // "LC3S", version, segment count
+    IMAGE_SEGMENT_BYTES = 8,  // origin, length, checksum
+    IMAGE_MAX_SEGMENTS = 1024
+};
+
+struct image_report
+{
+    char message[160];        // why the load failed
+    int segments;             // segments loaded (1 for a plain object file)
+    int overlap_words;        // words that an earlier image had already loaded
+    uint16_t overlap_first;   // lowest of those addresses
+};
+
+int image_load(struct lc3_vm* vm, const void* data, size_t size, struct image_report* report); // 1 on success
+int image_load_file(struct lc3_vm* vm, const char* path, struct image_report* report); // map the file and image_load() it
+uint32_t image_checksum(const uint8_t* data, size_t size); // Adler-32, as stored in containers
+void swap_words(uint16_t* dst, const uint8_t* src, size_t count); // big-endian words to host order, SSE2 when available
+
+#endif
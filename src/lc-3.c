@@ -15,320 +15,87 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <signal.h>
-/* for windows based OS*/
-#include <Windows.h>
-#include <conio.h>  // _kbhit
-
-
-/* Remove from comment FOR UNIX based systems 
-
+#include <string.h>
 #include <stdlib.h>
-#include <unistd.h>
-#include <fcntl.h>
-#include <sys/time.h>
-#include <sys/types.h>
-#include <sys/termios.h>
-#include <sys/mman.h>
-*/
-
-
-enum
-{
-    R_R0 = 0,  
-    R_R1,     
-    R_R2,    
-    R_R3,
-    R_R4,
-    R_R5,
-    R_R6,
-    R_R7,
-    R_PC, // Program Counter
-    R_COND, // Condition Flags
-    R_COUNT // Total number of registers
-};
-
-
-
-
-// @@diff : {Condition Flags}
-/*
-*   The condition flags register (COND) is used to store information 
-*   about the most recent operation that was performed.
-*   The condition flags are as follows:
-*       - 0000: POS (Positive) // The most recent operation resulted in a positive value
-*       - 0001: ZRO (Zero)     // The most recent operation resulted in a value of zero
-*       - 0010: NEG (Negative) // The most recent operation resulted in a negative value
-*/
-enum
-{
-    FL_POS = 1 << 0, // P
-    FL_ZRO = 1 << 1, // Z
-    FL_NEG = 1 << 2, // N
-};
-
-// @@diff : {OpCodes}
-
-/*  
-*   Instructions have both an opcode which indicates the kind of task to perform 
-*   and a set of parameters which provide inputs to the task being performed
-*   Each opcode represents one task that the CPU “knows” how to do.
-*   
-*   The LC-3 has 16 total opcodes, each of which is 4 bits.
-*   The opcodes are as follows:
-*       - 0001: ADD (R1 = R2 + R3)
-*       - 0101: AND (R1 = R2 & R3)
-*       - 0000: BR  (Branch)
-*       - 1100: JMP (Jump)
-*       - 0100: JSR (Jump to Subroutine)
-*       - 0100: JSRR (Jump to Subroutine)
-*       - 0010: LD (LOAD)
-*       - 1010: LDI (LOAD Indirect)
-*       - 0110: LDR (LOAD Register)
-*       - 1110: LEA (LOAD Effective Address)
-*       - 1001: NOT (NOT)
-*       - 1000: RTI (Return from Interrupt)
-*       - 0011: ST (Store)
-*       - 1011: STI (Store Indirect)
-*       - 0111: STR (Store Register)
-*       - 1111: TRAP (TRAP aka system call)
-*/
-enum
-{
-    OP_BR = 0, // branch
-    OP_ADD,    // add
-    OP_LD,     // load
-    OP_ST,     // store
-    OP_JSR,    // jump register
-    OP_AND,    // bitwise and
-    OP_LDR,    // load register
-    OP_STR,    // store register
-    OP_RTI,    // unused
-    OP_NOT,    // bitwise not
-    OP_LDI,    // load indirect
-    OP_STI,    // store indirect
-    OP_JMP,    // jump
-    OP_RES,    // reserved (unused)
-    OP_LEA,    // load effective address
-    OP_TRAP    // execute trap
-};
-
-enum 
-{
-    MR_KBSR = 0xFE00, /* keyboard status register */
-    MR_KBDR = 0xFE02  /* keyboard data register */
-};
-
-enum
-{
-    TRAP_GETC = 0x20,   /* get character from keyboard, not echoed onto the terminal */
-    TRAP_OUT = 0x21,     /* output a character */
-    TRAP_PUTS = 0x22,   /* output a word string */
-    TRAP_IN = 0x23,      /* get character from keyboard, echoed onto the terminal */
-    TRAP_PUTSP = 0x24,  /* output a byte string */
-    TRAP_HALT = 0x25    /* halt the program */
-};
-
-
-//  @@diff: {Memory Storage}
-#define MEMORY_MAX (1<<16) 
-uint16_t memory[MEMORY_MAX]; // 65536 Locations of memory
-
-
-//  @@diff: {Registers}
-/*  
-*   The LC-3 has 10 total registers, each of which is 16 bits. 
-*   Most of them are general purpose, but a few have designated roles: - 
-*        - 8 general purpose registers (R0-R7) [can be used to perform any program calculations]
-*        - 1 program counter (PC) register [an unsigned integer which is the address of the next instruction in memory to execute]
-*        - 1 condition flags (COND) register [tells us information about the previous calculation.]
-*/
-
-// @@diff : {Register Storage}
-uint16_t reg[R_COUNT]; // store the 10 registers in an array
 
-HANDLE hStdin = INVALID_HANDLE_VALUE; // get the standard input handle
-DWORD fdwMode, fdwOldMode; // get the mode of the standard input
+#include "lc3.h"
+#include "core.h"
+#include "trace.h"
+#include "console.h"
+#include "vm.h"
+#include "batch.h"
+#include "replay.h"
+#include "profile.h"
+#include "stats.h"
+#include "undo.h"
+#include "disasm.h"
+#include "debug.h"
+#include "checkpoint.h"
+#include "platform.h"
+
+static struct lc3_vm* main_vm; // the machine the command line runs, for handle_interrupt()
+static struct lc3_replay* main_recording; // --record, finished by handle_interrupt() too
+static volatile sig_atomic_t main_pause; // Ctrl-C with --checkpoint: stop after the current slice and save
 
-void disable_input_buffering()
-{
-    hStdin = GetStdHandle(STD_INPUT_HANDLE); // get the standard input handle
-    GetConsoleMode(hStdin, &fdwOldMode); // get the mode of the standard input
-    
-    fdwMode = fdwOldMode ^ ENABLE_ECHO_INPUT //no input echo 
-                         ^ ENABLE_LINE_INPUT; //return when one or more characters are available.
-    
-    SetConsoleMode(hStdin, fdwMode); // set the mode of the standard input
-    FlushConsoleInputBuffer(hStdin); // flush the input buffer                     
-}
-
-void restore_input_buffering()
-{
-    SetConsoleMode(hStdin, fdwOldMode); // set the mode of the standard input
-}
-
-uint16_t check_key()
-{
-    return WaitForSingleObject(hStdin, 1000) == WAIT_OBJECT_0 && _kbhit(); // check if a key is pressed
-}
 
 void handle_interrupt(int signal)
 {
+    if(main_vm && main_vm->debug)
+    {
+        main_vm->debug->interrupted = 1; // back to the debugger prompt after the current slice
+        return;
+    }
+    if(main_pause == 1) // a run with checkpoints saves and stops on its own, a second Ctrl-C does not wait
+    {
+        main_pause = 2;
+        return;
+    }
+    console_flush(); // show whatever the program printed
     restore_input_buffering(); // restore the input buffering
+    trace_close(main_vm); // flush whatever has been traced so far
+    struct replay_report report;
+    replay_close(main_recording, &report); // a recording cut short by Ctrl-C still replays
     printf("\n"); // output a new line
     exit(-2); // exit the program
 }
 
-
-
-/* Remove from comment FOR UNIX based systems 
-struct termios original_tio;
-
-void disable_input_buffering()
-{
-    tcgetattr(STDIN_FILENO, &original_tio);
-    struct termios new_tio = original_tio;
-    new_tio.c_lflag &= ~ICANON & ~ECHO;
-    tcsetattr(STDIN_FILENO, TCSANOW, &new_tio);
-}
-
-void restore_input_buffering()
-{
-    tcsetattr(STDIN_FILENO, TCSANOW, &original_tio);
-}
-
-uint16_t check_key()
-{
-    fd_set readfds;
-    FD_ZERO(&readfds);
-    FD_SET(STDIN_FILENO, &readfds);
-
-    struct timeval timeout;
-    timeout.tv_sec = 0;
-    timeout.tv_usec = 0;
-    return select(1, &readfds, NULL, NULL, &timeout) != 0;
-}
-*/
-
-
-
-// @@diff : {Sign Extend}
+// @@diff : {Checkpointed Run}
 /*
-*   [Padding]
-*   Sign extension is the operation of increasing the number of bits of a binary number.
-*   This is achieved by adding digits to the most significant side of the number.
-*   The most significant bit of the original number is used as the extension bit.
-*   The value of the extension bits is the same as the value of the most significant bit.
-*   Sign extension is used to preserve the sign of a number when it is extended.
-*   Sign extension is used to extend the length of a number without changing its value.
+*   vm_run() in slices short enough to notice Ctrl-C quickly, with a checkpoint every
+*   `every` instructions and one when the run ends for any reason.
 */
-uint16_t sign_extend(uint16_t x, int bit_count) // sign extend the number
-{
-    if((x >> (bit_count - 1)) & 1) // if the most significant bit is 1
-    {
-        x |= (0xFFFF << bit_count); // set the most significant bits to 1
-    }
-    return x;
-}
-
-uint16_t swap16(uint16_t x) // swap the value to big endian format
-{
-    return (x << 8) | (x >> 8); // shift the value by 8 bits and OR it with the value shifted by 8 bits
-}
-
-//@@diff : {Update Flags}
-
-void update_flags(uint16_t r)
-{
-    if(reg[r] == 0)
-    {
-        reg[R_COND] = FL_ZRO;
-    }
-    else if (reg[r] >> 15) // 1 in the leftmost-bit indicates negative value
-    {
-        reg[R_COND] = FL_NEG;
-    }
-    else
-    {
-        reg[R_COND] = FL_POS;
-    }
-
-    
-}
-//@@diff : {Read Image File}
-int read_image_file(FILE* file)
-{
-    /* the origin tells us where in memory to place the image */
-    uint16_t origin;
-    fread(&origin, sizeof(origin), 1, file); // read the origin from the file
-    origin = swap16(origin); // swap the origin to big endian format
-
-    //we know the maximum file size so we only need one fread().
-
-    uint16_t max_read = MEMORY_MAX - origin; // calculate the maximum number of words that can be read.
-    uint16_t* p = memory + origin; // set the pointer to the memory location
-    size_t read = fread(p, sizeof(uint16_t), max_read, file); // read the image from the file
-
-    // swap to little endian
-    while(read-- > 0)
-    {
-        *p = swap16(*p); // swap the value to little endian format
-        ++p;
-    }
-}
-
-int read_image(const char* image_path)
-{
-    FILE *file = fopen(image_path, "rb"); // open the file in binary mode
-    if(!file) // if the file is not opened
-    {
-        return 0;
-    }
-    read_image_file(file); // read the image file
-    fclose(file); // close the file
-    return 1;
-}
-
-
-void mem_write(uint16_t address, uint16_t val) // write the value to the memory location
+enum
 {
-    memory[address] = val; // write the value to the memory location
-}
+    CHECKPOINT_SLICE = 1 << 22
+};
 
-uint16_t mem_read(uint16_t address) // read the value from the memory location
+static int run_checkpointed(struct lc3_vm* vm, uint64_t budget, struct lc3_checkpoint* cp, uint64_t every)
 {
-    if(address == MR_KBSR) // if the address is the keyboard status register
+    uint64_t start = vm->instret, last = vm->instret;
+    int run;
+    for(;;)
     {
-        if(_kbhit()) // if a key is pressed
+        uint64_t n = CHECKPOINT_SLICE;
+        if(budget && budget - (vm->instret - start) < n)
         {
-            memory[MR_KBSR] = (1 << 15); // set the keyboard status register to 1
-            memory[MR_KBDR] = getchar(); // get the character from the keyboard
+            n = budget - (vm->instret - start);
         }
-        else
+        run = vm_run(vm, n);
+        int done = run != LC3_RUN_BUDGET || (budget && vm->instret - start >= budget) || main_pause == 2;
+        if(done || vm->instret - last >= every)
         {
-            memory[MR_KBSR] = 0; // set the keyboard status register to 0
+            if(!checkpoint_write(cp))
+            {
+                console_flush();
+                fprintf(stderr, "failed to write checkpoint\n");
+            }
+            last = vm->instret;
         }
-    }
-    return memory[address]; // return the value from the memory location
-}
-
-
-
-void print_state()
-{
-    printf("Registers:\n");
-    for (int i = 0; i < R_COUNT; i++)
-    {
-        printf("R%d: 0x%04X\n", i, reg[i]);
-    }
-    printf("Memory:\n");
-    for (int i = 0; i < MEMORY_MAX; i++)
-    {
-        if (memory[i] != 0)
+        if(done)
         {
-            printf("0x%04X: 0x%04X\n", i, memory[i]);
+            return run;
         }
     }
-    printf("\n");
 }
 
 // @@diff : Main
@@ -336,291 +103,408 @@ int main(int argc, char* argv[])
 {
     //@diff : {Load Arguments}
    
-   if(argc<2)
-   { 
-        printf("lc3 [image-file1] ...\n"); //usage string
-        exit(2);
-   }
-   for(int j=1; j<argc; j++) // loop through each argument read the image file
+   int trace = TRACE_NONE;
+   const char* trace_path = NULL;
+   int core = CORE_THREADED;
+   int compare = 0;
+   const char* manifest = NULL;
+   int profile = 0;
+   const char* profile_path = "lc3.folded";
+   const char* record_path = NULL;
+   const char* replay_path = NULL;
+   const char* os_path = NULL;
+   int debug = 0;
+   uint64_t undo_mb = 0; // --undo log size, 0 = none
+   const char* checkpoint_path = NULL;
+   const char* resume_path = NULL;
+   uint64_t checkpoint_every = 100000000;
+   int stats = 0; // 1 = table, 2 = JSON
+   int disasm = 0;
+   const char* cfg_path = NULL;
+   struct batch_options batch = { 0, CORE_THREADED, 0, 0, NULL, 0 };
+   int first_image = 1;
+   for(; first_image < argc && strncmp(argv[first_image], "--", 2) == 0; first_image++) // options come before the images
    {
-        if(!read_image(argv[j])) // if the image file is not read
+        const char* arg = argv[first_image];
+        if(strcmp(arg, "--trace=regs") == 0)
         {
-            printf("failed to load image: %s\n", argv[j]);
-            exit(1);
+            trace = TRACE_REGS;
         }
-   }
-
-   signal(SIGINT, handle_interrupt); // handle the interrupt signal
-   disable_input_buffering(); // disable the input buffering
-
-   //@diff : {Setup}
-
-   /*   since exactly one condition flag should be set at any 
-   *    given time, set the Z flag 
-   */
-  reg[R_COND] = FL_ZRO;
-  enum{PC_START = 0x3000}; // default PC starting position
-  reg[R_PC] = PC_START; // default PC starting position
-
-  int running = 1;
-  while(running)
-  {
-    //Fetch
-    uint16_t instr = mem_read(reg[R_PC]++);
-    uint16_t op = instr >> 12;
-
-    switch(op)
-    {
-        case OP_ADD:
-            // @@ diff : {ADD}
-            {
-                uint16_t r0 = (instr >> 9) & 0x7; // The shift moves the register field to the lowest three bits. // 0x7(111 in binary) ensures only those three bits are preserved.
-                uint16_t r1 = (instr >> 6) & 0x7; // first operand (SR1)
-                uint16_t imm_flag = (instr >> 5) & 0x1; // immediate flag (0 = register, 1 = immediate) // 0x1 ensures only the lowest bit is preserved.
-                
-                if(imm_flag)
-                {
-                    uint16_t imm5 = sign_extend(instr & 0x1F, 5); // sign extend the 5-bit immediate to 16 bits
-                    reg[r0] = reg[r1] + imm5; // perform the addition
-                }
-                else
-                {
-                    uint16_t r2 = instr & 0x7; // second operand (SR2)
-                    reg[r0] = reg[r1] + reg[r2]; // perform the addition
-                }
-
-                update_flags(r0); // update the condition flags
-
-            }
-
-        break;
-
-        case OP_AND:
-            {
-                // @@ diff : {AND}
-                uint16_t r0 = (instr >> 9) & 0x7; // destination register
-                uint16_t r1 = (instr >> 6) & 0x7; // first operand
-                uint16_t imm_flag = (instr >> 5) & 0x1; // immediate flag
-                if(imm_flag)
-                {
-                    uint16_t imm5 = sign_extend(instr & 0x1F, 5); // sign-extend the 5-bit immediate to 16 bits
-                    reg[r0] = reg[r1] & imm5; // perform the AND
-                }
-                else
-                {
-                    uint16_t r2 = instr & 0x7; // second operand
-                    reg[r0] = reg[r1] & reg[r2]; // perform the AND
-                }
-                update_flags(r0); // update the condition flags
-            }
-        break;
-
-        case OP_NOT:      
+        else if(strcmp(arg, "--trace=delta") == 0)
         {
-            // @@ diff : {NOT}
-            uint16_t r0 = (instr >> 9) & 0x7; // destination register
-            uint16_t r1 = (instr >> 6) & 0x7; // source register
-            reg[r0] = ~reg[r1]; // perform the NOT
-            update_flags(r0); // update the condition flags
+            trace = TRACE_DELTA;
         }
-        break;
-
-        case OP_BR:   // Branch
-        {   // @@ diff : {BR}
-            uint16_t pc_offset = sign_extend(instr & 0x1FF, 9); // sign-extend the offset to 16 bits
-            uint16_t cond_flag = (instr >> 9) & 0x7; // condition flag
-            if(cond_flag & reg[R_COND]) // if the condition flag is set
-            {
-                reg[R_PC] += pc_offset; // branch to the location
-            }
-        }    
-        break;
-
-        case OP_JMP:    // Jump
+        else if(strcmp(arg, "--trace=none") == 0)
         {
-            // @@ diff : {JMP}
-            uint16_t r1 = (instr >> 6) & 0x7; // base register
-            reg[R_PC] = reg[r1]; // set the PC to the base register
-        }    
-        break;
-
-        case OP_JSR: // Jump to Subroutine/Register
+            trace = TRACE_NONE;
+        }
+        else if(strncmp(arg, "--trace-file=", 13) == 0)
         {
-            // @@ diff : {JSR}
-            uint16_t long_flag = (instr >> 11) & 1; // long flag (1 = long, 0 = short)
-            reg[R_R7] = reg[R_PC]; // store the return address in R7
-            
-            if(long_flag) // if the long flag is set
-            {
-                uint16_t pc_offset = sign_extend(instr & 0x7FF, 11); // sign-extend the offset to 16 bits
-                reg[R_PC] += pc_offset; // branch to the location / JSR
-            }
-            else
+            trace_path = arg + 13;
+        }
+        else if(strcmp(arg, "--core=switch") == 0)
+        {
+            core = CORE_SWITCH;
+        }
+        else if(strcmp(arg, "--core=threaded") == 0)
+        {
+            core = CORE_THREADED;
+        }
+        else if(strcmp(arg, "--core=block") == 0)
+        {
+            core = CORE_BLOCK;
+        }
+        else if(strcmp(arg, "--compare-cores") == 0)
+        {
+            compare = 1;
+        }
+        else if(strcmp(arg, "--debug") == 0)
+        {
+            debug = 1;
+        }
+        else if(strcmp(arg, "--undo") == 0)
+        {
+            undo_mb = UNDO_DEFAULT_MB;
+        }
+        else if(strncmp(arg, "--undo=", 7) == 0)
+        {
+            undo_mb = strtoull(arg + 7, NULL, 10);
+            if(!undo_mb)
             {
-                uint16_t r1 = (instr >> 6) & 0x7; // base register
-                reg[R_PC] = reg[r1]; // set the PC to the base register / JSRR
+                printf("--undo needs a size in MiB of at least 1\n");
+                exit(2);
             }
+        }
+        else if(strcmp(arg, "--profile") == 0)
+        {
+            profile = 1;
+        }
+        else if(strncmp(arg, "--profile-file=", 15) == 0)
+        {
+            profile = 1;
+            profile_path = arg + 15;
+        }
+        else if(strcmp(arg, "--disasm") == 0)
+        {
+            disasm = 1;
+        }
+        else if(strncmp(arg, "--cfg=", 6) == 0)
+        {
+            cfg_path = arg + 6;
+        }
+        else if(strcmp(arg, "--stats") == 0 || strcmp(arg, "--stats=text") == 0)
+        {
+            stats = 1;
+        }
+        else if(strcmp(arg, "--stats=json") == 0)
+        {
+            stats = 2;
+        }
+        else if(strncmp(arg, "--record=", 9) == 0)
+        {
+            record_path = arg + 9;
+        }
+        else if(strncmp(arg, "--replay=", 9) == 0)
+        {
+            replay_path = arg + 9;
+        }
+        else if(strncmp(arg, "--os=", 5) == 0)
+        {
+            os_path = arg + 5;
+        }
+        else if(strncmp(arg, "--checkpoint=", 13) == 0)
+        {
+            checkpoint_path = arg + 13;
+        }
+        else if(strncmp(arg, "--checkpoint-every=", 19) == 0)
+        {
+            checkpoint_every = strtoull(arg + 19, NULL, 10);
+        }
+        else if(strncmp(arg, "--resume=", 9) == 0)
+        {
+            resume_path = arg + 9;
+        }
+        else if(strncmp(arg, "--batch=", 8) == 0)
+        {
+            manifest = arg + 8;
+        }
+        else if(strncmp(arg, "--batch-out=", 12) == 0)
+        {
+            batch.out_path = arg + 12;
+        }
+        else if(strncmp(arg, "--jobs=", 7) == 0)
+        {
+            batch.threads = atoi(arg + 7);
+        }
+        else if(strncmp(arg, "--budget=", 9) == 0)
+        {
+            batch.budget = strtoull(arg + 9, NULL, 10);
+        }
+        else if(strncmp(arg, "--timeout=", 10) == 0)
+        {
+            batch.timeout_ms = strtoull(arg + 10, NULL, 10);
+        }
+        else
+        {
+            printf("unknown option: %s\n", arg);
+            exit(2);
+        }
+   }
 
-        }    
-        break;
-
-        case OP_LD:   // Load
-        {    // @@ diff : {LD}
-            uint16_t r0 = (instr >> 9) & 0x7; // destination register
-            uint16_t pc_offset = sign_extend(instr & 0x1FF, 9); // sign-extend the offset to 16 bits
-            
-            reg[r0] = mem_read(reg[R_PC] + pc_offset); // read the value from the address in memory
-            update_flags(r0); // update the condition flags
-        }   
-        break;
-
-        case OP_LDI:    // Load Indirect
-        {    // @@ diff : {LDI}
-            uint16_t r0 = (instr >> 9) & 0x7; // destination register
-            uint16_t pc_offset = sign_extend(instr & 0x1FF, 9); // sign-extend the offset to 16 bits
-            // add pc_offset to the current PC, look at that memory location to get the final address
-            reg[r0] = mem_read(mem_read(reg[R_PC] + pc_offset)); // read the value from the address in memory
-            update_flags(r0); // update the condition flags
-        }    
-        break;
+   if(manifest)
+   {
+        batch.core = core;
+        batch.stats = stats != 0; // always JSON, in the job's line
+        return batch_run(manifest, &batch); // every job gets its own VM, the console is not used
+   }
 
-        case OP_LDR:    // Load Register
-        {    // @@ diff : {LDR}
-            uint16_t r0 = (instr >> 9) & 0x7; //destination register
-            uint16_t r1 = (instr >> 6) & 0x7; // base register
+   if((record_path || replay_path) && (compare || (record_path && replay_path)))
+   {
+        printf("--record and --replay run one core, on their own\n");
+        exit(2);
+   }
+   if(debug && compare)
+   {
+        printf("--debug and --compare-cores do not go together\n");
+        exit(2);
+   }
+   if(undo_mb && !debug)
+   {
+        printf("--undo is for stepping backwards in --debug\n");
+        exit(2);
+   }
 
-            uint16_t offset = sign_extend(instr & 0x3F, 6); // sign-extend the offset to 16 bits
-            reg[r0] = mem_read(reg[r1]+offset); // read the value from the address in memory
-            update_flags(r0); // update the condition flags
-        }    
-        break;
+   if((checkpoint_path || resume_path) && (compare || debug || record_path || replay_path))
+   {
+        printf("--checkpoint and --resume do not go with --compare-cores, --debug, --record or --replay\n");
+        exit(2);
+   }
+   if(resume_path && (first_image < argc || os_path))
+   {
+        printf("--resume restores all of memory, it takes no images\n");
+        exit(2);
+   }
 
-        case OP_LEA: // Load Effective Address
-        { // @@ diff : {LEA}
-            uint16_t r0 = (instr >> 9) & 0x7; // destination register
-            uint16_t pc_offset = sign_extend(instr & 0x1FF, 9); // sign-extend the offset to 16 bits.
-            reg[r0] = reg[R_PC] + pc_offset; // load the effective address
-            update_flags(r0); // update the condition flags
-        }
-        break;
+   if(first_image >= argc && !resume_path)
+   { 
+        printf("lc3 [--trace=none|regs|delta] [--trace-file=path] [--core=switch|threaded|block] [--compare-cores] [--debug [--undo[=MiB]]] [--profile] [--profile-file=path] [--stats[=text|json]] [--record=log|--replay=log] [--os=image] [--budget=N] [--timeout=ms] [--checkpoint=path] [--checkpoint-every=N] [image-file1] ...\n"); //usage string
+        printf("lc3 --disasm|--cfg=graph.dot [--os=image] [image-file1] ...  (listing or per-block summary on stdout, nothing runs)\n");
+        printf("lc3 --resume=path [--checkpoint=path] [--checkpoint-every=N] [other options as above]\n");
+        printf("lc3 --batch=manifest [--jobs=N] [--budget=N] [--timeout=ms] [--batch-out=path] [--core=...] [--stats]\n");
+        exit(2);
+   }
+   //@diff : {Setup}
+   main_vm = vm_create(); // empty memory, devices registered, PC = 0x3000, Z flag set
+   if(!main_vm)
+   {
+        printf("out of memory\n");
+        exit(1);
+   }
+   vm_set_core(main_vm, core);
 
-        case OP_ST:   // Store
-        {
-            // @@ diff : {ST}
-            uint16_t r0 = (instr >> 9) & 0x7; // source register
-            uint16_t pc_offset = sign_extend(instr & 0x1FF, 9); // sign-extend the offset to 16 bits
-            mem_write(reg[R_PC] + pc_offset, reg[r0]); // write the value to the address in memory
-        }    
-        break;
+   if(os_path) // full-system mode: TRAPs and interrupts go through the OS image's vector tables
+   {
+        vm_set_system(main_vm, 1);
+        if(!vm_load_image(main_vm, os_path))
+        {
+            printf("failed to load OS image: %s\n", os_path);
+            exit(1);
+        }
+   }
 
-        case OP_STI:
-            // @@ diff : {STI}
-            {
-                uint16_t r0 = (instr >> 9) & 0x7;   // Extracts the destination register (r0) from the instruction
-                uint16_t pc_offset = sign_extend(instr & 0x1FF, 9); 
-                mem_write(mem_read(reg[R_PC] + pc_offset), reg[r0]);
-            }
-        break;
+   for(int j=first_image; j<argc; j++) // loop through each argument read the image file
+   {
+        if(!vm_load_image(main_vm, argv[j])) // if the image file is not read
+        {
+            printf("failed to load image: %s\n", argv[j]);
+            exit(1);
+        }
+   }
 
-        case OP_STR:
-            // @@ diff : {STR}
+   if(disasm || cfg_path) // look at what was loaded instead of running it
+   {
+        struct lc3_cfg* cfg = cfg_build_loaded(main_vm);
+        FILE* dot = cfg_path ? (strcmp(cfg_path, "-") == 0 ? stdout : fopen(cfg_path, "w")) : NULL;
+        if(!cfg || (cfg_path && !dot))
+        {
+            printf(cfg ? "failed to create %s\n" : "out of memory\n", cfg_path);
+            exit(1);
+        }
+        if(disasm)
+        {
+            cfg_write_listing(main_vm, cfg, stdout);
+        }
+        if(dot)
+        {
+            cfg_write_summary(main_vm, cfg, dot == stdout ? stderr : stdout);
+            cfg_write_dot(main_vm, cfg, dot);
+            if(dot != stdout)
             {
-                uint16_t r0 = (instr >> 9) & 0x7;
-                uint16_t r1 = (instr >> 6) & 0x7;
-                uint16_t offset = sign_extend(instr & 0x3F, 6);
-                mem_write(reg[r1] + offset, reg[r0]);
+                fclose(dot);
             }
-        break;
-
-        case OP_TRAP:
-            // @@ diff : {TRAP}
-            {
-                reg[R_R7] = reg[R_PC];
-                switch(instr & 0xFF)
-                {
-                    case TRAP_GETC:
-                    {
-                        //@TRAP_GETC
-                        reg[R_R0] = (uint16_t)getchar(); // read a single ASCII character
-                        update_flags(R_R0); // update the condition flags
-                    }
-                    break;
-
-                    case TRAP_OUT:
-                    {
-                        //@TRAP_OUT
-                        putc((char)reg[R_R0], stdout); // output a single ASCII character
-                        fflush(stdout); // flush the output
-                    }
-                    break;
+        }
+        cfg_free(cfg);
+        vm_destroy(main_vm);
+        return 0;
+   }
+   struct checkpoint_report resumed;
+   if(resume_path)
+   {
+        if(!checkpoint_load(main_vm, resume_path, &resumed))
+        {
+            printf("failed to resume from %s: %s\n", resume_path, resumed.message);
+            exit(1);
+        }
+        if(resumed.truncated)
+        {
+            fprintf(stderr, "%s: %s\n", resume_path, resumed.message);
+        }
+   }
+   struct lc3_checkpoint* checkpoint = NULL;
+   if(checkpoint_path) // the same file as --resume is continued, unless its tail was damaged: then it starts over
+   {
+        int append = resume_path && strcmp(resume_path, checkpoint_path) == 0 && !resumed.truncated;
+        if(!(checkpoint = checkpoint_open(main_vm, checkpoint_path, append)))
+        {
+            printf("failed to create checkpoint: %s\n", checkpoint_path);
+            exit(1);
+        }
+   }
 
-                    case TRAP_PUTS:
-                    {
-                        //@TRAP_PUTS
-                        uint16_t* c = memory + reg[R_R0]; // get the address of the string
-                        while(*c)
-                        {
-                            putc((char)*c, stdout); // output the character
-                            ++c;
-                        }
-                        fflush(stdout); // flush the output
-                    }
-                    break;
+   if(!trace_open(main_vm, trace, trace_path))
+   {
+        printf("failed to open trace file: %s\n", trace_path);
+        exit(1);
+   }
 
-                    case TRAP_IN:
-                    {
-                        //@TRAP_IN
-                        printf("Enter a character: ");
-                        char c = getchar(); // read a single ASCII character
-                        putc(c, stdout); // echo the character
-                        fflush(stdout); // flush the output
-                        reg[R_R0] = (uint16_t)c; // store the character in R0
-                        update_flags(R_R0); // update the condition flags
-                    }
-                    break;
+   if(profile && !profile_open(main_vm))
+   {
+        printf("out of memory\n");
+        exit(1);
+   }
 
-                    case TRAP_PUTSP:
-                    {
-                        //@TRAP_PUTSP
-                        /* one char per byte (two bytes per word) here we need to swap back to
-                        big endian format */
-                        uint16_t* c = memory + reg[R_R0]; // get the address of the string
-                        while(*c)
-                        {
-                            char char1 = (*c) & 0xFF; // get the first ASCII character
-                            putc(char1, stdout); // output the character
-                            char char2 = (*c) >> 8; // get the second ASCII character
-                            if(char2) putc(char2, stdout); // output the character if it is not null
-                            ++c;
-                        }
-                        fflush(stdout); // flush the output
-                    }
-                    break;
+   if(undo_mb && !undo_open(main_vm, (size_t)undo_mb << 20))
+   {
+        printf("out of memory for a %llu MiB undo log\n", (unsigned long long)undo_mb);
+        exit(1);
+   }
 
-                    case TRAP_HALT:
-                    {
-                        //@TRAP_HALT
-                        puts("HALT"); // output "HALT"
-                        fflush(stdout); // flush the output
-                        running = 0; // stop the program
-                    }
-                    break;
-                }
-            }
-        break;
+   struct lc3_replay* replay = NULL;
+   struct replay_report report;
+   if(record_path && !(main_recording = replay_record(main_vm, record_path)))
+   {
+        printf("failed to create replay log: %s\n", record_path);
+        exit(1);
+   }
+   if(replay_path && !(replay = replay_open(main_vm, replay_path, &report)))
+   {
+        printf("failed to read replay log: %s: %s\n", replay_path, report.message);
+        exit(1);
+   }
 
-        case OP_RES:
-        case OP_RTI:
+   if(!compare && !debug)
+   {
+        cfg_translate_loaded(main_vm); // after --resume, which replaces memory and flushes the blocks, and after the hooks that keep a run off the block core
+   }
 
-        default:
-            // @@ diff : {BAD OPCODE}
-            abort();
-        break;
-    }
+   signal(SIGINT, handle_interrupt); // handle the interrupt signal
+   if(!replay && !debug)
+   {
+        disable_input_buffering(); // disable the input buffering, a replay never reads the terminal; the debugger switches it itself
+   }
 
-   print_state(); // print the state of the program
-    // @@ diff : {Shutdown}
+  int status = 0;
+  int run = LC3_RUN_HALT;
+  if(compare)
+  {
+      status = compare_cores(main_vm) ? 0 : 1;
+  }
+  else if(debug)
+  {
+      status = debug_repl(main_vm, stdin, stdout, !replay); // commands on stdin, the program's keys too while it runs
+  }
+  else if(replay)
+  {
+      if(replay_length(replay) > main_vm->instret) // exactly as far as the recording went
+      {
+          run = vm_run(main_vm, replay_length(replay) - main_vm->instret);
+      }
+  }
+  else
+  {
+      vm_set_deadline(main_vm, batch.timeout_ms ? time_ms() + batch.timeout_ms : 0);
+      if(checkpoint)
+      {
+          main_pause = 1; // Ctrl-C saves before it stops
+          run = run_checkpointed(main_vm, batch.budget, checkpoint, checkpoint_every);
+      }
+      else
+      {
+          run = vm_run(main_vm, batch.budget);
+      }
+      if(main_pause == 2)
+      {
+          console_flush();
+          fprintf(stderr, "\npaused at instruction %llu, continue with --resume=%s\n", (unsigned long long)main_vm->instret, checkpoint_path);
+          status = 3;
+      }
+      else if(run == LC3_RUN_BUDGET || run == LC3_RUN_DEADLINE) // a hard cap, e.g. on a program that never halts
+      {
+          console_flush();
+          fprintf(stderr, run == LC3_RUN_BUDGET ? "stopped: instruction budget of %llu used up\n" : "stopped: %llu ms timeout\n",
+              (unsigned long long)(run == LC3_RUN_BUDGET ? batch.budget : batch.timeout_ms));
+          status = 3;
+      }
+  }
+  if(run == LC3_RUN_FAULT)
+  {
+      console_flush();
+      fprintf(stderr, "%s at 0x%04X\n", vm_fault_name(main_vm->fault), (uint16_t)(main_vm->reg[R_PC] - 1));
+      status = 1;
   }
 
+  console_flush(); // output of a program stopped through MCR or a core mismatch report
+  if(main_vm->profile)
+  {
+      profile_report(main_vm, stderr, 20);
+      if(!profile_write_folded(main_vm, profile_path))
+      {
+          fprintf(stderr, "failed to write folded stacks: %s\n", profile_path);
+      }
+  }
+  if(stats && !compare)
+  {
+      struct lc3_stats counters;
+      vm_stats(main_vm, &counters);
+      if(stats == 2)
+      {
+          stats_print_json(&counters, stderr);
+          fputc('\n', stderr);
+      }
+      else
+      {
+          stats_print(&counters, stderr);
+      }
+  }
+  if(main_recording || replay)
+  {
+      int ok = replay_close(replay ? replay : main_recording, &report);
+      main_recording = NULL;
+      if(!ok)
+      {
+          fprintf(stderr, "%s\n", report.message);
+          status = 1;
+      }
+      else if(replay)
+      {
+          fprintf(stderr, "replay matched: %llu instructions, %llu input events\n",
+              (unsigned long long)report.instret, (unsigned long long)report.events);
+      }
+  }
+  checkpoint_close(checkpoint);
+  trace_close(main_vm); // flush the trace
   restore_input_buffering(); // restore the input buffering
+  vm_destroy(main_vm);
+  return status;
 }
+
@@ -0,0 +1,261 @@
+/*      LC-3 Simulator - machine definitions
+*       Registers, condition flags, opcodes, device and trap addresses, and the memory/register
+*       storage shared by every part of the emulator (see lc-3.c for the overview).
+*/
+#ifndef LC3_H
+#define LC3_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+enum
+{
+    R_R0 = 0,  
+    R_R1,     
+    R_R2,    
+    R_R3,
+    R_R4,
+    R_R5,
+    R_R6,
+    R_R7,
+    R_PC, // Program Counter
+    R_COND, // Condition Flags
+    R_COUNT // Total number of registers
+};
+
+
+
+
+// @@diff : {Condition Flags}
+/*
+*   The condition flags register (COND) is used to store information 
+*   about the most recent operation that was performed.
+*   The condition flags are as follows:
+*       - 0000: POS (Positive) // The most recent operation resulted in a positive value
+*       - 0001: ZRO (Zero)     // The most recent operation resulted in a value of zero
+*       - 0010: NEG (Negative) // The most recent operation resulted in a negative value
+*/
+enum
+{
+    FL_POS = 1 << 0, // P
+    FL_ZRO = 1 << 1, // Z
+    FL_NEG = 1 << 2, // N
+};
+
+// @@diff : {OpCodes}
+
+/*  
+*   Instructions have both an opcode which indicates the kind of task to perform 
+*   and a set of parameters which provide inputs to the task being performed
+*   Each opcode represents one task that the CPU “knows” how to do.
+*   
+*   The LC-3 has 16 total opcodes, each of which is 4 bits.
+*   The opcodes are as follows:
+*       - 0001: ADD (R1 = R2 + R3)
+*       - 0101: AND (R1 = R2 & R3)
+*       - 0000: BR  (Branch)
+*       - 1100: JMP (Jump)
+*       - 0100: JSR (Jump to Subroutine)
+*       - 0100: JSRR (Jump to Subroutine)
+*       - 0010: LD (LOAD)
+*       - 1010: LDI (LOAD Indirect)
+*       - 0110: LDR (LOAD Register)
+*       - 1110: LEA (LOAD Effective Address)
+*       - 1001: NOT (NOT)
+*       - 1000: RTI (Return from Interrupt)
+*       - 0011: ST (Store)
+*       - 1011: STI (Store Indirect)
+*       - 0111: STR (Store Register)
+*       - 1111: TRAP (TRAP aka system call)
+*/
+enum
+{
+    OP_BR = 0, // branch
+    OP_ADD,    // add
+    OP_LD,     // load
+    OP_ST,     // store
+    OP_JSR,    // jump register
+    OP_AND,    // bitwise and
+    OP_LDR,    // load register
+    OP_STR,    // store register
+    OP_RTI,    // return from interrupt (full-system mode only)
+    OP_NOT,    // bitwise not
+    OP_LDI,    // load indirect
+    OP_STI,    // store indirect
+    OP_JMP,    // jump
+    OP_RES,    // reserved (illegal opcode exception in full-system mode)
+    OP_LEA,    // load effective address
+    OP_TRAP    // execute trap
+};
+
+enum 
+{
+    MR_KBSR = 0xFE00, /* keyboard status register */
+    MR_KBDR = 0xFE02, /* keyboard data register */
+    MR_DSR = 0xFE04,  /* display status register */
+    MR_DDR = 0xFE06,  /* display data register */
+    MR_TMR = 0xFE08,  /* timer status register */
+    MR_TMI = 0xFE0A,  /* timer interval register (milliseconds) */
+    MR_PSR = 0xFFFC,  /* processor status register */
+    MR_MCR = 0xFFFE   /* machine control register */
+};
+
+enum
+{
+    MMIO_BASE = 0xFE00, /* first address of the device page */
+    MMIO_SIZE = 0x200   /* the device page runs to the end of memory */
+};
+
+enum
+{
+    TRAP_GETC = 0x20,   /* get character from keyboard, not echoed onto the terminal */
+    TRAP_OUT = 0x21,     /* output a character */
+    TRAP_PUTS = 0x22,   /* output a word string */
+    TRAP_IN = 0x23,      /* get character from keyboard, echoed onto the terminal */
+    TRAP_PUTSP = 0x24,  /* output a byte string */
+    TRAP_HALT = 0x25    /* halt the program */
+};
+
+
+
+//  @@diff: {Memory Storage}
+#define MEMORY_MAX (1<<16) // 65536 Locations of memory
+
+
+//  @@diff: {Registers}
+/*  
+*   The LC-3 has 10 total registers, each of which is 16 bits. 
+*   Most of them are general purpose, but a few have designated roles: - 
+*        - 8 general purpose registers (R0-R7) [can be used to perform any program calculations]
+*        - 1 program counter (PC) register [an unsigned integer which is the address of the next instruction in memory to execute]
+*        - 1 condition flags (COND) register [tells us information about the previous calculation.]
+*
+*   Memory and registers live in a struct lc3_vm (vm.h), so one process can run any number
+*   of machines side by side.
+*/
+
+// @@diff : {VM API}
+struct lc3_vm;
+
+enum
+{
+    PC_START = 0x3000 // default PC starting position
+};
+
+/*
+*   Where a machine's TRAP routines and keyboard/display devices read and write.
+*   The default (vm_create()) is the process console.
+*/
+struct lc3_io
+{
+    void* ctx;                     // passed back to every callback
+    int (*getc)(void* ctx);        // blocking read of one character, EOF at the end of input
+    int (*poll)(void* ctx);        // nonzero if getc() would not block
+    void (*putc)(void* ctx, char c);
+    void (*flush)(void* ctx);      // may be NULL
+    uint64_t (*clock)(void* ctx);  // milliseconds for the timer device, NULL = the host clock
+    const char* in_prompt;         // printed by TRAP IN before it reads, NULL = nothing
+    void (*wait)(void* ctx, int timeout_ms); // block until poll() would report a key or timeout_ms pass, NULL = never block
+};
+
+#define LC3_IN_PROMPT "Enter a character: " // what the console (and batch runs) print for TRAP IN
+
+enum
+{
+    LC3_RUN_HALT = 0, // TRAP HALT or MCR stopped the machine
+    LC3_RUN_BUDGET,   // the step budget ran out, vm_run() again to continue
+    LC3_RUN_FAULT,    // see LC3_FAULT_*, PC is just past the bad instruction
+    LC3_RUN_DEADLINE, // the deadline set by vm_set_deadline() passed, vm_run() again to continue
+    LC3_RUN_BREAK     // a breakpoint or watchpoint (debug.h) stopped the machine, vm_run() again to continue
+};
+
+enum
+{
+    LC3_FAULT_NONE = 0,
+    LC3_FAULT_OPCODE,    // the reserved opcode
+    LC3_FAULT_PRIVILEGE, // RTI, which user programs may not run
+    LC3_FAULT_MEMORY,    // no host memory for a page the program wrote to
+    LC3_FAULT_VECTOR     // full-system mode: TRAP, exception or interrupt with no handler in the vector table
+};
+
+/*
+*   Why vm_run_result() returned. Nothing in the library calls exit() or abort(), or touches
+*   the terminal unless the console I/O is in use, so a host can run untrusted programs in
+*   process and read everything off this.
+*/
+struct lc3_run_result
+{
+    int status;              // LC3_RUN_*
+    int fault;               // LC3_FAULT_*, set with LC3_RUN_FAULT
+    uint16_t pc;             // where the machine stopped
+    uint64_t instructions;   // retired during this call
+    uint64_t instret;        // retired since the last reset
+};
+
+struct lc3_vm* vm_create(); // reset machine with console I/O, NULL if out of memory
+void vm_destroy(struct lc3_vm* vm);
+void vm_reset(struct lc3_vm* vm); // clear memory, registers and caches; PC = PC_START
+void vm_set_io(struct lc3_vm* vm, const struct lc3_io* io);
+void vm_set_core(struct lc3_vm* vm, int core); // CORE_* from core.h
+void vm_set_system(struct lc3_vm* vm, int on); // full-system mode (system.h): TRAPs and interrupts go through a loaded OS image
+int vm_load_image(struct lc3_vm* vm, const char* image_path); // .obj image, or .asm source assembled in place; 0 on failure
+int vm_run(struct lc3_vm* vm, uint64_t n_steps); // run at most n_steps instructions (0 = until it stops), returns LC3_RUN_*
+void vm_set_deadline(struct lc3_vm* vm, uint64_t deadline_ms); // vm_run() returns once time_ms() reaches it; 0 = no deadline
+int vm_run_result(struct lc3_vm* vm, uint64_t n_steps, struct lc3_run_result* result); // vm_run() that also fills in result
+const char* vm_fault_name(int fault); // "bad opcode", ... for LC3_FAULT_*
+
+/*
+*   What a machine did since vm_create() or vm_reset(), counted on every core all the time.
+*   Per-opcode counts cost one increment per instruction on the switch and threaded cores and
+*   one per block on the block core; everything else is counted where the slow paths already
+*   are (device page, TRAPs, I/O callbacks).
+*/
+struct lc3_stats
+{
+    uint64_t instructions;   // retired, vm->instret
+    uint64_t opcodes[16];    // per OP_*, RTI and the reserved opcode included
+    uint64_t loads;          // data words read by LD, LDR, LDI (two) and STI (the pointer)
+    uint64_t stores;         // data words written by ST, STR and STI
+    uint64_t device_reads;   // accesses to the device page (xFE00 and up), instruction fetches included
+    uint64_t device_writes;
+    uint64_t traps[256];     // TRAPs by vector
+    uint64_t input_bytes;    // characters read through GETC, IN and KBDR
+    uint64_t output_bytes;   // characters written through TRAPs and DDR
+    uint64_t input_wait_ns;  // time blocked in the getc() and wait() callbacks
+};
+void vm_stats(struct lc3_vm* vm, struct lc3_stats* stats); // current counters; loads and stores are worked out from the opcode counts
+
+/*
+*   Headless I/O: input comes from a buffer (EOF once it is used up) and output goes into
+*   one, so nothing reaches the terminal. There is no TRAP IN prompt.
+*/
+struct lc3_buffer_io
+{
+    const char* input;
+    size_t input_size;
+    size_t input_pos;        // next character GETC/IN/KBDR will read
+    char* output;            // not NUL terminated
+    size_t output_cap;
+    size_t output_size;      // bytes printed; past output_cap they were counted but dropped
+};
+void vm_set_buffer_io(struct lc3_vm* vm, struct lc3_buffer_io* buffers); // buffers must outlive its use by vm
+
+/*
+*   Copy-on-write snapshots: load and boot an image once, then fork a VM per test input.
+*   Forks and restores share every page with the snapshot until they write to it.
+*/
+struct lc3_snapshot;
+struct lc3_snapshot* vm_snapshot(struct lc3_vm* vm); // freeze vm's state, NULL if out of memory
+struct lc3_vm* vm_fork(const struct lc3_snapshot* snap); // new VM in the snapshot's state, NULL if out of memory
+void vm_restore(struct lc3_vm* vm, const struct lc3_snapshot* snap); // put vm back into the snapshot's state
+void snapshot_destroy(struct lc3_snapshot* snap);
+
+
+// @@diff : {Machine Helpers}
+uint16_t sign_extend(uint16_t x, int bit_count); // sign extend the low bit_count bits
+uint16_t swap16(uint16_t x); // swap the bytes of a word
+void update_flags(struct lc3_vm* vm, uint16_t r); // set COND from register r
+void print_state(struct lc3_vm* vm); // full register and memory dump, for one-off debugging
+
+#endif
@@ -0,0 +1,133 @@
+; LC-3 operating system for full-system mode:  ./lc3 --os=src/lc3os.asm program.obj
+;
+; Fills the trap vector table (x0000) and the exception entries of the interrupt vector
+; table (x0100), and implements GETC, OUT, PUTS, IN, PUTSP and HALT on the devices. The
+; machine enters each routine in supervisor mode on the supervisor stack; they return with
+; RTI, which also gives the caller its own condition codes back. Every register but R0
+; (the result of GETC and IN) is preserved. The keyboard (x0180) and timer (x0181)
+; interrupt entries are left to the program: it installs a handler there, then sets bit 14
+; of KBSR or TMR.
+
+        .ORIG x0020
+        .FILL T_GETC            ; x20
+        .FILL T_OUT             ; x21
+        .FILL T_PUTS            ; x22
+        .FILL T_IN              ; x23
+        .FILL T_PUTSP           ; x24
+        .FILL T_HALT            ; x25
+        .END
+
+        .ORIG x0100
+        .FILL E_PRIVILEGE       ; x00: RTI in user mode
+        .FILL E_OPCODE          ; x01: reserved opcode
+        .END
+
+        .ORIG x0200
+; GETC: wait for a key, R0 = the character
+T_GETC  LDI R0, A_KBSR
+        BRzp T_GETC
+        LDI R0, A_KBDR
+        RTI
+
+; OUT: print the character in R0
+T_OUT   ADD R6, R6, #-1
+        STR R1, R6, #0
+OUT_W   LDI R1, A_DSR
+        BRzp OUT_W
+        STI R0, A_DDR
+        LDR R1, R6, #0
+        ADD R6, R6, #1
+        RTI
+
+; PUTS: print the string at R0, one character per word
+T_PUTS  ADD R6, R6, #-2
+        STR R0, R6, #0
+        STR R1, R6, #1
+        ADD R1, R0, #0
+PUTS_L  LDR R0, R1, #0
+        BRz PUTS_D
+        TRAP x21
+        ADD R1, R1, #1
+        BR PUTS_L
+PUTS_D  LDR R0, R6, #0
+        LDR R1, R6, #1
+        ADD R6, R6, #2
+        RTI
+
+; IN: prompt, wait for a key and echo it, R0 = the character
+T_IN    LEA R0, PROMPT
+        TRAP x22
+        TRAP x20
+        TRAP x21
+        RTI
+
+; PUTSP: print the string at R0, two characters per word, low byte first
+T_PUTSP ADD R6, R6, #-6
+        STR R0, R6, #0
+        STR R1, R6, #1
+        STR R2, R6, #2
+        STR R3, R6, #3
+        STR R4, R6, #4
+        STR R5, R6, #5
+        ADD R1, R0, #0
+PSP_L   LDR R2, R1, #0
+        BRz PSP_D
+        LD R0, LOW
+        AND R0, R2, R0
+        TRAP x21
+        AND R0, R0, #0          ; R0 = R2 >> 8: R3 walks the high bits, R5 the low ones
+        LD R3, BIT8
+        AND R5, R5, #0
+        ADD R5, R5, #1
+PSP_B   AND R4, R2, R3
+        BRz PSP_Z
+        ADD R0, R0, R5
+PSP_Z   ADD R5, R5, R5
+        ADD R3, R3, R3
+        BRnp PSP_B
+        ADD R0, R0, #0
+        BRz PSP_N               ; no second character in this word
+        TRAP x21
+PSP_N   ADD R1, R1, #1
+        BR PSP_L
+PSP_D   LDR R0, R6, #0
+        LDR R1, R6, #1
+        LDR R2, R6, #2
+        LDR R3, R6, #3
+        LDR R4, R6, #4
+        LDR R5, R6, #5
+        ADD R6, R6, #6
+        RTI
+
+; HALT: print HALT and stop the clock
+T_HALT  LEA R0, HALTED
+        TRAP x22
+        LDI R0, A_MCR
+        LD R1, CLOCK
+        AND R0, R0, R1
+        STI R0, A_MCR
+        BR T_HALT               ; only reached if the clock is started again
+
+E_PRIVILEGE
+        LEA R0, M_PRIV
+        TRAP x22
+        TRAP x25
+
+E_OPCODE
+        LEA R0, M_OPCODE
+        TRAP x22
+        TRAP x25
+
+A_KBSR  .FILL xFE00
+A_KBDR  .FILL xFE02
+A_DSR   .FILL xFE04
+A_DDR   .FILL xFE06
+A_MCR   .FILL xFFFE
+CLOCK   .FILL x7FFF
+LOW     .FILL x00FF
+BIT8    .FILL x0100
+PROMPT  .STRINGZ "Enter a character: "
+HALTED  .STRINGZ "HALT\n"
+M_PRIV  .STRINGZ "\nprivilege mode exception\n"
+M_OPCODE .STRINGZ "\nillegal opcode exception\n"
+        .END
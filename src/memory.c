@@ -0,0 +1,183 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#include "lc3.h"
+#include "vm.h"
+#include "memory.h"
+#include "undo.h"
+
+// @@diff : {Sign Extend}
+/*
+*   [Padding]
+*   Sign extension is the operation of increasing the number of bits of a binary number.
+*   This is achieved by adding digits to the most significant side of the number.
+*   The most significant bit of the original number is used as the extension bit.
+*   The value of the extension bits is the same as the value of the most significant bit.
+*   Sign extension is used to preserve the sign of a number when it is extended.
+*   Sign extension is used to extend the length of a number without changing its value.
+*/
+uint16_t sign_extend(uint16_t x, int bit_count) // sign extend the number
+{
+    if((x >> (bit_count - 1)) & 1) // if the most significant bit is 1
+    {
+        x |= (0xFFFF << bit_count); // set the most significant bits to 1
+    }
+    return x;
+}
+
+uint16_t swap16(uint16_t x) // swap the value to big endian format
+{
+    return (x << 8) | (x >> 8); // shift the value by 8 bits and OR it with the value shifted by 8 bits
+}
+
+//@@diff : {Update Flags}
+
+void update_flags(struct lc3_vm* vm, uint16_t r)
+{
+    uint16_t* reg = vm->reg;
+    if(reg[r] == 0)
+    {
+        reg[R_COND] = FL_ZRO;
+    }
+    else if (reg[r] >> 15) // 1 in the leftmost-bit indicates negative value
+    {
+        reg[R_COND] = FL_NEG;
+    }
+    else
+    {
+        reg[R_COND] = FL_POS;
+    }
+
+    
+}
+// @@diff : {Memory Pages}
+struct lc3_page zero_page; // all zero, refs is never looked at
+
+void page_ref(struct lc3_page* page)
+{
+    if(page == &zero_page)
+    {
+        return;
+    }
+#if defined(_MSC_VER)
+    _InterlockedIncrement((volatile long*)&page->refs);
+#else
+    __atomic_add_fetch(&page->refs, 1, __ATOMIC_RELAXED);
+#endif
+}
+
+void page_unref(struct lc3_page* page)
+{
+    if(page == &zero_page)
+    {
+        return;
+    }
+#if defined(_MSC_VER)
+    long left = _InterlockedDecrement((volatile long*)&page->refs);
+#else
+    uint32_t left = __atomic_sub_fetch(&page->refs, 1, __ATOMIC_ACQ_REL);
+#endif
+    if(left == 0)
+    {
+        free(page);
+    }
+}
+
+uint16_t* page_unshare(struct lc3_vm* vm, int page)
+{
+    struct lc3_page* old = vm->pages[page];
+#if defined(_MSC_VER)
+    uint32_t refs = old == &zero_page ? 0 : (uint32_t)_InterlockedOr((volatile long*)&old->refs, 0);
+#else
+    uint32_t refs = old == &zero_page ? 0 : __atomic_load_n(&old->refs, __ATOMIC_ACQUIRE);
+#endif
+    if(refs != 1) // zero page or still shared: copy it
+    {
+        struct lc3_page* copy = malloc(sizeof(struct lc3_page));
+        if(!copy)
+        {
+            vm->running = 0; // the write is lost, stop before anything reads it back
+            vm->fault = LC3_FAULT_MEMORY;
+            return vm->discard; // writable[] stays NULL, so the next write tries again
+        }
+        memcpy(copy->words, old->words, sizeof(copy->words));
+        copy->refs = 1;
+        vm->pages[page] = copy;
+        page_unref(old);
+    }
+    vm->writable[page] = vm->pages[page]->words;
+    return vm->writable[page];
+}
+
+void pages_release(struct lc3_vm* vm)
+{
+    for(int p = 0; p < PAGE_COUNT; p++)
+    {
+        if(vm->pages[p])
+        {
+            page_unref(vm->pages[p]);
+        }
+        vm->pages[p] = &zero_page;
+        vm->writable[p] = NULL;
+    }
+}
+
+void mem_log_write(struct lc3_vm* vm, uint16_t address, uint16_t val)
+{
+    uint16_t old_val = mem_peek(vm, address);
+    if(vm->trace.level == TRACE_DELTA)
+    {
+        trace_write(vm, address, old_val, val);
+    }
+    if(vm->undo)
+    {
+        undo_write(vm, address, old_val);
+    }
+}
+
+void code_invalidate(struct lc3_vm* vm, uint16_t address)
+{
+    if(vm->code_map[address] & CODE_DECODED)
+    {
+        vm->decoded[address].handler = H_DECODE; // decode again on the next execution
+    }
+    if(vm->code_map[address] & CODE_BLOCK)
+    {
+        block_invalidate(vm, address);
+    }
+    if(vm->code_map[address] & CODE_WATCH)
+    {
+        debug_hit(vm, DEBUG_WATCH, address);
+    }
+    vm->code_map[address] &= CODE_DEBUG;
+}
+
+
+/*
+*   Dumps every register and every non-zero memory word.
+*   This walks all 65536 words, so it is only meant for one-off debugging;
+*   per-instruction tracing is done by the trace subsystem above.
+*/
+void print_state(struct lc3_vm* vm)
+{
+    uint16_t* reg = vm->reg;
+    printf("Registers:\n");
+    for (int i = 0; i < R_COUNT; i++)
+    {
+        printf("R%d: 0x%04X\n", i, reg[i]);
+    }
+    printf("Memory:\n");
+    for (int i = 0; i < MEMORY_MAX; i++)
+    {
+        if (mem_peek(vm, i) != 0)
+        {
+            printf("0x%04X: 0x%04X\n", i, mem_peek(vm, i));
+        }
+    }
+    printf("\n");
+}
@@ -0,0 +1,87 @@
+/*      LC-3 Simulator - memory access
+*       mem_read()/mem_write() are inline so every core gets the RAM fast path without a call;
+*       only device page accesses, logged writes, writes over cached code and the first write
+*       to a shared page leave it.
+*/
+#ifndef LC3_MEMORY_H
+#define LC3_MEMORY_H
+
+#include <stdint.h>
+
+#include "lc3.h"
+#include "vm.h"
+#include "debug.h"
+
+void code_invalidate(struct lc3_vm* vm, uint16_t address); // drop cached copies of a word that was written
+void mem_log_write(struct lc3_vm* vm, uint16_t address, uint16_t val); // tell the delta trace and the undo log, before the write
+uint16_t* page_unshare(struct lc3_vm* vm, int page); // give vm its own copy of a shared page, returns its words
+void pages_release(struct lc3_vm* vm); // drop every page, memory reads as zero afterwards
+void page_ref(struct lc3_page* page);
+void page_unref(struct lc3_page* page);
+extern struct lc3_page zero_page; // shared by all fresh memory, never written or freed
+
+static inline uint16_t mem_peek(const struct lc3_vm* vm, uint16_t address) // plain memory, devices are not consulted
+{
+    return vm->pages[address >> PAGE_SHIFT]->words[address & (PAGE_WORDS - 1)];
+}
+
+static inline void mem_poke(struct lc3_vm* vm, uint16_t address, uint16_t val) // plain memory, caches are not told
+{
+    uint16_t* words = vm->writable[address >> PAGE_SHIFT];
+    if(!words)
+    {
+        words = page_unshare(vm, address >> PAGE_SHIFT); // first write since the page was shared
+    }
+    words[address & (PAGE_WORDS - 1)] = val;
+}
+
+static inline void mem_write(struct lc3_vm* vm, uint16_t address, uint16_t val) // write the value to the memory location
+{
+    if(vm->log_writes)
+    {
+        mem_log_write(vm, address, val); // record the change for the delta trace or the undo log
+    }
+    if(address >= MMIO_BASE)
+    {
+        mmio_write(vm, address, val); // device page, never holds cached code
+        return;
+    }
+    mem_poke(vm, address, val); // write the value to the memory location
+    if(vm->code_map[address])
+    {
+        code_invalidate(vm, address); // the word was decoded or translated, that copy is stale now (or is watched)
+    }
+}
+
+static inline uint16_t mem_read(struct lc3_vm* vm, uint16_t address) // read the value from the memory location
+{
+    if(address >= MMIO_BASE) // one check for the whole device page
+    {
+        return mmio_read(vm, address);
+    }
+    if(vm->debug && (vm->code_map[address] & CODE_RWATCH))
+    {
+        debug_hit(vm, DEBUG_RWATCH, address); // read watchpoints keep the VM on the switch core, which reads through here
+    }
+    return mem_peek(vm, address); // return the value from the memory location
+}
+
+/*
+*   mem_read() for the fast cores, which settle vm->instret once per run (threaded) or per
+*   block (block). pending is what vm->instret is short of the instructions retired before
+*   the current one; it wraps around when a core charged ahead. Devices, and the input
+*   replay behind them, always see the same count as on the switch core.
+*/
+static inline uint16_t mem_read_sync(struct lc3_vm* vm, uint16_t address, uint64_t pending)
+{
+    if(address >= MMIO_BASE)
+    {
+        vm->instret += pending;
+        uint16_t v = mmio_read(vm, address);
+        vm->instret -= pending;
+        return v;
+    }
+    return mem_peek(vm, address);
+}
+
+#endif
@@ -0,0 +1,203 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "lc3.h"
+#include "vm.h"
+#include "memory.h"
+#include "mmio.h"
+#include "system.h"
+#include "platform.h"
+
+void mmio_register(struct lc3_vm* vm, uint16_t address, mmio_read_fn read, mmio_write_fn write)
+{
+    vm->mmio[address - MMIO_BASE].read = read;
+    vm->mmio[address - MMIO_BASE].write = write;
+}
+
+uint16_t mmio_read(struct lc3_vm* vm, uint16_t address)
+{
+    if(address != MR_KBSR)
+    {
+        vm->idle_spins = 0; // doing something besides waiting for a key
+    }
+    vm->stats.device_reads++;
+    struct mmio_device* dev = &vm->mmio[address - MMIO_BASE];
+    return dev->read ? dev->read(vm, address) : mem_peek(vm, address);
+}
+
+void mmio_write(struct lc3_vm* vm, uint16_t address, uint16_t val)
+{
+    vm->idle_spins = 0;
+    vm->stats.device_writes++;
+    struct mmio_device* dev = &vm->mmio[address - MMIO_BASE];
+    if(dev->write)
+    {
+        dev->write(vm, address, val);
+    }
+    else
+    {
+        mem_poke(vm, address, val);
+    }
+}
+
+// @@diff : {Idle Loops}
+static int idle_loop(struct lc3_vm* vm) // a KBSR read without a key: is the program doing nothing else?
+{
+    uint64_t gap = vm->instret - vm->idle_instret;
+    vm->idle_instret = vm->instret;
+    if(gap == 0 || gap > IDLE_MAX_GAP || gap != vm->idle_gap)
+    {
+        vm->idle_gap = gap;
+        vm->idle_spins = 0;
+        return 0;
+    }
+    if(vm->idle_spins < IDLE_SPINS)
+    {
+        vm->idle_spins++;
+    }
+    return vm->idle_spins == IDLE_SPINS;
+}
+
+static void idle_wait(struct lc3_vm* vm)
+{
+    uint64_t timeout = IDLE_WAIT_MS;
+    if(vm->deadline_ms)
+    {
+        uint64_t now = time_ms();
+        if(now >= vm->deadline_ms)
+        {
+            return; // vm_run() is about to give up anyway
+        }
+        if(vm->deadline_ms - now < timeout)
+        {
+            timeout = vm->deadline_ms - now;
+        }
+    }
+    if(vm->system.enabled && (mem_peek(vm, MR_TMR) & DEVICE_IE) && mem_peek(vm, MR_TMI) && mem_peek(vm, MR_TMI) < timeout)
+    {
+        timeout = mem_peek(vm, MR_TMI); // the timer interrupt must not wait for a key
+    }
+    uint64_t start = time_ns();
+    vm->io.wait(vm->io.ctx, (int)timeout);
+    vm->stats.input_wait_ns += time_ns() - start;
+}
+
+static uint16_t kbsr_read(struct lc3_vm* vm, uint16_t address)
+{
+    uint16_t kbsr = mem_peek(vm, MR_KBSR);
+    if(!(kbsr & DEVICE_READY) && vm->io.wait && idle_loop(vm))
+    {
+        idle_wait(vm);
+    }
+    if(!(kbsr & DEVICE_READY) && vm->io.poll(vm->io.ctx)) // a key is waiting and the last one was consumed
+    {
+        mem_poke(vm, MR_KBDR, (uint16_t)vm->io.getc(vm->io.ctx)); // get the character from the keyboard
+        mem_poke(vm, MR_KBSR, kbsr | DEVICE_READY); // ready until KBDR is read
+        vm->stats.input_bytes++;
+    }
+    return mem_peek(vm, MR_KBSR);
+}
+
+static void kbsr_write(struct lc3_vm* vm, uint16_t address, uint16_t val)
+{
+    mem_poke(vm, MR_KBSR, (mem_peek(vm, MR_KBSR) & DEVICE_READY) | (val & DEVICE_IE)); // only the interrupt enable is writable
+}
+
+static uint16_t kbdr_read(struct lc3_vm* vm, uint16_t address)
+{
+    mem_poke(vm, MR_KBSR, mem_peek(vm, MR_KBSR) & DEVICE_IE); // the character has been taken
+    return mem_peek(vm, MR_KBDR);
+}
+
+static uint16_t dsr_read(struct lc3_vm* vm, uint16_t address)
+{
+    return 0x8000; // the display is always ready
+}
+
+static void ddr_write(struct lc3_vm* vm, uint16_t address, uint16_t val)
+{
+    vm->io.putc(vm->io.ctx, (char)val);
+    vm->stats.output_bytes++;
+}
+
+static uint64_t vm_clock(struct lc3_vm* vm)
+{
+    return vm->io.clock ? vm->io.clock(vm->io.ctx) : time_ms();
+}
+
+static void timer_tick(struct lc3_vm* vm) // latch TMR bit 15 once TMI milliseconds have passed
+{
+    uint64_t now = vm_clock(vm);
+    uint16_t interval = mem_peek(vm, MR_TMI);
+    if(interval && now - vm->timer_last_ms >= interval)
+    {
+        vm->timer_last_ms = now;
+        mem_poke(vm, MR_TMR, mem_peek(vm, MR_TMR) | DEVICE_READY);
+    }
+}
+
+static uint16_t tmr_read(struct lc3_vm* vm, uint16_t address)
+{
+    timer_tick(vm);
+    uint16_t tmr = mem_peek(vm, MR_TMR);
+    mem_poke(vm, MR_TMR, tmr & DEVICE_IE); // reading takes the tick
+    return tmr;
+}
+
+static void tmr_write(struct lc3_vm* vm, uint16_t address, uint16_t val)
+{
+    mem_poke(vm, MR_TMR, (mem_peek(vm, MR_TMR) & DEVICE_READY) | (val & DEVICE_IE));
+}
+
+static void tmi_write(struct lc3_vm* vm, uint16_t address, uint16_t val)
+{
+    mem_poke(vm, MR_TMI, val); // interval in milliseconds, 0 disables the timer
+    vm->timer_last_ms = vm_clock(vm);
+}
+
+static void mcr_write(struct lc3_vm* vm, uint16_t address, uint16_t val)
+{
+    mem_poke(vm, MR_MCR, val);
+    if(!(val & 0x8000))
+    {
+        vm->running = 0; // clock enable bit cleared: halt
+    }
+}
+
+static uint16_t psr_read(struct lc3_vm* vm, uint16_t address)
+{
+    return system_psr(vm);
+}
+
+static void psr_write(struct lc3_vm* vm, uint16_t address, uint16_t val)
+{
+    system_set_psr(vm, val);
+}
+
+void mmio_sample(struct lc3_vm* vm)
+{
+    if((mem_peek(vm, MR_KBSR) & (DEVICE_READY | DEVICE_IE)) == DEVICE_IE)
+    {
+        kbsr_read(vm, MR_KBSR);
+    }
+    if(mem_peek(vm, MR_TMR) & DEVICE_IE)
+    {
+        timer_tick(vm);
+    }
+}
+
+void mmio_init(struct lc3_vm* vm)
+{
+    memset(vm->mmio, 0, sizeof(vm->mmio));
+    mmio_register(vm, MR_KBSR, kbsr_read, kbsr_write);
+    mmio_register(vm, MR_KBDR, kbdr_read, NULL);
+    mmio_register(vm, MR_DSR, dsr_read, NULL);
+    mmio_register(vm, MR_DDR, NULL, ddr_write);
+    mmio_register(vm, MR_TMR, tmr_read, tmr_write);
+    mmio_register(vm, MR_TMI, NULL, tmi_write);
+    mmio_register(vm, MR_PSR, psr_read, psr_write);
+    mmio_register(vm, MR_MCR, NULL, mcr_write);
+    mem_poke(vm, MR_KBSR, 0);
+    mem_poke(vm, MR_TMR, 0);
+    mem_poke(vm, MR_MCR, 0x8000); // the clock is running
+}
@@ -0,0 +1,56 @@
+/*      LC-3 Simulator - memory-mapped devices
+*/
+#ifndef LC3_MMIO_H
+#define LC3_MMIO_H
+
+#include <stdint.h>
+
+#include "lc3.h"
+
+// @@diff : {Memory Mapped I/O}
+/*
+*   Everything from MMIO_BASE (0xFE00) up is the device page. Loads and stores there go
+*   through a table of read/write callbacks instead of plain memory; ordinary RAM accesses
+*   only pay for the single "address >= MMIO_BASE" check in mem_read()/mem_write().
+*   A word in the device page without a registered callback behaves like normal memory.
+*
+*   Devices registered by mmio_init():
+*       - KBSR/KBDR : keyboard status (bit 15 = a key is waiting, bit 14 = interrupt enable) and data
+*       - DSR/DDR   : display status (always ready) and data (writes print a character)
+*       - TMR/TMI   : timer status (bit 15 = TMI milliseconds have passed, cleared by reading;
+*                     bit 14 = interrupt enable) and interval
+*       - PSR       : processor status (privilege, priority, NZP), see system.h
+*       - MCR       : machine control, clearing bit 15 halts the machine
+*/
+typedef uint16_t (*mmio_read_fn)(struct lc3_vm* vm, uint16_t address);
+typedef void (*mmio_write_fn)(struct lc3_vm* vm, uint16_t address, uint16_t val);
+
+struct mmio_device
+{
+    mmio_read_fn read;   // NULL = read memory[address]
+    mmio_write_fn write; // NULL = write memory[address]
+};
+
+/*
+*   Idle loops: a program that waits for a key by reading KBSR in a tight loop and touches no
+*   other device and no TRAP in between (the LDI/BRzp loop of 2048 and rogue) has nothing to do
+*   until a key arrives. After IDLE_SPINS such reads in a row, each the same few instructions
+*   after the last, kbsr_read() blocks in io.wait() for up to IDLE_WAIT_MS (less if a deadline
+*   or a timer interrupt is due sooner) before it polls, so an idle session sleeps in the
+*   kernel instead of spinning. No instruction is skipped: the loop just runs fewer times, as
+*   if the key had come sooner, and vm->instret at every device read is as exact as ever.
+*/
+enum
+{
+    IDLE_MAX_GAP = 16,   // longest loop, in instructions, that counts as a poll loop
+    IDLE_SPINS = 64,     // reads in a row before blocking
+    IDLE_WAIT_MS = 100   // longest single wait, the loop then checks in again
+};
+
+void mmio_register(struct lc3_vm* vm, uint16_t address, mmio_read_fn read, mmio_write_fn write);
+uint16_t mmio_read(struct lc3_vm* vm, uint16_t address); // address must be >= MMIO_BASE
+void mmio_write(struct lc3_vm* vm, uint16_t address, uint16_t val);
+void mmio_init(struct lc3_vm* vm); // register the standard devices
+void mmio_sample(struct lc3_vm* vm); // full-system mode: update the ready bits of devices with interrupts enabled
+
+#endif
@@ -0,0 +1,33 @@
+/*      LC-3 Simulator - platform layer
+*       Raw (unbuffered, no echo) keyboard input, a non-blocking key check, a single-key read
+*       a millisecond clock, read-only file mappings for the image loader, and the threads
+*       and mutexes the batch runner needs. Exactly one of platform_win32.c / platform_posix.c is built,
+*       picked by CMake (WIN32 or not).
+*/
+#ifndef LC3_PLATFORM_H
+#define LC3_PLATFORM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+void disable_input_buffering();
+void restore_input_buffering();
+uint16_t check_key(); // nonzero if a key can be read without blocking
+int read_key(); // blocking read of one key, EOF at end of input
+void wait_key(int timeout_ms); // sleep until check_key() would be nonzero or timeout_ms pass
+uint64_t time_ms(); // monotonic milliseconds
+uint64_t time_ns(); // monotonic nanoseconds, for benchmarks
+
+const void* map_file(const char* path, size_t* size); // read-only mapping of the whole file, NULL if it cannot be opened
+void unmap_file(const void* data, size_t size);
+
+struct platform_mutex; // opaque, so this header does not need <pthread.h> / <Windows.h>
+
+int cpu_count(); // online processors, at least 1
+int run_threads(int count, void (*fn)(void* arg, int index), void* arg); // run fn(arg, 0..count-1) on up to count threads and wait, returns how many started
+struct platform_mutex* mutex_create(); // NULL if out of memory
+void mutex_destroy(struct platform_mutex* m);
+void mutex_lock(struct platform_mutex* m);
+void mutex_unlock(struct platform_mutex* m);
+
+#endif
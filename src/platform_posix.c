@@ -0,0 +1,192 @@
+// @@diff : {Platform: UNIX}
+#define _POSIX_C_SOURCE 200809L // clock_gettime, select
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/select.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <termios.h>
+
+#include "platform.h"
+
+static struct termios original_tio;
+static int original_tio_saved = 0; // stdin may not be a terminal (pipes, files)
+
+void disable_input_buffering()
+{
+    if(tcgetattr(STDIN_FILENO, &original_tio) != 0)
+    {
+        return;
+    }
+    original_tio_saved = 1;
+    struct termios new_tio = original_tio;
+    new_tio.c_lflag &= ~ICANON & ~ECHO;
+    tcsetattr(STDIN_FILENO, TCSANOW, &new_tio);
+}
+
+void restore_input_buffering()
+{
+    if(original_tio_saved)
+    {
+        tcsetattr(STDIN_FILENO, TCSANOW, &original_tio);
+    }
+}
+
+uint16_t check_key()
+{
+    fd_set readfds;
+    FD_ZERO(&readfds);
+    FD_SET(STDIN_FILENO, &readfds);
+
+    struct timeval timeout;
+    timeout.tv_sec = 0;
+    timeout.tv_usec = 0;
+    return select(1, &readfds, NULL, NULL, &timeout) > 0;
+}
+
+void wait_key(int timeout_ms)
+{
+    struct pollfd fd = { STDIN_FILENO, POLLIN, 0 };
+    poll(&fd, 1, timeout_ms); // also wakes up at end of input, which read_key() then reports
+}
+
+int read_key()
+{
+    unsigned char c;
+    return read(STDIN_FILENO, &c, 1) == 1 ? c : EOF; // read() directly, stdin is never touched through stdio
+}
+
+uint64_t time_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+uint64_t time_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+const void* map_file(const char* path, size_t* size)
+{
+    int fd = open(path, O_RDONLY);
+    if(fd < 0)
+    {
+        return NULL;
+    }
+    struct stat st;
+    void* data = NULL;
+    if(fstat(fd, &st) == 0)
+    {
+        *size = (size_t)st.st_size;
+        data = *size == 0 ? (void*)"" : mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0); // mmap() refuses empty files
+        if(data == MAP_FAILED)
+        {
+            data = NULL;
+        }
+    }
+    close(fd); // the mapping keeps the file alive
+    return data;
+}
+
+void unmap_file(const void* data, size_t size)
+{
+    if(data && size)
+    {
+        munmap((void*)data, size);
+    }
+}
+
+int cpu_count()
+{
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+}
+
+struct thread_start
+{
+    void (*fn)(void*, int);
+    void* arg;
+    int index;
+};
+
+static void* thread_main(void* p)
+{
+    struct thread_start* start = p;
+    start->fn(start->arg, start->index);
+    return NULL;
+}
+
+int run_threads(int count, void (*fn)(void* arg, int index), void* arg)
+{
+    pthread_t* threads = malloc(count * sizeof(pthread_t));
+    struct thread_start* starts = malloc(count * sizeof(struct thread_start));
+    if(!threads || !starts)
+    {
+        free(threads);
+        free(starts);
+        return 0;
+    }
+    int started = 0;
+    for(; started < count; started++)
+    {
+        starts[started] = (struct thread_start){ fn, arg, started };
+        if(pthread_create(&threads[started], NULL, thread_main, &starts[started]) != 0)
+        {
+            break;
+        }
+    }
+    for(int i = 0; i < started; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+    free(starts);
+    return started;
+}
+
+struct platform_mutex
+{
+    pthread_mutex_t mutex;
+};
+
+struct platform_mutex* mutex_create()
+{
+    struct platform_mutex* m = malloc(sizeof(struct platform_mutex));
+    if(m && pthread_mutex_init(&m->mutex, NULL) != 0)
+    {
+        free(m);
+        m = NULL;
+    }
+    return m;
+}
+
+void mutex_destroy(struct platform_mutex* m)
+{
+    if(m)
+    {
+        pthread_mutex_destroy(&m->mutex);
+        free(m);
+    }
+}
+
+void mutex_lock(struct platform_mutex* m)
+{
+    pthread_mutex_lock(&m->mutex);
+}
+
+void mutex_unlock(struct platform_mutex* m)
+{
+    pthread_mutex_unlock(&m->mutex);
+}
@@ -0,0 +1,183 @@
+// @@diff : {Platform: Windows}
+#include <stdio.h>
+#include <stdlib.h>
+#include <Windows.h>
+#include <conio.h>  // _kbhit
+
+#include "platform.h"
+
+static HANDLE hStdin = INVALID_HANDLE_VALUE; // get the standard input handle
+static DWORD fdwMode, fdwOldMode; // get the mode of the standard input
+
+void disable_input_buffering()
+{
+    hStdin = GetStdHandle(STD_INPUT_HANDLE); // get the standard input handle
+    GetConsoleMode(hStdin, &fdwOldMode); // get the mode of the standard input
+    
+    fdwMode = fdwOldMode ^ ENABLE_ECHO_INPUT //no input echo 
+                         ^ ENABLE_LINE_INPUT; //return when one or more characters are available.
+    
+    SetConsoleMode(hStdin, fdwMode); // set the mode of the standard input
+    FlushConsoleInputBuffer(hStdin); // flush the input buffer                     
+}
+
+void restore_input_buffering()
+{
+    SetConsoleMode(hStdin, fdwOldMode); // set the mode of the standard input
+}
+
+uint16_t check_key()
+{
+    return _kbhit() != 0; // never blocks
+}
+
+void wait_key(int timeout_ms)
+{
+    WaitForSingleObject(GetStdHandle(STD_INPUT_HANDLE), (DWORD)timeout_ms); // signalled by any console input event
+}
+
+int read_key()
+{
+    return getchar(); // blocks until a key is pressed
+}
+
+uint64_t time_ms()
+{
+    return GetTickCount64();
+}
+
+uint64_t time_ns()
+{
+    static LARGE_INTEGER frequency; // ticks per second, fixed at boot
+    LARGE_INTEGER now;
+    if(!frequency.QuadPart)
+    {
+        QueryPerformanceFrequency(&frequency);
+    }
+    QueryPerformanceCounter(&now);
+    return (uint64_t)(now.QuadPart / frequency.QuadPart) * 1000000000
+        + (uint64_t)(now.QuadPart % frequency.QuadPart) * 1000000000 / frequency.QuadPart;
+}
+
+const void* map_file(const char* path, size_t* size)
+{
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if(file == INVALID_HANDLE_VALUE)
+    {
+        return NULL;
+    }
+    LARGE_INTEGER length;
+    const void* data = NULL;
+    if(GetFileSizeEx(file, &length))
+    {
+        *size = (size_t)length.QuadPart;
+        if(*size == 0)
+        {
+            data = ""; // empty files cannot be mapped
+        }
+        else
+        {
+            HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+            if(mapping)
+            {
+                data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+                CloseHandle(mapping); // the view keeps the mapping alive
+            }
+        }
+    }
+    CloseHandle(file);
+    return data;
+}
+
+void unmap_file(const void* data, size_t size)
+{
+    if(data && size)
+    {
+        UnmapViewOfFile(data);
+    }
+}
+
+int cpu_count()
+{
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? (int)info.dwNumberOfProcessors : 1;
+}
+
+struct thread_start
+{
+    void (*fn)(void*, int);
+    void* arg;
+    int index;
+};
+
+static DWORD WINAPI thread_main(LPVOID p)
+{
+    struct thread_start* start = p;
+    start->fn(start->arg, start->index);
+    return 0;
+}
+
+int run_threads(int count, void (*fn)(void* arg, int index), void* arg)
+{
+    HANDLE* threads = malloc(count * sizeof(HANDLE));
+    struct thread_start* starts = malloc(count * sizeof(struct thread_start));
+    if(!threads || !starts)
+    {
+        free(threads);
+        free(starts);
+        return 0;
+    }
+    int started = 0;
+    for(; started < count; started++)
+    {
+        starts[started] = (struct thread_start){ fn, arg, started };
+        threads[started] = CreateThread(NULL, 0, thread_main, &starts[started], 0, NULL);
+        if(!threads[started])
+        {
+            break;
+        }
+    }
+    for(int i = 0; i < started; i++)
+    {
+        WaitForSingleObject(threads[i], INFINITE);
+        CloseHandle(threads[i]);
+    }
+    free(threads);
+    free(starts);
+    return started;
+}
+
+struct platform_mutex
+{
+    CRITICAL_SECTION section;
+};
+
+struct platform_mutex* mutex_create()
+{
+    struct platform_mutex* m = malloc(sizeof(struct platform_mutex));
+    if(m)
+    {
+        InitializeCriticalSection(&m->section);
+    }
+    return m;
+}
+
+void mutex_destroy(struct platform_mutex* m)
+{
+    if(m)
+    {
+        DeleteCriticalSection(&m->section);
+        free(m);
+    }
+}
+
+void mutex_lock(struct platform_mutex* m)
+{
+    EnterCriticalSection(&m->section);
+}
+
+void mutex_unlock(struct platform_mutex* m)
+{
+    LeaveCriticalSection(&m->section);
+}
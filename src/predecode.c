@@ -0,0 +1,62 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lc3.h"
+#include "vm.h"
+#include "predecode.h"
+
+void decode_instr(uint16_t instr, struct decoded_instr* d)
+{
+    d->dr = INSTR_DR(instr);
+    d->sr1 = INSTR_SR1(instr);
+    d->sr2 = INSTR_SR2(instr);
+    d->imm = INSTR_SEXT(instr, 9); // PC offset 9 is the most common field, others overwrite it
+
+    switch(instr >> 12)
+    {
+        case OP_BR:   d->handler = H_BR; break;
+        case OP_ADD:  d->handler = (instr & 0x20) ? H_ADD_IMM : H_ADD_REG; d->imm = INSTR_SEXT(instr, 5); break;
+        case OP_AND:  d->handler = (instr & 0x20) ? H_AND_IMM : H_AND_REG; d->imm = INSTR_SEXT(instr, 5); break;
+        case OP_NOT:  d->handler = H_NOT; break;
+        case OP_JMP:  d->handler = H_JMP; break;
+        case OP_JSR:  d->handler = (instr & 0x800) ? H_JSR : H_JSRR; d->imm = INSTR_SEXT(instr, 11); break;
+        case OP_LD:   d->handler = H_LD; break;
+        case OP_LDI:  d->handler = H_LDI; break;
+        case OP_LDR:  d->handler = H_LDR; d->imm = INSTR_SEXT(instr, 6); break;
+        case OP_LEA:  d->handler = H_LEA; break;
+        case OP_ST:   d->handler = H_ST; break;
+        case OP_STI:  d->handler = H_STI; break;
+        case OP_STR:  d->handler = H_STR; d->imm = INSTR_SEXT(instr, 6); break;
+        case OP_TRAP: d->handler = H_TRAP; d->imm = instr & 0xFF; break;
+        default:      d->handler = H_BAD; d->imm = instr; break; // the fault depends on the opcode
+    }
+}
+
+int predecode_init(struct lc3_vm* vm)
+{
+    if(!vm->decoded)
+    {
+        vm->decoded = calloc(MEMORY_MAX, sizeof(struct decoded_instr)); // zero filled, so every word starts out as H_DECODE
+    }
+    return vm->decoded != NULL;
+}
+
+void predecode_free(struct lc3_vm* vm)
+{
+    free(vm->decoded);
+    vm->decoded = NULL;
+}
+
+void predecode_flush(struct lc3_vm* vm) // forget every decoded record, used after memory is filled behind mem_write()'s back
+{
+    if(!vm->decoded)
+    {
+        return;
+    }
+    memset(vm->decoded, 0, MEMORY_MAX * sizeof(struct decoded_instr));
+    for(int i = 0; i < MEMORY_MAX; i++)
+    {
+        vm->code_map[i] &= ~CODE_DECODED;
+    }
+}
@@ -0,0 +1,66 @@
+/*      LC-3 Simulator - predecoded instructions
+*/
+#ifndef LC3_PREDECODE_H
+#define LC3_PREDECODE_H
+
+#include <stdint.h>
+
+#include "lc3.h"
+
+// @@diff : {Predecode}
+/*
+*   The threaded core does not decode an instruction every time it runs. A table parallel to
+*   memory[] holds one decoded record per word: which handler to run, the register fields and
+*   the offset already sign extended. Records are built lazily the first time a word is
+*   executed and the word is marked CODE_DECODED in the VM's code map; mem_write() resets the
+*   record of a marked word back to H_DECODE, so self-modifying code is picked up on its next
+*   execution. The table is only allocated once a VM runs on a fast core.
+*
+*   Handlers are finer grained than opcodes (ADD with a register vs. an immediate operand,
+*   JSR vs. JSRR) so the handlers themselves have no decoding left to do.
+*/
+enum
+{
+    H_DECODE = 0, // not decoded yet (or invalidated by a write)
+    H_BR,
+    H_ADD_REG,
+    H_ADD_IMM,
+    H_AND_REG,
+    H_AND_IMM,
+    H_NOT,
+    H_JMP,
+    H_JSR,
+    H_JSRR,
+    H_LD,
+    H_LDI,
+    H_LDR,
+    H_LEA,
+    H_ST,
+    H_STI,
+    H_STR,
+    H_TRAP,
+    H_BAD,        // RTI and the reserved opcode
+    H_BREAK,      // breakpoint (debug.h): stop before the instruction, never made by decode_instr()
+    H_COUNT
+};
+
+#define INSTR_DR(i)   (((i) >> 9) & 0x7) // destination / source register of the store
+#define INSTR_SR1(i)  (((i) >> 6) & 0x7) // first operand / base register
+#define INSTR_SR2(i)  ((i) & 0x7)        // second operand
+#define INSTR_SEXT(i, bits) ((uint16_t)((int16_t)(uint16_t)((i) << (16 - (bits))) >> (16 - (bits)))) // sign extend the low bits
+
+struct decoded_instr
+{
+    uint8_t handler; // H_* value
+    uint8_t dr;      // destination register, source register for stores, nzp mask for BR
+    uint8_t sr1;     // first operand / base register
+    uint8_t sr2;     // second operand
+    uint16_t imm;    // sign extended immediate or offset, trap vector for TRAP, the instruction for H_BAD
+};
+
+void decode_instr(uint16_t instr, struct decoded_instr* d);
+int predecode_init(struct lc3_vm* vm); // allocate the table on first use (zero filled: all H_DECODE), 0 if out of memory
+void predecode_free(struct lc3_vm* vm);
+void predecode_flush(struct lc3_vm* vm); // forget every decoded record, used after memory is filled behind mem_write()'s back
+
+#endif
@@ -0,0 +1,306 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lc3.h"
+#include "vm.h"
+#include "memory.h"
+#include "profile.h"
+
+static const char* op_names[16] =
+{
+    "BR", "ADD", "LD", "ST", "JSR", "AND", "LDR", "STR",
+    "RTI", "NOT", "LDI", "STI", "JMP", "RES", "LEA", "TRAP"
+};
+
+static const char* trap_name(int vector)
+{
+    static const char* names[] = { "GETC", "OUT", "PUTS", "IN", "PUTSP", "HALT" };
+    return vector >= TRAP_GETC && vector <= TRAP_HALT ? names[vector - TRAP_GETC] : "";
+}
+
+static int add_node(struct lc3_profile* p, int parent, uint16_t entry)
+{
+    if(p->node_count == PROFILE_MAX_NODES)
+    {
+        return -1;
+    }
+    if((p->node_count & (p->node_count - 1)) == 0) // grows at every power of two
+    {
+        int capacity = p->node_count ? p->node_count * 2 : 256;
+        struct profile_node* nodes = realloc(p->nodes, capacity * sizeof(struct profile_node));
+        if(!nodes)
+        {
+            return -1;
+        }
+        p->nodes = nodes;
+    }
+    int index = p->node_count++;
+    struct profile_node* n = &p->nodes[index];
+    memset(n, 0, sizeof(*n));
+    n->entry = entry;
+    n->parent = parent;
+    n->child = -1;
+    n->sibling = -1;
+    if(parent >= 0)
+    {
+        n->depth = p->nodes[parent].depth + 1;
+        n->sibling = p->nodes[parent].child;
+        p->nodes[parent].child = index;
+    }
+    return index;
+}
+
+int profile_open(struct lc3_vm* vm)
+{
+    struct lc3_profile* p = calloc(1, sizeof(struct lc3_profile));
+    if(!p)
+    {
+        return 0;
+    }
+    if(add_node(p, -1, vm->reg[R_PC]) < 0) // the root: whatever runs before the first call
+    {
+        free(p);
+        return 0;
+    }
+    profile_close(vm);
+    p->mark = vm->instret;
+    vm->profile = p;
+    return 1;
+}
+
+void profile_close(struct lc3_vm* vm)
+{
+    if(vm->profile)
+    {
+        free(vm->profile->nodes);
+        free(vm->profile);
+        vm->profile = NULL;
+    }
+}
+
+// @@diff : {Call Tracking}
+static void charge(struct lc3_vm* vm, struct lc3_profile* p) // the node being left ran everything since the mark, the JSR/RET included
+{
+    p->nodes[p->current].self += vm->instret + 1 - p->mark; // step_switch() counts the instruction after its hooks
+    p->mark = vm->instret + 1;
+}
+
+void profile_call(struct lc3_vm* vm, uint16_t target)
+{
+    struct lc3_profile* p = vm->profile;
+    struct profile_node* cur = &p->nodes[p->current];
+    if(p->overflow || cur->depth + 1 >= PROFILE_MAX_DEPTH)
+    {
+        p->overflow++; // the matching RET only has to undo this
+        return;
+    }
+    charge(vm, p);
+    int child = cur->child;
+    while(child >= 0 && p->nodes[child].entry != target)
+    {
+        child = p->nodes[child].sibling;
+    }
+    if(child < 0 && (child = add_node(p, p->current, target)) < 0)
+    {
+        p->overflow++;
+        return;
+    }
+    p->nodes[child].calls++;
+    p->current = child;
+}
+
+void profile_return(struct lc3_vm* vm)
+{
+    struct lc3_profile* p = vm->profile;
+    if(p->overflow)
+    {
+        p->overflow--;
+    }
+    else if(p->nodes[p->current].parent >= 0) // a RET out of the root is a jump through R7, stay put
+    {
+        charge(vm, p);
+        p->current = p->nodes[p->current].parent;
+    }
+}
+
+uint64_t profile_self(const struct lc3_vm* vm, int node)
+{
+    const struct lc3_profile* p = vm->profile;
+    return p->nodes[node].self + (node == p->current ? vm->instret - p->mark : 0);
+}
+
+// @@diff : {Profile Report}
+struct profile_row
+{
+    uint16_t key;     // PC or subroutine entry
+    uint64_t count;   // the sort key
+    uint64_t total;
+    uint64_t calls;
+};
+
+static int by_count(const void* a, const void* b)
+{
+    const struct profile_row* x = a;
+    const struct profile_row* y = b;
+    if(x->count != y->count)
+    {
+        return x->count < y->count ? 1 : -1;
+    }
+    return x->key < y->key ? -1 : x->key > y->key;
+}
+
+static double percent(uint64_t n, uint64_t of)
+{
+    return of ? 100.0 * (double)n / (double)of : 0.0;
+}
+
+static void subtree_totals(const struct lc3_vm* vm, uint64_t* totals)
+{
+    const struct lc3_profile* p = vm->profile;
+    for(int i = 0; i < p->node_count; i++)
+    {
+        totals[i] = profile_self(vm, i);
+    }
+    for(int i = p->node_count - 1; i > 0; i--) // children always come after their parents
+    {
+        totals[p->nodes[i].parent] += totals[i];
+    }
+}
+
+static int recursive_call(const struct lc3_profile* p, int node) // an outer call of the same subroutine already counts this one
+{
+    for(int up = p->nodes[node].parent; up >= 0; up = p->nodes[up].parent)
+    {
+        if(p->nodes[up].entry == p->nodes[node].entry)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void profile_report(const struct lc3_vm* vm, FILE* out, int top)
+{
+    const struct lc3_profile* p = vm->profile;
+    if(!p)
+    {
+        return;
+    }
+    uint64_t total = 0;
+    for(int op = 0; op < 16; op++)
+    {
+        total += p->op_count[op];
+    }
+    struct profile_row* rows = malloc(MEMORY_MAX * sizeof(struct profile_row));
+    uint64_t* totals = malloc(p->node_count * sizeof(uint64_t));
+    if(!rows || !totals)
+    {
+        fprintf(out, "profile: out of memory\n");
+        free(rows);
+        free(totals);
+        return;
+    }
+    fprintf(out, "profile: %llu instructions\n", (unsigned long long)total);
+
+    int n = 0;
+    for(int pc = 0; pc < MEMORY_MAX; pc++)
+    {
+        if(p->pc_count[pc])
+        {
+            rows[n].key = (uint16_t)pc;
+            rows[n++].count = p->pc_count[pc];
+        }
+    }
+    qsort(rows, n, sizeof(rows[0]), by_count);
+    fprintf(out, "\nhot spots\n      pc    instr         count       %%\n");
+    for(int i = 0; i < n && i < top; i++)
+    {
+        fprintf(out, "  x%04X    x%04X  %12llu  %5.1f%%\n", rows[i].key, mem_peek(vm, rows[i].key),
+            (unsigned long long)rows[i].count, percent(rows[i].count, total));
+    }
+
+    fprintf(out, "\nopcodes\n");
+    for(int op = 0; op < 16; op++)
+    {
+        if(p->op_count[op])
+        {
+            fprintf(out, "  %-5s  %12llu  %5.1f%%\n", op_names[op], (unsigned long long)p->op_count[op], percent(p->op_count[op], total));
+        }
+    }
+
+    fprintf(out, "\ntraps\n");
+    for(int v = 0; v < 256; v++)
+    {
+        if(p->trap_count[v])
+        {
+            fprintf(out, "  x%02X %-5s  %12llu\n", v, trap_name(v), (unsigned long long)p->trap_count[v]);
+        }
+    }
+
+    subtree_totals(vm, totals); // then fold the call paths into one row per entry address
+    memset(rows, 0, MEMORY_MAX * sizeof(struct profile_row));
+    for(int i = 0; i < p->node_count; i++)
+    {
+        struct profile_row* row = &rows[p->nodes[i].entry];
+        row->key = p->nodes[i].entry;
+        row->count += profile_self(vm, i);
+        row->calls += p->nodes[i].calls;
+        if(!recursive_call(p, i))
+        {
+            row->total += totals[i];
+        }
+    }
+    n = 0;
+    for(int entry = 0; entry < MEMORY_MAX; entry++) // only the addresses that were called
+    {
+        if(rows[entry].count || rows[entry].total)
+        {
+            rows[n++] = rows[entry];
+        }
+    }
+    qsort(rows, n, sizeof(rows[0]), by_count);
+    fprintf(out, "\nsubroutines (x%04X is the code outside any call)\n   entry       calls          self       %%         total       %%\n", p->nodes[0].entry);
+    for(int i = 0; i < n && i < top; i++)
+    {
+        fprintf(out, "  x%04X  %10llu  %12llu  %5.1f%%  %12llu  %5.1f%%\n", rows[i].key, (unsigned long long)rows[i].calls,
+            (unsigned long long)rows[i].count, percent(rows[i].count, total), (unsigned long long)rows[i].total, percent(rows[i].total, total));
+    }
+    free(rows);
+    free(totals);
+}
+
+int profile_write_folded(const struct lc3_vm* vm, const char* path)
+{
+    const struct lc3_profile* p = vm->profile;
+    FILE* file = fopen(path, "w");
+    if(!p || !file)
+    {
+        if(file)
+        {
+            fclose(file);
+        }
+        return 0;
+    }
+    int path_nodes[PROFILE_MAX_DEPTH];
+    for(int i = 0; i < p->node_count; i++)
+    {
+        uint64_t self = profile_self(vm, i);
+        if(!self)
+        {
+            continue;
+        }
+        int depth = 0;
+        for(int up = i; up >= 0; up = p->nodes[up].parent)
+        {
+            path_nodes[depth++] = up;
+        }
+        while(depth--)
+        {
+            fprintf(file, "x%04X%c", p->nodes[path_nodes[depth]].entry, depth ? ';' : ' ');
+        }
+        fprintf(file, "%llu\n", (unsigned long long)self);
+    }
+    return fclose(file) == 0;
+}
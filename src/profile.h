@@ -0,0 +1,66 @@
+/*      LC-3 Simulator - profiler
+*/
+#ifndef LC3_PROFILE_H
+#define LC3_PROFILE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "lc3.h"
+
+// @@diff : {Profiler}
+/*
+*   --profile counts every instruction the switch and threaded cores run (the block core hands
+*   profiled runs to the threaded one): per PC and per opcode in flat arrays, and per trap vector. Calls are followed on a shadow call stack kept as a trie of
+*   call paths (a JSR/JSRR enters a child node keyed by the target address, RET leaves it),
+*   and every instruction is charged to the node it ran in. The counts are exact, not sampled:
+*   two increments per instruction, and nodes are charged from vm->instret at calls and returns.
+*
+*   At exit profile_report() prints the hot spots (PCs, opcodes, traps and subroutines by self
+*   and inclusive count) and profile_write_folded() writes one "x3000;x3120;x3200 count" line per
+*   call path, the folded-stacks format flamegraph tools read.
+*/
+enum
+{
+    PROFILE_MAX_NODES = 1 << 16, // distinct call paths; calls beyond that are charged to the caller
+    PROFILE_MAX_DEPTH = 256      // deeper recursion is charged to the deepest node
+};
+
+struct profile_node
+{
+    uint16_t entry;   // address the subroutine was called at, PC_START-ish for the root
+    uint16_t depth;
+    int parent;       // node indices, -1 = none
+    int child;
+    int sibling;
+    uint64_t calls;
+    uint64_t self;    // instructions run in this node, callees not included (see profile_self())
+};
+
+struct lc3_profile
+{
+    uint64_t pc_count[MEMORY_MAX];
+    uint64_t op_count[16];
+    uint64_t trap_count[256];
+    struct profile_node* nodes;
+    int node_count;
+    int current;      // node the machine is running in
+    int overflow;     // calls taken past PROFILE_MAX_NODES / PROFILE_MAX_DEPTH, not yet returned
+    uint64_t mark;    // vm->instret up to which nodes have been charged
+};
+
+int profile_open(struct lc3_vm* vm); // start counting from the current PC, 0 if out of memory
+void profile_close(struct lc3_vm* vm);
+void profile_call(struct lc3_vm* vm, uint16_t target); // after JSR/JSRR
+void profile_return(struct lc3_vm* vm); // after RET
+uint64_t profile_self(const struct lc3_vm* vm, int node); // self count including what the current node has run since the last call/return
+void profile_report(const struct lc3_vm* vm, FILE* out, int top); // hot spot tables, top rows each
+int profile_write_folded(const struct lc3_vm* vm, const char* path); // 0 if the file cannot be written
+
+static inline void profile_count(struct lc3_profile* p, uint16_t pc, uint16_t instr) // once per instruction
+{
+    p->pc_count[pc]++;
+    p->op_count[instr >> 12]++;
+}
+
+#endif
@@ -0,0 +1,389 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+
+#include "lc3.h"
+#include "vm.h"
+#include "replay.h"
+#include "platform.h"
+
+struct replay_event
+{
+    uint8_t kind;           // REPLAY_*
+    uint8_t key;
+    uint64_t instret;
+    uint64_t value;         // clock reading, output hash for REPLAY_END
+};
+
+struct lc3_replay
+{
+    struct lc3_vm* vm;
+    struct lc3_io inner;    // the VM's own callbacks, given back by replay_close()
+    FILE* file;             // recording
+    struct replay_event* events; // replaying, ends with REPLAY_END
+    uint64_t count;
+    uint64_t next;          // events consumed
+    uint64_t last_instret;  // instret of the previous record
+    uint64_t last_clock;
+    uint64_t hash;          // FNV-1a of everything the program printed
+    int diverged;
+    char message[160];
+};
+
+static void put_varint(FILE* file, uint64_t v)
+{
+    while(v >= 0x80)
+    {
+        fputc((int)(v & 0x7F) | 0x80, file);
+        v >>= 7;
+    }
+    fputc((int)v, file);
+}
+
+static int get_varint(const uint8_t* data, size_t size, size_t* at, uint64_t* v)
+{
+    *v = 0;
+    for(int shift = 0; shift < 64 && *at < size; shift += 7)
+    {
+        uint8_t b = data[(*at)++];
+        *v |= (uint64_t)(b & 0x7F) << shift;
+        if(!(b & 0x80))
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void put_record(struct lc3_replay* r, int kind)
+{
+    fputc(kind, r->file);
+    put_varint(r->file, r->vm->instret - r->last_instret);
+    r->last_instret = r->vm->instret;
+    r->count++;
+}
+
+static void hash_byte(struct lc3_replay* r, char c)
+{
+    r->hash = (r->hash ^ (unsigned char)c) * 1099511628211ULL; // FNV-1a, 64 bit
+}
+
+// @@diff : {Record}
+static int record_getc(void* ctx)
+{
+    struct lc3_replay* r = ctx;
+    int c = r->inner.getc(r->inner.ctx);
+    put_record(r, c == EOF ? REPLAY_EOF : REPLAY_KEY);
+    if(c != EOF)
+    {
+        fputc(c & 0xFF, r->file);
+    }
+    return c;
+}
+
+static int record_poll(void* ctx)
+{
+    struct lc3_replay* r = ctx;
+    int ready = r->inner.poll(r->inner.ctx);
+    if(ready)
+    {
+        put_record(r, REPLAY_READY); // "no key yet" is what the replay assumes everywhere else
+    }
+    return ready;
+}
+
+static uint64_t record_clock(void* ctx)
+{
+    struct lc3_replay* r = ctx;
+    uint64_t now = r->inner.clock ? r->inner.clock(r->inner.ctx) : time_ms();
+    if(now < r->last_clock)
+    {
+        now = r->last_clock; // the log only holds forward steps
+    }
+    put_record(r, REPLAY_CLOCK);
+    put_varint(r->file, now - r->last_clock);
+    r->last_clock = now;
+    return now;
+}
+
+static void record_wait(void* ctx, int timeout_ms)
+{
+    struct lc3_replay* r = ctx;
+    r->inner.wait(r->inner.ctx, timeout_ms); // nothing to log, the poll() after it is what counts
+}
+
+static void replay_putc(void* ctx, char c)
+{
+    struct lc3_replay* r = ctx;
+    hash_byte(r, c);
+    r->inner.putc(r->inner.ctx, c);
+}
+
+static void replay_flush(void* ctx)
+{
+    struct lc3_replay* r = ctx;
+    if(r->inner.flush)
+    {
+        r->inner.flush(r->inner.ctx);
+    }
+}
+
+struct lc3_replay* replay_record(struct lc3_vm* vm, const char* path)
+{
+    struct lc3_replay* r = calloc(1, sizeof(struct lc3_replay));
+    if(!r)
+    {
+        return NULL;
+    }
+    r->file = fopen(path, "wb");
+    if(!r->file)
+    {
+        free(r);
+        return NULL;
+    }
+    fwrite("LC3R", 1, 4, r->file);
+    fputc(REPLAY_VERSION & 0xFF, r->file);
+    fputc(REPLAY_VERSION >> 8, r->file);
+    r->vm = vm;
+    r->inner = vm->io;
+    r->hash = 14695981039346656037ULL;
+    const struct lc3_io io = { r, record_getc, record_poll, replay_putc, replay_flush, record_clock, r->inner.in_prompt, r->inner.wait ? record_wait : NULL };
+    vm_set_io(vm, &io);
+    return r;
+}
+
+// @@diff : {Replay}
+static void diverge(struct lc3_replay* r, const char* message, ...)
+{
+    if(!r->diverged)
+    {
+        va_list args;
+        va_start(args, message);
+        int n = snprintf(r->message, sizeof(r->message), "replay diverged at instruction %llu: ", (unsigned long long)r->vm->instret);
+        vsnprintf(r->message + n, sizeof(r->message) - n, message, args);
+        va_end(args);
+        r->diverged = 1;
+    }
+    r->vm->running = 0; // whatever the program does from here is not what was recorded
+}
+
+static const struct replay_event* expect(struct lc3_replay* r, int kind, const char* what)
+{
+    const struct replay_event* e = &r->events[r->next];
+    if(e->kind != kind || e->instret != r->vm->instret)
+    {
+        diverge(r, "%s, but the log has %s at instruction %llu", what,
+            e->kind == REPLAY_END ? "the end of the recording" : "other input", (unsigned long long)e->instret);
+        return NULL;
+    }
+    r->next++;
+    return e;
+}
+
+static int replay_getc(void* ctx)
+{
+    struct lc3_replay* r = ctx;
+    const struct replay_event* e = &r->events[r->next];
+    if(e->kind == REPLAY_EOF && e->instret == r->vm->instret)
+    {
+        r->next++;
+        return EOF;
+    }
+    e = expect(r, REPLAY_KEY, "the program reads a key");
+    return e ? e->key : EOF;
+}
+
+static int replay_poll(void* ctx)
+{
+    struct lc3_replay* r = ctx;
+    const struct replay_event* e = &r->events[r->next];
+    if(e->instret < r->vm->instret)
+    {
+        diverge(r, "the program went past input recorded at instruction %llu", (unsigned long long)e->instret);
+        return 0;
+    }
+    if(e->kind == REPLAY_READY && e->instret == r->vm->instret)
+    {
+        r->next++;
+        return 1;
+    }
+    return 0;
+}
+
+static uint64_t replay_clock(void* ctx)
+{
+    struct lc3_replay* r = ctx;
+    const struct replay_event* e = &r->events[r->next];
+    if(e->kind != REPLAY_CLOCK) // timer writes (TMI) read the clock too, so readings are matched by order alone
+    {
+        diverge(r, "the program reads the timer, but the log has %s", e->kind == REPLAY_END ? "the end of the recording" : "other input");
+        return r->last_clock;
+    }
+    r->next++;
+    r->last_clock = e->value;
+    return e->value;
+}
+
+static int load_events(struct lc3_replay* r, const uint8_t* data, size_t size)
+{
+    if(size < 6 || memcmp(data, "LC3R", 4) != 0)
+    {
+        snprintf(r->message, sizeof(r->message), "not a replay log");
+        return 0;
+    }
+    if((data[4] | data[5] << 8) != REPLAY_VERSION)
+    {
+        snprintf(r->message, sizeof(r->message), "unsupported replay log version %u", data[4] | data[5] << 8);
+        return 0;
+    }
+    size_t at = 6;
+    uint64_t capacity = 0, instret = 0, clock = 0;
+    for(;;)
+    {
+        if(r->count == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 256;
+            struct replay_event* events = realloc(r->events, capacity * sizeof(struct replay_event));
+            if(!events)
+            {
+                snprintf(r->message, sizeof(r->message), "out of memory");
+                return 0;
+            }
+            r->events = events;
+        }
+        struct replay_event* e = &r->events[r->count];
+        memset(e, 0, sizeof(*e));
+        uint64_t delta = 0;
+        if(at >= size || (e->kind = data[at++]) > REPLAY_CLOCK || !get_varint(data, size, &at, &delta))
+        {
+            snprintf(r->message, sizeof(r->message), "bad or truncated record %llu", (unsigned long long)r->count);
+            return 0;
+        }
+        instret += delta;
+        e->instret = instret;
+        r->count++;
+        if(e->kind == REPLAY_KEY)
+        {
+            if(at >= size)
+            {
+                snprintf(r->message, sizeof(r->message), "truncated key record %llu", (unsigned long long)(r->count - 1));
+                return 0;
+            }
+            e->key = data[at++];
+        }
+        else if(e->kind == REPLAY_CLOCK)
+        {
+            if(!get_varint(data, size, &at, &delta))
+            {
+                snprintf(r->message, sizeof(r->message), "truncated clock record %llu", (unsigned long long)(r->count - 1));
+                return 0;
+            }
+            clock += delta;
+            e->value = clock;
+        }
+        else if(e->kind == REPLAY_END)
+        {
+            if(size - at != 8)
+            {
+                snprintf(r->message, sizeof(r->message), "bad end record");
+                return 0;
+            }
+            for(int i = 7; i >= 0; i--)
+            {
+                e->value = e->value << 8 | data[at + i];
+            }
+            return 1;
+        }
+    }
+}
+
+struct lc3_replay* replay_open(struct lc3_vm* vm, const char* path, struct replay_report* report)
+{
+    memset(report, 0, sizeof(*report));
+    struct lc3_replay* r = calloc(1, sizeof(struct lc3_replay));
+    if(!r)
+    {
+        snprintf(report->message, sizeof(report->message), "out of memory");
+        return NULL;
+    }
+    size_t size = 0;
+    const uint8_t* data = map_file(path, &size);
+    if(!data)
+    {
+        snprintf(r->message, sizeof(r->message), "cannot open");
+    }
+    int ok = data && load_events(r, data, size);
+    unmap_file(data, size);
+    if(!ok)
+    {
+        memcpy(report->message, r->message, sizeof(report->message));
+        free(r->events);
+        free(r);
+        return NULL;
+    }
+    r->vm = vm;
+    r->inner = vm->io;
+    r->hash = 14695981039346656037ULL;
+    report->events = r->count - 1;
+    report->instret = r->events[r->count - 1].instret;
+    const struct lc3_io io = { r, replay_getc, replay_poll, replay_putc, replay_flush, replay_clock, r->inner.in_prompt, NULL }; // the log never waits
+    vm_set_io(vm, &io);
+    return r;
+}
+
+uint64_t replay_length(const struct lc3_replay* r)
+{
+    return r->events ? r->events[r->count - 1].instret : r->vm->instret;
+}
+
+int replay_close(struct lc3_replay* r, struct replay_report* report)
+{
+    memset(report, 0, sizeof(*report));
+    if(!r)
+    {
+        return 0;
+    }
+    int ok = 1;
+    report->instret = r->vm->instret;
+    if(r->file) // recording: the end record, then the file is complete
+    {
+        put_record(r, REPLAY_END);
+        for(int i = 0; i < 8; i++)
+        {
+            fputc((int)(r->hash >> (8 * i)) & 0xFF, r->file);
+        }
+        report->events = r->count - 1;
+        if(fclose(r->file) != 0)
+        {
+            snprintf(report->message, sizeof(report->message), "failed to write the replay log");
+            ok = 0;
+        }
+    }
+    else
+    {
+        const struct replay_event* end = &r->events[r->count - 1];
+        report->events = r->next;
+        if(r->diverged)
+        {
+            memcpy(report->message, r->message, sizeof(report->message));
+            ok = 0;
+        }
+        else if(r->vm->instret != end->instret || r->next != r->count - 1)
+        {
+            snprintf(report->message, sizeof(report->message), "replay stopped at instruction %llu after %llu of %llu input records, the recording at %llu",
+                (unsigned long long)r->vm->instret, (unsigned long long)r->next, (unsigned long long)(r->count - 1), (unsigned long long)end->instret);
+            ok = 0;
+        }
+        else if(r->hash != end->value)
+        {
+            snprintf(report->message, sizeof(report->message), "the output differs from the recording");
+            ok = 0;
+        }
+    }
+    vm_set_io(r->vm, &r->inner);
+    free(r->events);
+    free(r);
+    return ok;
+}
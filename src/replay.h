@@ -0,0 +1,57 @@
+/*      LC-3 Simulator - input record/replay
+*       Logs every keyboard and timer input a VM sees together with the instruction count it
+*       arrived at, and feeds a log back so interactive programs run the same way every time.
+*/
+#ifndef LC3_REPLAY_H
+#define LC3_REPLAY_H
+
+#include <stdint.h>
+
+#include "lc3.h"
+
+// @@diff : {Replay}
+/*
+*   Recording wraps the VM's I/O callbacks: every character getc() returns, every poll()
+*   that reports a waiting key and every clock() reading the timer takes is written to the
+*   log with vm->instret at that moment. All cores keep vm->instret exact at device reads and
+*   traps, so a log taken on one core replays on any other.
+*
+*   Replaying swaps the input callbacks for the log: poll() reports a key at exactly the
+*   recorded instruction count, keys and clock readings come back in the recorded order and
+*   nothing else ever comes from the keyboard or the host clock. Output still goes to the
+*   wrapped putc(). The log ends with the instruction count and a hash of the output at the
+*   end of the recording, which replay_close() checks.
+*
+*   File: "LC3R", a 16-bit little endian version, then one record per event: a kind byte,
+*   the instruction count as a LEB128 delta from the previous record and the payload:
+*       - REPLAY_KEY   : the character (1 byte)
+*       - REPLAY_EOF   : none, getc() hit the end of input
+*       - REPLAY_READY : none, poll() found a key
+*       - REPLAY_CLOCK : milliseconds, LEB128 delta from the previous clock record
+*       - REPLAY_END   : FNV-1a hash of the output, 8 bytes little endian; last record
+*/
+enum
+{
+    REPLAY_VERSION = 1,
+    REPLAY_END = 0,
+    REPLAY_KEY,
+    REPLAY_EOF,
+    REPLAY_READY,
+    REPLAY_CLOCK
+};
+
+struct replay_report
+{
+    char message[160];      // why the log could not be used, or where the replay went off it
+    uint64_t events;        // input records written or consumed
+    uint64_t instret;       // instruction count at the end of the recording
+};
+
+struct lc3_replay;
+
+struct lc3_replay* replay_record(struct lc3_vm* vm, const char* path); // log vm's input from now on, NULL if the file cannot be created
+struct lc3_replay* replay_open(struct lc3_vm* vm, const char* path, struct replay_report* report); // feed the log to vm, NULL on a bad log
+uint64_t replay_length(const struct lc3_replay* r); // instructions in the recording, the budget for vm_run()
+int replay_close(struct lc3_replay* r, struct replay_report* report); // give vm its I/O back; 1 if the log was written / the replay matched it
+
+#endif
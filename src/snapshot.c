@@ -0,0 +1,96 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lc3.h"
+#include "vm.h"
+#include "memory.h"
+#include "predecode.h"
+#include "block.h"
+#include "undo.h"
+
+// @@diff : {Snapshots}
+/*
+*   Snapshots and forks only take references on the pages (see {Memory Pages}); nothing is
+*   copied until somebody writes. Taking a snapshot also hands the VM's own pages over to
+*   sharing, so the VM copies a page again on its next write to it.
+*
+*   Translation caches are not part of a snapshot. A fork starts with none, and a restore
+*   flushes the VM's, because the memory under them changed without going through mem_write().
+*/
+static void share_pages(struct lc3_page* const* from, struct lc3_page** to)
+{
+    for(int p = 0; p < PAGE_COUNT; p++)
+    {
+        page_ref(from[p]);
+        to[p] = from[p];
+    }
+}
+
+static void load_snapshot(struct lc3_vm* vm, const struct lc3_snapshot* snap)
+{
+    pages_release(vm);
+    share_pages(snap->pages, vm->pages);
+    memcpy(vm->reg, snap->reg, sizeof(vm->reg));
+    memcpy(vm->mmio, snap->mmio, sizeof(vm->mmio));
+    vm->running = snap->running;
+    vm->fault = snap->fault;
+    vm->core = snap->core;
+    vm->instret = snap->instret;
+    vm->system = snap->system;
+    vm->io = snap->io;
+    vm->timer_last_ms = snap->timer_last_ms;
+}
+
+struct lc3_snapshot* vm_snapshot(struct lc3_vm* vm)
+{
+    struct lc3_snapshot* snap = malloc(sizeof(struct lc3_snapshot));
+    if(!snap)
+    {
+        return NULL;
+    }
+    share_pages(vm->pages, snap->pages);
+    memset(vm->writable, 0, sizeof(vm->writable)); // every page is shared with the snapshot now
+    memcpy(snap->reg, vm->reg, sizeof(snap->reg));
+    memcpy(snap->mmio, vm->mmio, sizeof(snap->mmio));
+    snap->running = vm->running;
+    snap->fault = vm->fault;
+    snap->core = vm->core;
+    snap->instret = vm->instret;
+    snap->system = vm->system;
+    snap->io = vm->io;
+    snap->timer_last_ms = vm->timer_last_ms;
+    return snap;
+}
+
+struct lc3_vm* vm_fork(const struct lc3_snapshot* snap)
+{
+    struct lc3_vm* vm = calloc(1, sizeof(struct lc3_vm)); // no caches, no trace
+    if(!vm)
+    {
+        return NULL;
+    }
+    load_snapshot(vm, snap);
+    return vm;
+}
+
+void vm_restore(struct lc3_vm* vm, const struct lc3_snapshot* snap)
+{
+    load_snapshot(vm, snap);
+    undo_clear(vm);
+    predecode_flush(vm);
+    block_flush(vm);
+}
+
+void snapshot_destroy(struct lc3_snapshot* snap)
+{
+    if(!snap)
+    {
+        return;
+    }
+    for(int p = 0; p < PAGE_COUNT; p++)
+    {
+        page_unref(snap->pages[p]);
+    }
+    free(snap);
+}
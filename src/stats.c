@@ -0,0 +1,73 @@
+#include <stdio.h>
+#include <stdint.h>
+
+#include "lc3.h"
+#include "stats.h"
+
+static const char* op_names[16] =
+{
+    "BR", "ADD", "LD", "ST", "JSR", "AND", "LDR", "STR",
+    "RTI", "NOT", "LDI", "STI", "JMP", "RES", "LEA", "TRAP"
+};
+
+static const char* trap_name(int vector)
+{
+    static const char* names[] = { "GETC", "OUT", "PUTS", "IN", "PUTSP", "HALT" };
+    return vector >= TRAP_GETC && vector <= TRAP_HALT ? names[vector - TRAP_GETC] : "";
+}
+
+// @@diff : {Statistics}
+void stats_print(const struct lc3_stats* s, FILE* out)
+{
+    fprintf(out, "instructions   %12llu\n", (unsigned long long)s->instructions);
+    for(int op = 0; op < 16; op++)
+    {
+        if(s->opcodes[op])
+        {
+            fprintf(out, "  %-5s        %12llu  %5.1f%%\n", op_names[op], (unsigned long long)s->opcodes[op],
+                    s->instructions ? 100.0 * (double)s->opcodes[op] / (double)s->instructions : 0.0);
+        }
+    }
+    fprintf(out, "loads          %12llu\n", (unsigned long long)s->loads);
+    fprintf(out, "stores         %12llu\n", (unsigned long long)s->stores);
+    fprintf(out, "device reads   %12llu\n", (unsigned long long)s->device_reads);
+    fprintf(out, "device writes  %12llu\n", (unsigned long long)s->device_writes);
+    for(int v = 0; v < 256; v++)
+    {
+        if(s->traps[v])
+        {
+            fprintf(out, "trap x%02X %-5s %12llu\n", v, trap_name(v), (unsigned long long)s->traps[v]);
+        }
+    }
+    fprintf(out, "input bytes    %12llu\n", (unsigned long long)s->input_bytes);
+    fprintf(out, "output bytes   %12llu\n", (unsigned long long)s->output_bytes);
+    fprintf(out, "input wait     %12.3f ms\n", (double)s->input_wait_ns / 1e6);
+}
+
+void stats_print_json(const struct lc3_stats* s, FILE* out)
+{
+    fprintf(out, "{\"instructions\":%llu,\"opcodes\":{", (unsigned long long)s->instructions);
+    const char* sep = "";
+    for(int op = 0; op < 16; op++)
+    {
+        if(s->opcodes[op])
+        {
+            fprintf(out, "%s\"%s\":%llu", sep, op_names[op], (unsigned long long)s->opcodes[op]);
+            sep = ",";
+        }
+    }
+    fprintf(out, "},\"loads\":%llu,\"stores\":%llu,\"device_reads\":%llu,\"device_writes\":%llu,\"traps\":{",
+            (unsigned long long)s->loads, (unsigned long long)s->stores,
+            (unsigned long long)s->device_reads, (unsigned long long)s->device_writes);
+    sep = "";
+    for(int v = 0; v < 256; v++)
+    {
+        if(s->traps[v])
+        {
+            fprintf(out, "%s\"x%02X\":%llu", sep, v, (unsigned long long)s->traps[v]);
+            sep = ",";
+        }
+    }
+    fprintf(out, "},\"input_bytes\":%llu,\"output_bytes\":%llu,\"input_wait_ns\":%llu}",
+            (unsigned long long)s->input_bytes, (unsigned long long)s->output_bytes, (unsigned long long)s->input_wait_ns);
+}
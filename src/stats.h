@@ -0,0 +1,19 @@
+/*      LC-3 Simulator - run statistics
+*/
+#ifndef LC3_STATS_H
+#define LC3_STATS_H
+
+#include <stdio.h>
+
+#include "lc3.h"
+
+// @@diff : {Statistics}
+/*
+*   --stats prints the counters of struct lc3_stats (see vm_stats()) when a run ends, as a
+*   table or, with --stats=json, as one JSON object that batch jobs also embed. Opcodes and
+*   traps that never ran are left out of both.
+*/
+void stats_print(const struct lc3_stats* stats, FILE* out);
+void stats_print_json(const struct lc3_stats* stats, FILE* out); // one object, no newline
+
+#endif
@@ -0,0 +1,119 @@
+#include <stdint.h>
+
+#include "lc3.h"
+#include "vm.h"
+#include "memory.h"
+#include "mmio.h"
+#include "system.h"
+
+void system_reset(struct lc3_vm* vm)
+{
+    vm->system.psr = PSR_USER;
+    vm->system.saved_ssp = SYSTEM_SSP_START;
+    vm->system.saved_usp = 0;
+}
+
+uint16_t system_psr(const struct lc3_vm* vm)
+{
+    return vm->system.psr | vm->reg[R_COND];
+}
+
+void system_set_psr(struct lc3_vm* vm, uint16_t psr)
+{
+    vm->system.psr = psr & (PSR_USER | PSR_PRIORITY);
+    uint16_t cond = psr & PSR_COND;
+    vm->reg[R_COND] = cond == FL_POS || cond == FL_NEG ? cond : FL_ZRO; // exactly one flag, like everywhere else
+}
+
+// @@diff : {Supervisor Stack}
+static void push(struct lc3_vm* vm, uint16_t val)
+{
+    mem_write(vm, --vm->reg[R_R6], val);
+}
+
+static uint16_t pop(struct lc3_vm* vm)
+{
+    return mem_read(vm, vm->reg[R_R6]++);
+}
+
+/*
+*   What TRAPs, exceptions and interrupts share: look the handler up, switch to the
+*   supervisor stack if coming from user mode, push PSR and PC and jump. priority < 0
+*   keeps the current priority level.
+*/
+static void enter_supervisor(struct lc3_vm* vm, uint16_t table_entry, int priority)
+{
+    struct lc3_system* s = &vm->system;
+    uint16_t handler = mem_read(vm, table_entry);
+    if(!handler)
+    {
+        vm->running = 0;
+        vm->fault = LC3_FAULT_VECTOR;
+        return;
+    }
+    uint16_t psr = system_psr(vm);
+    if(s->psr & PSR_USER)
+    {
+        s->saved_usp = vm->reg[R_R6];
+        vm->reg[R_R6] = s->saved_ssp;
+    }
+    s->psr &= ~PSR_USER;
+    if(priority >= 0)
+    {
+        s->psr = (uint16_t)((s->psr & ~PSR_PRIORITY) | priority << 8);
+    }
+    push(vm, psr);
+    push(vm, vm->reg[R_PC]);
+    vm->reg[R_PC] = handler;
+}
+
+void system_trap(struct lc3_vm* vm, uint16_t instr)
+{
+    vm->stats.traps[instr & 0xFF]++;
+    enter_supervisor(vm, SYSTEM_TRAP_TABLE + (instr & 0xFF), -1);
+}
+
+void system_exception(struct lc3_vm* vm, uint16_t vector)
+{
+    enter_supervisor(vm, SYSTEM_INT_TABLE + vector, -1);
+}
+
+void system_rti(struct lc3_vm* vm)
+{
+    struct lc3_system* s = &vm->system;
+    if(s->psr & PSR_USER)
+    {
+        system_exception(vm, VEC_PRIVILEGE);
+        return;
+    }
+    vm->reg[R_PC] = pop(vm);
+    system_set_psr(vm, pop(vm));
+    if(s->psr & PSR_USER) // back to user mode: swap the stacks back
+    {
+        s->saved_ssp = vm->reg[R_R6];
+        vm->reg[R_R6] = s->saved_usp;
+    }
+}
+
+// @@diff : {Interrupts}
+/*
+*   The devices keep their ready bits in the device page (see mmio.c), so checking for a
+*   pending interrupt is two loads per instruction. Only the sampling, which may poll the
+*   input or read the clock, waits for the next SYSTEM_POLL_INTERVAL boundary.
+*/
+void system_interrupts(struct lc3_vm* vm)
+{
+    if((vm->instret & (SYSTEM_POLL_INTERVAL - 1)) == 0)
+    {
+        mmio_sample(vm);
+    }
+    int level = (vm->system.psr & PSR_PRIORITY) >> 8;
+    if(level < PL_TIMER && (mem_peek(vm, MR_TMR) & (DEVICE_READY | DEVICE_IE)) == (DEVICE_READY | DEVICE_IE))
+    {
+        enter_supervisor(vm, SYSTEM_INT_TABLE + VEC_TIMER, PL_TIMER);
+    }
+    else if(level < PL_KEYBOARD && (mem_peek(vm, MR_KBSR) & (DEVICE_READY | DEVICE_IE)) == (DEVICE_READY | DEVICE_IE))
+    {
+        enter_supervisor(vm, SYSTEM_INT_TABLE + VEC_KEYBOARD, PL_KEYBOARD);
+    }
+}
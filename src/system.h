@@ -0,0 +1,71 @@
+/*      LC-3 Simulator - full-system mode
+*       Privilege levels, the supervisor stack, RTI and interrupts, for running a real LC-3
+*       operating system image instead of the TRAP routines emulated in C.
+*/
+#ifndef LC3_SYSTEM_H
+#define LC3_SYSTEM_H
+
+#include <stdint.h>
+
+#include "lc3.h"
+
+// @@diff : {Full-System Mode}
+/*
+*   Off by default: TRAPs run in C (trap.c) and RTI or the reserved opcode stop the machine
+*   with a fault. vm_set_system() turns it on, and from then on the reference core does what
+*   the hardware does:
+*       - TRAP x pushes PSR and PC on the supervisor stack, enters supervisor mode and jumps
+*         through the trap vector table at x0000 + x. The OS routine returns with RTI.
+*       - RTI in user mode and the reserved opcode are exceptions x00 and x01, taken through
+*         the interrupt vector table at x0100 like interrupts.
+*       - the keyboard (KBSR bit 14 enables it) interrupts at priority 4 through x0180, the
+*         timer (TMR bit 14) at priority 6 through x0181, whenever the PSR priority is lower.
+*       - entering supervisor mode from user mode saves R6 as the USP and loads the SSP;
+*         an RTI back to user mode does the reverse.
+*   The machine starts in user mode at priority 0 with the supervisor stack at x3000. Memory
+*   is not protected (no ACV), so programs that poll the device page still run under an OS.
+*   A TRAP, exception or interrupt through a vector table entry of zero stops the machine
+*   with LC3_FAULT_VECTOR, so a missing handler shows up as such and not as a jump to x0000.
+*
+*   The devices are sampled for interrupts every SYSTEM_POLL_INTERVAL instructions, at fixed
+*   instruction counts so a recorded session replays with the interrupts in the same places.
+*/
+enum
+{
+    SYSTEM_TRAP_TABLE = 0x0000,    // trap vector table, x0000-x00FF
+    SYSTEM_INT_TABLE = 0x0100,     // exception and interrupt vector table, x0100-x01FF
+    SYSTEM_SSP_START = 0x3000,     // initial supervisor stack, grows down below user memory
+    SYSTEM_POLL_INTERVAL = 1024,   // instructions between device samples, a power of two
+
+    PSR_USER = 0x8000,             // bit 15: 1 = user mode
+    PSR_PRIORITY = 0x0700,         // bits 10:8: priority level
+    PSR_COND = 0x0007,             // bits 2:0: NZP, kept in reg[R_COND] while running
+
+    DEVICE_READY = 0x8000,         // KBSR/TMR bit 15
+    DEVICE_IE = 0x4000,            // KBSR/TMR bit 14: interrupt enable
+
+    VEC_PRIVILEGE = 0x00,          // RTI in user mode
+    VEC_OPCODE = 0x01,             // reserved opcode
+    VEC_KEYBOARD = 0x80,
+    VEC_TIMER = 0x81,
+    PL_KEYBOARD = 4,
+    PL_TIMER = 6
+};
+
+struct lc3_system
+{
+    int enabled;          // vm_set_system()
+    uint16_t psr;         // privilege and priority; NZP lives in reg[R_COND]
+    uint16_t saved_ssp;   // R6 for whichever mode is not running
+    uint16_t saved_usp;
+};
+
+void system_reset(struct lc3_vm* vm); // user mode, priority 0, supervisor stack at SYSTEM_SSP_START
+uint16_t system_psr(const struct lc3_vm* vm); // full PSR, NZP included
+void system_set_psr(struct lc3_vm* vm, uint16_t psr);
+void system_trap(struct lc3_vm* vm, uint16_t instr); // PC already points past the TRAP
+void system_exception(struct lc3_vm* vm, uint16_t vector);
+void system_rti(struct lc3_vm* vm);
+void system_interrupts(struct lc3_vm* vm); // before each instruction: take the highest pending interrupt, if any
+
+#endif
@@ -0,0 +1,125 @@
+#include <stdio.h>
+#include <stdint.h>
+
+#include "lc3.h"
+#include "vm.h"
+#include "trace.h"
+
+enum
+{
+    TRACE_VERSION = 1
+};
+
+static void trace_put16(struct lc3_trace* t, uint16_t x) // write a 16-bit little endian word to the trace file
+{
+    putc(x & 0xFF, t->file);
+    putc(x >> 8, t->file);
+}
+
+int trace_open(struct lc3_vm* vm, int level, const char* path)
+{
+    struct lc3_trace* t = &vm->trace;
+    t->level = level;
+    if(level == TRACE_NONE)
+    {
+        return 1;
+    }
+    if(level == TRACE_REGS && !path)
+    {
+        t->file = stderr; // register traces are text, default to stderr
+        return 1;
+    }
+
+    t->file = fopen(path ? path : "lc3.trace", level == TRACE_DELTA ? "wb" : "w");
+    if(!t->file)
+    {
+        t->level = TRACE_NONE;
+        return 0;
+    }
+    if(level == TRACE_DELTA)
+    {
+        fputs("LC3T", t->file); // magic
+        trace_put16(t, TRACE_VERSION);
+        vm->log_writes = 1;
+    }
+    return 1;
+}
+
+void trace_close(struct lc3_vm* vm)
+{
+    struct lc3_trace* t = &vm->trace;
+    if(t->file && t->file != stderr)
+    {
+        fclose(t->file);
+    }
+    else if(t->file)
+    {
+        fflush(t->file);
+    }
+    t->file = NULL;
+    t->level = TRACE_NONE;
+    vm->log_writes = vm->undo != NULL;
+}
+
+void trace_begin(struct lc3_vm* vm) // called before an instruction executes
+{
+    struct lc3_trace* t = &vm->trace;
+    for(int i = 0; i < R_COUNT; i++)
+    {
+        t->regs[i] = vm->reg[i]; // remember the registers so we can diff them afterwards
+    }
+    t->write_count = 0;
+}
+
+void trace_write(struct lc3_vm* vm, uint16_t address, uint16_t old_val, uint16_t val) // called by mem_write()
+{
+    struct lc3_trace* t = &vm->trace;
+    if(old_val != val && t->write_count < TRACE_MAX_WRITES)
+    {
+        t->write_addr[t->write_count] = address;
+        t->write_val[t->write_count] = val;
+        t->write_count++;
+    }
+}
+
+void trace_end(struct lc3_vm* vm, uint16_t pc, uint16_t instr) // called after an instruction executes
+{
+    struct lc3_trace* t = &vm->trace;
+    uint16_t* reg = vm->reg;
+    if(t->level == TRACE_REGS)
+    {
+        fprintf(t->file, "0x%04X: 0x%04X |", pc, instr);
+        for(int i = 0; i < R_PC; i++)
+        {
+            fprintf(t->file, " R%d=0x%04X", i, reg[i]);
+        }
+        fprintf(t->file, " PC=0x%04X COND=%X\n", reg[R_PC], reg[R_COND]);
+        return;
+    }
+
+    // TRACE_DELTA: only what the instruction changed
+    uint16_t mask = 0;
+    for(int i = 0; i < R_COUNT; i++)
+    {
+        if(reg[i] != t->regs[i])
+        {
+            mask |= 1 << i;
+        }
+    }
+    trace_put16(t, pc);
+    trace_put16(t, instr);
+    trace_put16(t, mask);
+    for(int i = 0; i < R_COUNT; i++)
+    {
+        if(mask & (1 << i))
+        {
+            trace_put16(t, reg[i]);
+        }
+    }
+    putc(t->write_count, t->file);
+    for(int i = 0; i < t->write_count; i++)
+    {
+        trace_put16(t, t->write_addr[i]);
+        trace_put16(t, t->write_val[i]);
+    }
+}
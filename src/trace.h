@@ -0,0 +1,53 @@
+/*      LC-3 Simulator - tracing
+*/
+#ifndef LC3_TRACE_H
+#define LC3_TRACE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "lc3.h"
+
+// @@diff : {Tracing}
+/*
+*   Tracing is off by default so the interpreter runs at full speed.
+*   The trace level is picked on the command line:
+*       - TRACE_NONE  : nothing is recorded (default)
+*       - TRACE_REGS  : PC, instruction and registers are printed as text after every instruction
+*       - TRACE_DELTA : only the registers and memory words an instruction changed are
+*                       written as binary records to the trace file
+*
+*   The delta trace file starts with the magic "LC3T" and a 16-bit version, followed by
+*   one record per instruction (all words little endian):
+*       pc, instr, reg_mask, reg[i] for every bit i set in reg_mask,
+*       write_count (1 byte), then write_count pairs of (address, value)
+*/
+enum
+{
+    TRACE_NONE = 0,
+    TRACE_REGS,
+    TRACE_DELTA
+};
+
+enum
+{
+    TRACE_MAX_WRITES = 4 // one word per instruction; in full-system mode an interrupt and a TRAP push two each
+};
+
+struct lc3_trace
+{
+    int level;                                  // current trace level, checked by the switch core and mem_write()
+    FILE* file;                                 // sink for the trace (stderr or a binary file)
+    uint16_t regs[R_COUNT];                     // registers before the current instruction
+    uint16_t write_addr[TRACE_MAX_WRITES];      // memory words written by the current instruction
+    uint16_t write_val[TRACE_MAX_WRITES];
+    int write_count;
+};
+
+int trace_open(struct lc3_vm* vm, int level, const char* path); // 0 if the trace file could not be opened
+void trace_close(struct lc3_vm* vm);
+void trace_begin(struct lc3_vm* vm); // called before an instruction executes
+void trace_write(struct lc3_vm* vm, uint16_t address, uint16_t old_val, uint16_t val); // called by mem_write()
+void trace_end(struct lc3_vm* vm, uint16_t pc, uint16_t instr); // called after an instruction executes
+
+#endif
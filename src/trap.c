@@ -0,0 +1,117 @@
+#include <stdio.h>
+#include <stdint.h>
+
+#include "lc3.h"
+#include "core.h"
+#include "vm.h"
+#include "memory.h"
+#include "platform.h"
+
+// @@diff : {Trap Routines}
+/*
+*   The TRAP routines are emulated in C on top of the VM's I/O callbacks (the buffered
+*   console by default). Every core calls this after setting R7 to the return address.
+*   Characters go through trap_getc()/trap_putc() so the stats see them.
+*/
+static int trap_getc(struct lc3_vm* vm)
+{
+    uint64_t start = time_ns();
+    int c = vm->io.getc(vm->io.ctx);
+    vm->stats.input_wait_ns += time_ns() - start;
+    vm->stats.input_bytes += c != EOF;
+    return c;
+}
+
+static void trap_putc(struct lc3_vm* vm, char c)
+{
+    vm->io.putc(vm->io.ctx, c);
+    vm->stats.output_bytes++;
+}
+
+static void trap_puts(struct lc3_vm* vm, const char* s)
+{
+    while(*s)
+    {
+        trap_putc(vm, *s++);
+    }
+}
+
+void execute_trap(struct lc3_vm* vm, uint16_t instr)
+{
+    uint16_t* reg = vm->reg;
+    struct lc3_io* io = &vm->io;
+    vm->idle_spins = 0; // a program that prints or reads through TRAPs is not idling
+    vm->stats.traps[instr & 0xFF]++;
+
+    switch(instr & 0xFF)
+    {
+        case TRAP_GETC:
+        {
+            //@TRAP_GETC
+            reg[R_R0] = (uint16_t)trap_getc(vm); // read a single ASCII character
+            update_flags(vm, R_R0); // update the condition flags
+        }
+        break;
+
+        case TRAP_OUT:
+        {
+            //@TRAP_OUT
+            trap_putc(vm, (char)reg[R_R0]); // output a single ASCII character
+        }
+        break;
+
+        case TRAP_PUTS:
+        {
+            //@TRAP_PUTS
+            uint16_t a = reg[R_R0];
+            for(uint32_t n = 0; n < MEMORY_MAX && mem_peek(vm, a); n++, a++) // walk the string from the address in R0, wrapping at xFFFF, at most once around
+            {
+                trap_putc(vm, (char)mem_peek(vm, a)); // output the character
+            }
+        }
+        break;
+
+        case TRAP_IN:
+        {
+            //@TRAP_IN
+            if(io->in_prompt)
+            {
+                trap_puts(vm, io->in_prompt);
+            }
+            char c = trap_getc(vm); // read a single ASCII character (the console flushes the prompt first)
+            trap_putc(vm, c); // echo the character
+            reg[R_R0] = (uint16_t)c; // store the character in R0
+            update_flags(vm, R_R0); // update the condition flags
+        }
+        break;
+
+        case TRAP_PUTSP:
+        {
+            //@TRAP_PUTSP
+            /* one char per byte (two bytes per word) here we need to swap back to
+            big endian format */
+            uint16_t a = reg[R_R0];
+            for(uint32_t n = 0; n < MEMORY_MAX && mem_peek(vm, a); n++, a++) // same walk as PUTS
+            {
+                uint16_t c = mem_peek(vm, a);
+                char char1 = c & 0xFF; // get the first ASCII character
+                trap_putc(vm, char1); // output the character
+                char char2 = c >> 8; // get the second ASCII character
+                if(char2) trap_putc(vm, char2); // output the character if it is not null
+            }
+        }
+        break;
+
+        case TRAP_HALT:
+        {
+            //@TRAP_HALT
+            trap_puts(vm, "HALT\n"); // output "HALT"
+            if(io->flush)
+            {
+                io->flush(io->ctx); // everything the program printed goes out now
+            }
+            vm->running = 0; // stop the program
+        }
+        break;
+    }
+}
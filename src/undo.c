@@ -0,0 +1,202 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lc3.h"
+#include "vm.h"
+#include "memory.h"
+#include "undo.h"
+
+int undo_open(struct lc3_vm* vm, size_t bytes)
+{
+    struct lc3_undo* u = calloc(1, sizeof(struct lc3_undo));
+    if(!u || bytes < 256 || !(u->ring = malloc(bytes)))
+    {
+        free(u);
+        return 0;
+    }
+    u->capacity = bytes;
+    undo_close(vm);
+    vm->undo = u;
+    vm->log_writes = 1;
+    return 1;
+}
+
+void undo_close(struct lc3_vm* vm)
+{
+    if(vm->undo)
+    {
+        free(vm->undo->ring);
+        free(vm->undo);
+        vm->undo = NULL;
+        vm->log_writes = vm->trace.level == TRACE_DELTA;
+    }
+}
+
+void undo_clear(struct lc3_vm* vm)
+{
+    struct lc3_undo* u = vm->undo;
+    if(u)
+    {
+        u->start = 0;
+        u->used = 0;
+        u->count = 0;
+        u->active = 0;
+    }
+}
+
+uint64_t undo_depth(const struct lc3_vm* vm)
+{
+    return vm->undo ? vm->undo->count : 0;
+}
+
+// @@diff : {Undo Recording}
+static void capture(const struct lc3_vm* vm, uint16_t* state) // UNDO_REGS words
+{
+    memcpy(state, vm->reg, R_COUNT * sizeof(uint16_t));
+    state[R_COUNT] = vm->system.psr;
+    state[R_COUNT + 1] = vm->system.saved_ssp;
+    state[R_COUNT + 2] = vm->system.saved_usp;
+}
+
+void undo_begin(struct lc3_vm* vm)
+{
+    struct lc3_undo* u = vm->undo;
+    capture(vm, u->before);
+    u->write_count = 0;
+    u->active = 1;
+}
+
+void undo_write(struct lc3_vm* vm, uint16_t address, uint16_t old_val)
+{
+    struct lc3_undo* u = vm->undo;
+    if(u->active && address < MMIO_BASE && u->write_count < UNDO_MAX_WRITES) // the debugger's own writes are not instructions
+    {
+        u->write_addr[u->write_count] = address;
+        u->write_old[u->write_count] = old_val;
+        u->write_count++;
+    }
+}
+
+static void put_byte(struct lc3_undo* u, size_t at, uint8_t b)
+{
+    u->ring[(u->start + at) % u->capacity] = b;
+}
+
+static uint8_t get_byte(const struct lc3_undo* u, size_t at)
+{
+    return u->ring[(u->start + at) % u->capacity];
+}
+
+void undo_end(struct lc3_vm* vm)
+{
+    struct lc3_undo* u = vm->undo;
+    uint16_t after[UNDO_REGS];
+    capture(vm, after);
+    u->active = 0;
+
+    uint16_t mask = vm->running ? 0 : UNDO_STOPPED;
+    size_t size = 1 + 2 + 4 * u->write_count + 1;
+    for(int i = 0; i < UNDO_REGS; i++)
+    {
+        if(after[i] != u->before[i])
+        {
+            mask |= 1 << i;
+            size += 2;
+        }
+    }
+    while(u->used + size > u->capacity) // make room: the oldest records go
+    {
+        size_t oldest = get_byte(u, 0);
+        u->start = (u->start + oldest) % u->capacity;
+        u->used -= oldest;
+        u->count--;
+    }
+
+    size_t at = u->used;
+    put_byte(u, at++, (uint8_t)size);
+    put_byte(u, at++, mask & 0xFF);
+    put_byte(u, at++, mask >> 8);
+    for(int i = 0; i < UNDO_REGS; i++)
+    {
+        if(mask & (1 << i))
+        {
+            put_byte(u, at++, u->before[i] & 0xFF);
+            put_byte(u, at++, u->before[i] >> 8);
+        }
+    }
+    for(int i = 0; i < u->write_count; i++)
+    {
+        put_byte(u, at++, u->write_addr[i] & 0xFF);
+        put_byte(u, at++, u->write_addr[i] >> 8);
+        put_byte(u, at++, u->write_old[i] & 0xFF);
+        put_byte(u, at++, u->write_old[i] >> 8);
+    }
+    put_byte(u, at++, (uint8_t)size);
+    u->used = at;
+    u->count++;
+}
+
+// @@diff : {Undo Step}
+static uint16_t get16(const struct lc3_undo* u, size_t at)
+{
+    return (uint16_t)(get_byte(u, at) | get_byte(u, at + 1) << 8);
+}
+
+int undo_step(struct lc3_vm* vm, uint16_t* watched)
+{
+    struct lc3_undo* u = vm->undo;
+    if(!u || !u->count)
+    {
+        return UNDO_NONE;
+    }
+    size_t size = get_byte(u, u->used - 1);
+    size_t at = u->used - size + 1;
+    uint16_t mask = get16(u, at);
+    at += 2;
+
+    uint16_t state[UNDO_REGS];
+    capture(vm, state);
+    for(int i = 0; i < UNDO_REGS; i++)
+    {
+        if(mask & (1 << i))
+        {
+            state[i] = get16(u, at);
+            at += 2;
+        }
+    }
+    memcpy(vm->reg, state, R_COUNT * sizeof(uint16_t));
+    vm->system.psr = state[R_COUNT];
+    vm->system.saved_ssp = state[R_COUNT + 1];
+    vm->system.saved_usp = state[R_COUNT + 2];
+
+    int result = UNDO_STEP;
+    size_t end = u->used - 1;
+    while(at < end) // the writes, newest last: undo them newest first
+    {
+        end -= 4;
+        uint16_t address = get16(u, end);
+        mem_poke(vm, address, get16(u, end + 2));
+        uint8_t marks = vm->code_map[address];
+        if(marks & CODE_WATCH)
+        {
+            result = UNDO_WATCH;
+            *watched = address;
+        }
+        if(marks & (CODE_DECODED | CODE_BLOCK))
+        {
+            vm->code_map[address] &= ~CODE_WATCH; // not a watchpoint hit, the program did not write it
+            code_invalidate(vm, address);
+            vm->code_map[address] |= marks & CODE_WATCH;
+        }
+    }
+    if(mask & UNDO_STOPPED)
+    {
+        vm->running = 1;
+        vm->fault = LC3_FAULT_NONE;
+    }
+    vm->instret--;
+    u->used -= size;
+    u->count--;
+    return result;
+}
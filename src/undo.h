@@ -0,0 +1,66 @@
+/*      LC-3 Simulator - undo log
+*       Remembers what the last instructions overwrote, so the debugger can step backwards.
+*/
+#ifndef LC3_UNDO_H
+#define LC3_UNDO_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "lc3.h"
+
+// @@diff : {Undo Log}
+/*
+*   With an undo log the switch core records, for every instruction it retires, the old
+*   value of each register and memory word the instruction changed. Records go into a ring
+*   buffer of a fixed number of bytes; once it is full the oldest records are dropped, so
+*   the log always covers the most recent instructions that fit. Undoing one is a handful
+*   of stores, so stepping back anywhere inside that window takes time proportional to the
+*   distance, never a re-run from the start.
+*
+*   A record is its size (u8), a mask (u16) of what it holds, the old value of every
+*   register in the mask (R0-R7, PC, COND, then PSR, saved SSP and saved USP in full-system
+*   mode), then (address, old value) pairs for the words written, and its size again so the
+*   newest one can be found from the end. All words are little endian. UNDO_STOPPED marks
+*   an instruction that stopped the machine (HALT, MCR, a fault).
+*
+*   Only machine state is undone: characters a program printed stay printed, keys it read
+*   are gone, and device registers (xFE00 and up) keep their values. Running forward again
+*   after stepping back over a GETC reads the next key.
+*/
+enum
+{
+    UNDO_REGS = R_COUNT + 3,  // the registers, then PSR, saved SSP and saved USP
+    UNDO_STOPPED = 1 << 13,
+    UNDO_MAX_WRITES = 4,      // like the delta trace: an interrupt and a TRAP push two words each
+    UNDO_DEFAULT_MB = 64,
+
+    UNDO_NONE = 0,            // undo_step(): the log is empty
+    UNDO_STEP,                // one instruction undone
+    UNDO_WATCH                // ... and it had written a watched word
+};
+
+struct lc3_undo
+{
+    uint8_t* ring;
+    size_t capacity;          // bytes
+    size_t start;             // oldest record
+    size_t used;
+    uint64_t count;           // records in the ring
+    uint16_t before[UNDO_REGS]; // state before the current instruction
+    uint16_t write_addr[UNDO_MAX_WRITES];
+    uint16_t write_old[UNDO_MAX_WRITES];
+    int write_count;
+    int active;               // between undo_begin() and undo_end(), writes belong to an instruction
+};
+
+int undo_open(struct lc3_vm* vm, size_t bytes); // 0 if out of memory
+void undo_close(struct lc3_vm* vm);
+void undo_clear(struct lc3_vm* vm); // forget everything, e.g. after the machine was changed by hand
+uint64_t undo_depth(const struct lc3_vm* vm); // instructions that can be undone
+void undo_begin(struct lc3_vm* vm); // switch core, before an instruction
+void undo_write(struct lc3_vm* vm, uint16_t address, uint16_t old_val); // called by mem_write()
+void undo_end(struct lc3_vm* vm); // switch core, after an instruction retired
+int undo_step(struct lc3_vm* vm, uint16_t* watched); // undo the newest instruction, UNDO_*; *watched is the word for UNDO_WATCH
+
+#endif
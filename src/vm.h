@@ -0,0 +1,102 @@
+/*      LC-3 Simulator - machine state
+*       Everything one LC-3 machine owns. Nothing in the emulator keeps per-machine state in
+*       globals, so any number of these can run in one process (one thread per VM at a time).
+*/
+#ifndef LC3_VM_H
+#define LC3_VM_H
+
+#include <stdint.h>
+
+#include "lc3.h"
+#include "trace.h"
+#include "mmio.h"
+#include "predecode.h"
+#include "block.h"
+#include "system.h"
+
+/*
+*   Bits in code_map[]: which caches hold a copy of the word, and the debugger's marks
+*   (debug.h). mem_write() only leaves its fast path when the word it writes is marked.
+*/
+enum
+{
+    CODE_DECODED = 1 << 0, // has a record in the predecode table
+    CODE_BLOCK = 1 << 1,   // covered by at least one translated block
+    CODE_BREAK = 1 << 2,   // breakpoint
+    CODE_WATCH = 1 << 3,   // watchpoint on writes
+    CODE_RWATCH = 1 << 4,  // watchpoint on reads
+    CODE_DEBUG = CODE_BREAK | CODE_WATCH | CODE_RWATCH // survive writes and cache flushes
+};
+
+// @@diff : {Memory Pages}
+/*
+*   Memory is 256 pages of 256 words. Pages are reference counted and shared between a VM,
+*   its snapshots and the VMs forked from them; a VM copies a page the first time it writes
+*   to it (copy-on-write). writable[] caches which pages this VM owns outright, so the write
+*   fast path never looks at a reference count. Fresh memory points at one shared zero page.
+*/
+enum
+{
+    PAGE_SHIFT = 8,
+    PAGE_WORDS = 1 << PAGE_SHIFT,
+    PAGE_COUNT = MEMORY_MAX >> PAGE_SHIFT
+};
+
+struct lc3_page
+{
+    uint16_t words[PAGE_WORDS]; // first, so a page pointer is also a pointer to its words
+    uint32_t refs;              // VMs and snapshots holding the page (atomic)
+};
+
+struct lc3_vm
+{
+    struct lc3_page* pages[PAGE_COUNT]; // 65536 Locations of memory, 256 words per page
+    uint16_t* writable[PAGE_COUNT];     // words of pages only this VM holds, NULL = copy before writing
+    uint16_t reg[R_COUNT];              // store the 10 registers in an array
+    int running;                        // cleared by TRAP HALT, MCR or a bad opcode
+    int fault;                          // LC3_FAULT_*, set together with running = 0
+    int core;                           // CORE_* used by vm_run()
+    uint64_t instret;                   // instructions retired
+    uint64_t deadline_ms;               // time_ms() at which vm_run() gives up, 0 = none
+    struct lc3_stats stats;             // counters behind vm_stats(); the block core keeps its opcode counts per block until then
+    struct lc3_system system;           // PSR and saved stack pointers, full-system mode only
+
+    struct lc3_io io;                   // TRAP routines and keyboard/display devices
+    struct lc3_trace trace;
+    struct lc3_profile* profile;        // --profile counters, NULL = off
+    struct lc3_debug* debug;            // breakpoints and watchpoints, NULL = no debugger
+    struct lc3_undo* undo;              // --undo log for stepping backwards, NULL = off
+    int log_writes;                     // mem_write() reports every write to the delta trace and/or the undo log
+    struct mmio_device mmio[MMIO_SIZE]; // device page callbacks
+    uint64_t timer_last_ms;             // when TMR last fired (or TMI was set)
+    uint64_t idle_instret;              // vm->instret at the last KBSR read that found no key
+    uint64_t idle_gap;                  // instructions between the last two of those
+    int idle_spins;                     // such reads in a row the same gap apart, with no other device or TRAP use
+
+    uint16_t discard[PAGE_WORDS];       // takes writes while a page cannot be copied (LC3_FAULT_MEMORY)
+    uint8_t loaded[MEMORY_MAX / 8];     // words written by an image since the last reset, for overlap reports
+    uint8_t code_map[MEMORY_MAX];       // CODE_* bits per word
+    struct decoded_instr* decoded;      // predecode table, allocated on first use
+    struct block_cache* blocks;         // translated blocks, allocated on first use
+};
+
+/*
+*   A frozen copy of a VM: registers, device state and references to its memory pages.
+*   Taking one costs a reference per page; the VM and every fork copy a page when they
+*   first write to it.
+*/
+struct lc3_snapshot
+{
+    struct lc3_page* pages[PAGE_COUNT];
+    uint16_t reg[R_COUNT];
+    int running;
+    int fault;
+    int core;
+    uint64_t instret;
+    struct lc3_system system;
+    struct lc3_io io;
+    struct mmio_device mmio[MMIO_SIZE];
+    uint64_t timer_last_ms;
+};
+
+#endif
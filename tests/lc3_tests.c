@@ -0,0 +1,1129 @@
+/*      LC-3 Simulator - tests
+*       Runs small programs on every core and checks the resulting machine state.
+*       Programs are either the checked-in images under src/ or hand-assembled words.
+*/
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "lc3.h"
+#include "core.h"
+#include "vm.h"
+#include "memory.h"
+#include "asm.h"
+#include "image.h"
+#include "replay.h"
+#include "profile.h"
+#include "debug.h"
+#include "checkpoint.h"
+#include "undo.h"
+#include "disasm.h"
+#include "batch.h"
+#include "platform.h"
+
+static int failures = 0;
+static struct lc3_vm* vm; // the machine most tests run on
+
+#define CHECK(cond) do { if(!(cond)) { printf("  FAILED %s:%d: %s\n", __FILE__, __LINE__, #cond); failures++; } } while(0)
+
+static const int cores[] = { CORE_SWITCH, CORE_THREADED, CORE_BLOCK };
+static const char* core_names[] = { "switch", "threaded", "block" };
+enum { CORE_TOTAL = 3 };
+
+static void load_words(const uint16_t* words, int count) // words[0] is the origin, like an image file
+{
+    vm_reset(vm);
+    for(int i = 1; i < count; i++)
+    {
+        mem_poke(vm, words[0] + i - 1, words[i]);
+    }
+}
+
+static int load_image(const char* name)
+{
+    char path[512];
+    snprintf(path, sizeof(path), "%s/src/%s", LC3_SOURCE_DIR, name);
+    vm_reset(vm);
+    return vm_load_image(vm, path);
+}
+
+static void test_images()
+{
+    for(int c = 0; c < CORE_TOTAL; c++)
+    {
+        printf("images on %s core\n", core_names[c]);
+
+        CHECK(load_image("add.obj"));
+        vm_set_core(vm, cores[c]);
+        vm_run(vm, 0);
+        CHECK(vm->reg[R_R2] == 8);
+
+        CHECK(load_image("branching.obj"));
+        vm_set_core(vm, cores[c]);
+        vm_run(vm, 0);
+        CHECK(vm->reg[R_R2] == 3); // flags come from LD R1 (positive), so BRz falls through
+
+        CHECK(load_image("loadAndStore.obj"));
+        vm_set_core(vm, cores[c]);
+        vm_run(vm, 0);
+        CHECK(mem_peek(vm, 0x3004) == 6);
+
+        CHECK(load_image("subroutineCall.obj"));
+        vm_set_core(vm, cores[c]);
+        vm_run(vm, 0);
+        CHECK(vm->reg[R_R0] == 1);
+        CHECK(vm->reg[R_R7] == 0x3002); // HALT sets R7 last
+    }
+}
+
+static void test_self_modifying_code()
+{
+    // JSR T; LD R1, NEWI; ST R1, T; JSR T; HALT; T: ADD R0, R0, #1; RET; NEWI: ADD R0, R0, #2
+    const uint16_t prog[] = { 0x3000, 0x4804, 0x2205, 0x3202, 0x4801, 0xF025, 0x1021, 0xC1C0, 0x1022 };
+    for(int c = 0; c < CORE_TOTAL; c++)
+    {
+        printf("self-modifying code on %s core\n", core_names[c]);
+        load_words(prog, sizeof(prog) / sizeof(prog[0]));
+        vm_set_core(vm, cores[c]);
+        vm_run(vm, 0);
+        CHECK(vm->reg[R_R0] == 3);
+    }
+}
+
+static void test_mcr_halt()
+{
+    // AND R0, R0, #0; STI R0, PTR; ADD R1, R1, #1; PTR: .FILL xFFFE
+    const uint16_t prog[] = { 0x3000, 0x5020, 0xB001, 0x1261, 0xFFFE };
+    for(int c = 0; c < CORE_TOTAL; c++)
+    {
+        printf("MCR halt on %s core\n", core_names[c]);
+        load_words(prog, sizeof(prog) / sizeof(prog[0]));
+        vm_set_core(vm, cores[c]);
+        vm_run(vm, 0);
+        CHECK(!vm->running);
+        CHECK(vm->reg[R_R1] == 0); // the instruction after the store never ran
+        CHECK(vm->instret == 2); // the AND and the STI
+    }
+}
+
+static void test_flags()
+{
+    // AND R0, R0, #0; ADD R0, R0, #-1; NOT R1, R0; HALT
+    const uint16_t prog[] = { 0x3000, 0x5020, 0x103F, 0x923F, 0xF025 };
+    for(int c = 0; c < CORE_TOTAL; c++)
+    {
+        printf("condition flags on %s core\n", core_names[c]);
+        load_words(prog, sizeof(prog) / sizeof(prog[0]));
+        vm_set_core(vm, cores[c]);
+        vm_run(vm, 0);
+        CHECK(vm->reg[R_R0] == 0xFFFF);
+        CHECK(vm->reg[R_R1] == 0);
+        CHECK(vm->reg[R_COND] == FL_ZRO); // set by the NOT, the ADD's flags were dead in the block core
+    }
+
+    // LD R2, PSR; ADD R1, R1, #-1; LDR R0, R2, #0; HALT; PSR: .FILL xFFFC
+    const uint16_t psr[] = { 0x3000, 0x2403, 0x127F, 0x6080, 0xF025, 0xFFFC };
+    for(int c = 0; c < CORE_TOTAL; c++)
+    {
+        load_words(psr, sizeof(psr) / sizeof(psr[0]));
+        vm_set_core(vm, cores[c]);
+        vm_run(vm, 0);
+        CHECK((vm->reg[R_R0] & 7) == FL_NEG); // a load can read the ADD's flags through the PSR, so they are not dead
+    }
+}
+
+static void test_budget()
+{
+    // loadAndStore.obj and subroutineCall.obj one instruction at a time: every core must stop
+    // after exactly one instruction and agree with the switch core at each step
+    const char* images[] = { "loadAndStore.obj", "subroutineCall.obj" };
+    for(int i = 0; i < 2; i++)
+    {
+        printf("single steps through %s\n", images[i]);
+        struct lc3_vm* machines[CORE_TOTAL];
+        char path[512];
+        snprintf(path, sizeof(path), "%s/src/%s", LC3_SOURCE_DIR, images[i]);
+        for(int c = 0; c < CORE_TOTAL; c++)
+        {
+            machines[c] = vm_create();
+            CHECK(machines[c] && vm_load_image(machines[c], path));
+            vm_set_core(machines[c], cores[c]);
+        }
+        for(int step = 1; machines[0]->running; step++)
+        {
+            for(int c = 0; c < CORE_TOTAL; c++)
+            {
+                int status = vm_run(machines[c], 1);
+                CHECK(status == (machines[0]->running ? LC3_RUN_BUDGET : LC3_RUN_HALT));
+                CHECK(machines[c]->instret == (uint64_t)step);
+                CHECK(memcmp(machines[c]->reg, machines[0]->reg, sizeof(machines[0]->reg)) == 0);
+            }
+        }
+        for(int c = 0; c < CORE_TOTAL; c++)
+        {
+            vm_destroy(machines[c]);
+        }
+    }
+
+    // LEA R2, #0; 40000 x ADD R0, R0, #1; JMP R2: the budget runs out in the middle of a
+    // straight run longer than the last RUN_MAX instructions the threaded core counts one by one
+    printf("long straight runs\n");
+    enum { RUN = 40000 };
+    static uint16_t words[RUN + 4];
+    words[0] = 0x3000;
+    words[1] = 0xE400;
+    for(int i = 0; i < RUN; i++)
+    {
+        words[2 + i] = 0x1021;
+    }
+    words[RUN + 2] = 0xC080;
+    const uint64_t budgets[] = { 123457, 2 * (RUN + 1) + 1, 1 };
+    for(int c = 0; c < CORE_TOTAL; c++)
+    {
+        load_words(words, RUN + 3);
+        vm_set_core(vm, cores[c]);
+        uint64_t total = 0;
+        for(int b = 0; b < 3; b++)
+        {
+            total += budgets[b];
+            CHECK(vm_run(vm, budgets[b]) == LC3_RUN_BUDGET && vm->instret == total);
+            uint64_t adds = total - 1 - (total - 1) / (RUN + 1);
+            CHECK(vm->reg[R_R0] == (uint16_t)adds);
+        }
+    }
+
+    // the same run ending in STI R1, PTR; PTR: .FILL xFFFE: the store to MCR stops the machine after a long run
+    words[RUN + 2] = 0xB200;
+    words[RUN + 3] = 0xFFFE;
+    for(int c = 0; c < CORE_TOTAL; c++)
+    {
+        load_words(words, RUN + 4);
+        vm_set_core(vm, cores[c]);
+        CHECK(vm_run(vm, 0) == LC3_RUN_HALT && vm->instret == RUN + 2);
+    }
+}
+
+static void test_fault()
+{
+    // ADD R0, R0, #1; RTI; ADD R0, R0, #1
+    const uint16_t prog[] = { 0x3000, 0x1021, 0x8000, 0x1021 };
+    const uint16_t reserved[] = { 0x3000, 0xD000 };
+    const uint16_t psr_jump[] = { 0x3000, 0x2201, 0xC040, 0xFFFC }; // LD R1, PSR; JMP R1; PSR: .FILL xFFFC
+    for(int c = 0; c < CORE_TOTAL; c++)
+    {
+        printf("bad opcode on %s core\n", core_names[c]);
+        load_words(prog, sizeof(prog) / sizeof(prog[0]));
+        vm_set_core(vm, cores[c]);
+        CHECK(vm_run(vm, 0) == LC3_RUN_FAULT);
+        CHECK(vm->fault == LC3_FAULT_PRIVILEGE);
+        CHECK(vm->reg[R_R0] == 1);
+        CHECK(vm->reg[R_PC] == 0x3002); // just past the RTI
+        CHECK(vm->instret == 2);
+
+        load_words(reserved, 2);
+        vm_set_core(vm, cores[c]);
+        CHECK(vm_run(vm, 0) == LC3_RUN_FAULT && vm->fault == LC3_FAULT_OPCODE);
+
+        load_words(psr_jump, 4);
+        vm_set_core(vm, cores[c]);
+        CHECK(vm_run(vm, 0) == LC3_RUN_FAULT && vm->fault == LC3_FAULT_PRIVILEGE); // fetched x8001 from the PSR, memory there is 0
+    }
+}
+
+static void test_fork()
+{
+    // LD R1, VAL; ADD R1, R1, R0; ST R1, VAL; HALT; VAL: .FILL #10
+    const uint16_t prog[] = { 0x3000, 0x2203, 0x1240, 0x3201, 0xF025, 10 };
+    for(int c = 0; c < CORE_TOTAL; c++)
+    {
+        printf("forks on %s core\n", core_names[c]);
+        load_words(prog, sizeof(prog) / sizeof(prog[0]));
+        vm_set_core(vm, cores[c]);
+        struct lc3_snapshot* snap = vm_snapshot(vm);
+        CHECK(snap != NULL);
+        struct lc3_vm* children[3];
+        for(int i = 0; i < 3; i++)
+        {
+            children[i] = vm_fork(snap);
+            CHECK(children[i] != NULL);
+            CHECK(children[i]->pages[0x30] == vm->pages[0x30]); // shared until written
+            children[i]->reg[R_R0] = (uint16_t)i; // the per-child "test input"
+        }
+        for(int i = 0; i < 3; i++)
+        {
+            CHECK(vm_run(children[i], 0) == LC3_RUN_HALT);
+            CHECK(mem_peek(children[i], 0x3004) == 10 + i);
+            CHECK(children[i]->pages[0x30] != vm->pages[0x30]); // the store copied the page
+            CHECK(children[i]->pages[0x00] == vm->pages[0x00]); // untouched pages stay shared
+        }
+        CHECK(mem_peek(vm, 0x3004) == 10); // the parent never sees the children's writes
+
+        vm_run(vm, 0); // the parent can run too, and restore puts it back
+        vm_restore(vm, snap);
+        CHECK(vm->reg[R_PC] == 0x3000 && vm->running && mem_peek(vm, 0x3004) == 10);
+        vm->reg[R_R0] = 5;
+        CHECK(vm_run(vm, 0) == LC3_RUN_HALT);
+        CHECK(mem_peek(vm, 0x3004) == 15);
+
+        for(int i = 0; i < 3; i++)
+        {
+            vm_destroy(children[i]);
+        }
+        snapshot_destroy(snap);
+    }
+}
+
+static void test_assembler_matches_images()
+{
+    const char* names[] = { "add", "branching", "inputOutput", "loadAndStore", "subroutineCall" };
+    struct lc3_vm* assembled = vm_create();
+    for(int i = 0; i < 5; i++)
+    {
+        printf("assembling testcases/%s.asm\n", names[i]);
+        char path[512], image[64];
+        snprintf(path, sizeof(path), "%s/testcases/%s.asm", LC3_SOURCE_DIR, names[i]);
+        snprintf(image, sizeof(image), "%s.obj", names[i]);
+        struct asm_error err;
+        vm_reset(assembled);
+        CHECK(vm_load_asm(assembled, path, &err));
+        CHECK(load_image(image));
+        int same = 1;
+        for(int a = 0; a < MEMORY_MAX; a++)
+        {
+            same &= mem_peek(assembled, a) == mem_peek(vm, a);
+        }
+        CHECK(same);
+    }
+    vm_destroy(assembled);
+}
+
+static void test_assembler()
+{
+    printf("assembler directives and aliases\n");
+    const char* source =
+        "; everything the assembler understands\n"
+        "        .orig x3000\n"
+        "        lea r0, MSG      ; forward reference\n"
+        "        PUTS\n"
+        "LOOP:   add R1, R1, #-1\n"
+        "        BRnp LOOP\n"
+        "        brz DONE\n"
+        "        jsr SUB\n"
+        "DONE    HALT\n"
+        "SUB     ldr r2, r6, #-32\n"
+        "        RET\n"
+        "MSG     .STRINGZ \"hi;\\\"\\n\"\n"
+        "BUF     .BLKW 3\n"
+        "PTR     .FILL BUF\n"
+        "NEG     .FILL #-1\n"
+        "        .END\n";
+    vm_reset(vm);
+    struct asm_error err;
+    CHECK(asm_assemble(vm, source, strlen(source), &err));
+    const uint16_t expected[] =
+    {
+        0xE008, 0xF022, 0x127F, 0x0BFE, 0x0401, 0x4801, 0xF025, 0x65A0, 0xC1C0,
+        'h', 'i', ';', '"', '\n', 0, 0, 0, 0, 0x300F, 0xFFFF
+    };
+    for(int i = 0; i < (int)(sizeof(expected) / sizeof(expected[0])); i++)
+    {
+        CHECK(mem_peek(vm, 0x3000 + i) == expected[i]);
+    }
+
+    const char* bad = ".ORIG x3000\nADD R0, R0, #1\nBR NOWHERE\n.END\n";
+    CHECK(!asm_assemble(vm, bad, strlen(bad), &err));
+    CHECK(err.line == 3);
+    const char* far = ".ORIG x3000\nLD R0, X\n.BLKW 300\nX .FILL 0\n.END\n";
+    CHECK(!asm_assemble(vm, far, strlen(far), &err));
+    CHECK(err.line == 2);
+    const char* twice = ".ORIG x3000\nA HALT\nA HALT\n.END\n";
+    CHECK(!asm_assemble(vm, twice, strlen(twice), &err));
+    CHECK(err.line == 3);
+}
+
+static size_t put_segment(uint8_t* out, uint16_t origin, const uint16_t* words, uint16_t count) // container segment, big-endian
+{
+    uint8_t* data = out + IMAGE_SEGMENT_BYTES;
+    for(int i = 0; i < count; i++)
+    {
+        data[2 * i] = words[i] >> 8;
+        data[2 * i + 1] = words[i] & 0xFF;
+    }
+    uint32_t sum = image_checksum(data, 2 * (size_t)count);
+    const uint8_t header[IMAGE_SEGMENT_BYTES] = { origin >> 8, origin & 0xFF, count >> 8, count & 0xFF, sum >> 24, (sum >> 16) & 0xFF, (sum >> 8) & 0xFF, sum & 0xFF };
+    memcpy(out, header, sizeof(header));
+    return IMAGE_SEGMENT_BYTES + 2 * (size_t)count;
+}
+
+static void test_image_loader()
+{
+    printf("image loader\n");
+    uint8_t bytes[64];
+    uint16_t words[24];
+    for(int n = 0; n <= 24; n++) // vector body and scalar tail
+    {
+        for(int i = 0; i < 2 * n; i++)
+        {
+            bytes[i] = (uint8_t)(i * 7 + 1);
+        }
+        memset(words, 0, sizeof(words));
+        swap_words(words, bytes, n);
+        int same = 1;
+        for(int i = 0; i < n; i++)
+        {
+            same &= words[i] == (uint16_t)(bytes[2 * i] << 8 | bytes[2 * i + 1]);
+        }
+        CHECK(same);
+    }
+
+    struct image_report report;
+    const uint8_t at_zero[] = { 0x00, 0x00, 0x12, 0x34, 0xAB, 0xCD }; // origin 0 used to load nothing
+    vm_reset(vm);
+    CHECK(image_load(vm, at_zero, sizeof(at_zero), &report));
+    CHECK(mem_peek(vm, 0) == 0x1234 && mem_peek(vm, 1) == 0xABCD);
+    CHECK(!image_load(vm, at_zero, 5, &report)); // odd length
+    CHECK(!image_load(vm, at_zero, 1, &report)); // no origin
+    const uint8_t past_end[] = { 0xFF, 0xFF, 0, 1, 0, 2 };
+    CHECK(!image_load(vm, past_end, sizeof(past_end), &report));
+
+    const uint8_t overlapping[] = { 0x00, 0x01, 0x55, 0x55 };
+    CHECK(image_load(vm, overlapping, sizeof(overlapping), &report));
+    CHECK(report.overlap_words == 1 && report.overlap_first == 1);
+
+    uint8_t container[128] = { 'L', 'C', '3', 'S', 0, IMAGE_CONTAINER_VERSION, 0, 2 };
+    const uint16_t code[] = { 0x1021, 0xF025 }, data[] = { 7, 8, 9 };
+    size_t size = IMAGE_HEADER_BYTES;
+    size += put_segment(container + size, 0x3000, code, 2);
+    size_t second = size;
+    size += put_segment(container + size, 0x4000, data, 3);
+    vm_reset(vm);
+    CHECK(image_load(vm, container, size, &report));
+    CHECK(report.segments == 2 && report.overlap_words == 0);
+    CHECK(mem_peek(vm, 0x3001) == 0xF025 && mem_peek(vm, 0x4002) == 9);
+
+    vm_reset(vm);
+    CHECK(!image_load(vm, container, size - 1, &report)); // truncated segment
+    CHECK(mem_peek(vm, 0x3000) == 0); // nothing was written
+    container[size - 1] ^= 1;
+    CHECK(!image_load(vm, container, size, &report)); // checksum
+    put_segment(container + second, 0x3001, data, 3);
+    CHECK(!image_load(vm, container, size, &report)); // the segments overlap at 0x3001
+}
+
+struct scripted_io
+{
+    int polls;
+    int keys;
+};
+
+static int scripted_getc(void* ctx)
+{
+    struct scripted_io* io = ctx;
+    return 'a' + io->keys++;
+}
+
+static int scripted_poll(void* ctx)
+{
+    struct scripted_io* io = ctx;
+    return ++io->polls % 37 == 0; // a key every 37 polls, wherever that falls in a block
+}
+
+static void null_putc(void* ctx, char c)
+{
+}
+
+static int run_manifest(const char* fields) // one job, add.obj with the given fields after the image; batch_run()'s status
+{
+    char manifest[512], results[512];
+    snprintf(manifest, sizeof(manifest), "%s/lc3_tests.manifest", LC3_BINARY_DIR);
+    snprintf(results, sizeof(results), "%s/lc3_tests_batch.jsonl", LC3_BINARY_DIR);
+    FILE* file = fopen(manifest, "w");
+    CHECK(file != NULL);
+    if(!file)
+    {
+        return -1;
+    }
+    fprintf(file, "# header\n%s/src/add.obj %s\n", LC3_SOURCE_DIR, fields);
+    fclose(file);
+    struct batch_options options = { 1, CORE_THREADED, 0, 0, results, 0 };
+    return batch_run(manifest, &options);
+}
+
+static void test_batch_manifest()
+{
+    printf("batch manifest fields\n");
+    CHECK(run_manifest("- budget=100000 timeout=10000") == 0);
+    CHECK(run_manifest("- budget=100000 timeout=10000 extra") == 2); // past the fourth field
+    CHECK(run_manifest("- budget=100000 timeout=10000 budget=5 extra") == 2);
+    CHECK(run_manifest("- budget=abc") == 2);
+    CHECK(run_manifest("- budget=10x") == 2);
+    CHECK(run_manifest("- timeout=") == 2); // not "no limit"
+    CHECK(run_manifest("- budget=-1") == 2);
+}
+
+static void test_replay()
+{
+    printf("record/replay\n");
+    const char* source = // echo three keys, polling KBSR in between
+        ".ORIG x3000\n"
+        "      AND R2, R2, #0\n"
+        "LOOP  LDI R1, KBSR\n"
+        "      BRzp SPIN\n"
+        "      LDI R0, KBDR\n"
+        "      OUT\n"
+        "      ADD R2, R2, #1\n"
+        "      ADD R3, R2, #-3\n"
+        "      BRz DONE\n"
+        "SPIN  ADD R4, R4, #1\n"
+        "      BR LOOP\n"
+        "DONE  HALT\n"
+        "KBSR  .FILL xFE00\n"
+        "KBDR  .FILL xFE02\n"
+        ".END\n";
+    char path[512];
+    snprintf(path, sizeof(path), "%s/lc3_tests_replay.log", LC3_BINARY_DIR);
+    struct asm_error err;
+    struct replay_report report;
+    struct scripted_io script = { 0, 0 };
+    const struct lc3_io io = { &script, scripted_getc, scripted_poll, null_putc, NULL, NULL };
+    const struct lc3_io saved = vm->io; // put back at the end, script and io die with this frame
+
+    vm_reset(vm);
+    CHECK(asm_assemble(vm, source, strlen(source), &err));
+    vm_set_io(vm, &io);
+    vm_set_core(vm, CORE_BLOCK);
+    struct lc3_replay* r = replay_record(vm, path);
+    CHECK(r != NULL);
+    CHECK(vm_run(vm, 0) == LC3_RUN_HALT);
+    uint64_t recorded = vm->instret;
+    uint16_t spins = vm->reg[R_R4];
+    CHECK(replay_close(r, &report));
+    CHECK(report.events == 6); // three READY, three KEY
+
+    for(int c = 0; c < CORE_TOTAL; c++)
+    {
+        vm_reset(vm);
+        CHECK(asm_assemble(vm, source, strlen(source), &err));
+        vm_set_core(vm, cores[c]);
+        r = replay_open(vm, path, &report);
+        CHECK(r != NULL && replay_length(r) == recorded);
+        CHECK(r && vm_run(vm, replay_length(r)) == LC3_RUN_HALT);
+        CHECK(vm->reg[R_R4] == spins && vm->reg[R_R2] == 3);
+        CHECK(replay_close(r, &report));
+    }
+
+    const char* other = ".ORIG x3000\nGETC\nHALT\n.END\n"; // reads a key where the log has none
+    vm_reset(vm);
+    CHECK(asm_assemble(vm, other, strlen(other), &err));
+    r = replay_open(vm, path, &report);
+    CHECK(r != NULL);
+    vm_run(vm, 0);
+    CHECK(!replay_close(r, &report));
+    vm_set_io(vm, &saved);
+}
+
+struct idle_io
+{
+    int waits;
+    int putcs;
+};
+
+static int idle_getc(void* ctx)
+{
+    return 'k';
+}
+
+static int idle_poll(void* ctx)
+{
+    struct idle_io* io = ctx;
+    return io->waits >= 3; // the key comes in while the machine waits for the third time
+}
+
+static void idle_putc(void* ctx, char c)
+{
+    struct idle_io* io = ctx;
+    io->putcs++;
+}
+
+static void idle_wait(void* ctx, int timeout_ms)
+{
+    struct idle_io* io = ctx;
+    io->waits++;
+}
+
+static void test_idle()
+{
+    printf("idle loops\n");
+    const char* poll_loop = ".ORIG x3000\nLOOP LDI R0, KBSR\nBRzp LOOP\nLDI R0, KBDR\nHALT\nKBSR .FILL xFE00\nKBDR .FILL xFE02\n.END\n";
+    const char* busy_loop = ".ORIG x3000\nLOOP LD R0, DOT\nOUT\nLDI R0, KBSR\nBRzp LOOP\nHALT\nDOT .FILL x2E\nKBSR .FILL xFE00\n.END\n";
+    struct asm_error err;
+    uint64_t instret[CORE_TOTAL];
+    const struct lc3_io saved = vm->io; // put back below, the tests after this one must not call into this frame
+    for(int c = 0; c < CORE_TOTAL; c++)
+    {
+        struct idle_io state = { 0, 0 };
+        const struct lc3_io io = { &state, idle_getc, idle_poll, idle_putc, NULL, NULL, NULL, idle_wait };
+        vm_reset(vm);
+        CHECK(asm_assemble(vm, poll_loop, strlen(poll_loop), &err));
+        vm_set_io(vm, &io);
+        vm_set_core(vm, cores[c]);
+        CHECK(vm_run(vm, 0) == LC3_RUN_HALT && vm->reg[R_R0] == 'k');
+        CHECK(state.waits == 3);
+        instret[c] = vm->instret;
+        CHECK(instret[c] == instret[0]); // the waits fall at the same instruction on every core
+        CHECK(instret[c] < 2 * (IDLE_SPINS + 8)); // two instructions a spin, not the thousands without waiting
+
+        state.waits = 0; // printing in the loop: never idle, so the key never comes
+        vm_reset(vm);
+        CHECK(asm_assemble(vm, busy_loop, strlen(busy_loop), &err));
+        CHECK(vm_run(vm, 10000) == LC3_RUN_BUDGET && state.waits == 0 && state.putcs > 1000);
+        vm_set_io(vm, &saved); // state and io go out of scope with this iteration
+    }
+}
+
+static void test_debugger()
+{
+    printf("breakpoints and watchpoints\n");
+    const char* source = ".ORIG x3000\nAND R1, R1, #0\nLOOP ADD R1, R1, #1\nST R1, VAR\nADD R2, R1, #-5\nBRn LOOP\n"
+        "LD R3, VAR\nHALT\nVAR .FILL 0\n.END\n";
+    struct asm_error err;
+    for(int c = 0; c < CORE_TOTAL; c++)
+    {
+        vm_reset(vm);
+        CHECK(asm_assemble(vm, source, strlen(source), &err));
+        vm_set_core(vm, cores[c]);
+        CHECK(debug_open(vm));
+        debug_set(vm, 0x3003, CODE_BREAK, 1);
+        CHECK(vm_run(vm, 0) == LC3_RUN_BREAK && vm->reg[R_PC] == 0x3003 && vm->reg[R_R1] == 1 && vm->instret == 3);
+        CHECK(vm_run(vm, 0) == LC3_RUN_BREAK && vm->reg[R_R1] == 2 && vm->instret == 7); // stepped over the one it started on
+        debug_set(vm, 0x3003, CODE_BREAK, 0);
+        debug_set(vm, 0x3001, CODE_BREAK, 1); // on an instruction the threaded core has already decoded
+        CHECK(vm_run(vm, 0) == LC3_RUN_BREAK && vm->reg[R_PC] == 0x3001 && vm->reg[R_R1] == 2);
+        debug_set(vm, 0x3001, CODE_BREAK, 0);
+        debug_set(vm, 0x3007, CODE_WATCH, 1);
+        CHECK(vm_run(vm, 0) == LC3_RUN_BREAK && vm->debug->hit == DEBUG_WATCH && vm->reg[R_PC] == 0x3003 && mem_peek(vm, 0x3007) == 3);
+        debug_set(vm, 0x3007, CODE_WATCH, 0);
+        debug_set(vm, 0x3007, CODE_RWATCH, 1);
+        CHECK(vm_run(vm, 0) == LC3_RUN_BREAK && vm->debug->hit == DEBUG_RWATCH && vm->reg[R_PC] == 0x3006 && vm->reg[R_R3] == 5);
+        CHECK(vm_run(vm, 0) == LC3_RUN_HALT && vm->instret == 23);
+        debug_close(vm);
+        CHECK(vm->code_map[0x3007] == 0);
+
+        // LD R0, DEV; JMP R0; DEV: .FILL xFE10, where unused device words read as NOPs
+        const uint16_t device[] = { 0x3000, 0x2001, 0xC000, 0xFE10 };
+        load_words(device, 4);
+        vm_set_core(vm, cores[c]);
+        CHECK(debug_open(vm));
+        debug_set(vm, 0xFE10, CODE_BREAK, 1);
+        debug_set(vm, 0xFE11, CODE_BREAK, 1);
+        CHECK(vm_run(vm, 0) == LC3_RUN_BREAK && vm->reg[R_PC] == 0xFE10 && vm->instret == 2);
+        CHECK(vm_run(vm, 0) == LC3_RUN_BREAK && vm->reg[R_PC] == 0xFE11 && vm->instret == 3); // the skip is used up
+        debug_close(vm);
+    }
+
+    FILE* in = tmpfile();
+    FILE* out = tmpfile();
+    if(in && out)
+    {
+        vm_reset(vm);
+        CHECK(asm_assemble(vm, source, strlen(source), &err));
+        fputs("b x3003\nc\nd\nw VAR\nw x3007\nc\nc\nq\n", in);
+        rewind(in);
+        CHECK(debug_repl(vm, in, out, 0) == 0);
+        char text[4096];
+        rewind(out);
+        size_t n = fread(text, 1, sizeof(text) - 1, out);
+        text[n] = '\0';
+        CHECK(strstr(text, "breakpoint x3003\nx3003: x147B") != NULL);
+        CHECK(strstr(text, "needs an address") != NULL); // no symbols
+        CHECK(strstr(text, "watchpoint x3007 written: x0002") != NULL);
+        debug_close(vm);
+    }
+    if(in)
+    {
+        fclose(in);
+    }
+    if(out)
+    {
+        fclose(out);
+    }
+}
+
+static void test_profile()
+{
+    printf("profile\n");
+    const char* source =
+        ".ORIG x3000\n"
+        "      JSR SUB\n"
+        "      JSR SUB\n"
+        "      HALT\n"
+        "SUB   ADD R6, R7, #0\n" // keep the return address across the inner call
+        "      JSR LEAF\n"
+        "      ADD R7, R6, #0\n"
+        "      RET\n"
+        "LEAF  ADD R0, R0, #1\n"
+        "      RET\n"
+        ".END\n";
+    struct asm_error err;
+    for(int c = 0; c < CORE_TOTAL; c++) // the block core hands profiled runs to the threaded core
+    {
+        vm_reset(vm);
+        CHECK(asm_assemble(vm, source, strlen(source), &err));
+        vm_set_core(vm, cores[c]);
+        CHECK(profile_open(vm));
+        CHECK(vm_run(vm, 6) == LC3_RUN_BUDGET); // stops inside SUB, the budget and the profile agree
+        CHECK(vm_run(vm, 0) == LC3_RUN_HALT);
+        struct lc3_profile* p = vm->profile;
+        CHECK(p->pc_count[0x3003] == 2 && p->pc_count[0x3002] == 1);
+        CHECK(p->op_count[OP_JSR] == 4 && p->op_count[OP_ADD] == 6 && p->trap_count[TRAP_HALT] == 1);
+        CHECK(p->node_count == 3); // root, SUB, SUB -> LEAF
+        CHECK(p->nodes[1].entry == 0x3003 && p->nodes[1].calls == 2 && profile_self(vm, 1) == 8);
+        CHECK(p->nodes[2].parent == 1 && p->nodes[2].calls == 2 && profile_self(vm, 2) == 4);
+        CHECK(profile_self(vm, 0) == 3); // JSR, JSR, HALT
+        profile_close(vm);
+    }
+}
+
+static void test_deadline()
+{
+    const uint16_t spin[] = { 0x3000, 0x0FFF }; // BRnzp to itself
+    for(int c = 0; c < CORE_TOTAL; c++)
+    {
+        printf("deadline on %s core\n", core_names[c]);
+        load_words(spin, 2);
+        vm_set_core(vm, cores[c]);
+        vm_set_deadline(vm, time_ms() + 60000);
+        CHECK(vm_run(vm, 200000) == LC3_RUN_BUDGET); // the budget still counts, and is exact
+        CHECK(vm->instret == 200000);
+        vm_set_deadline(vm, time_ms() + 20);
+        CHECK(vm_run(vm, 0) == LC3_RUN_DEADLINE);
+        CHECK(vm->running);
+        uint64_t stopped = vm->instret;
+        CHECK(vm_run(vm, 0) == LC3_RUN_DEADLINE && vm->instret == stopped); // already past it, nothing runs
+        vm_set_deadline(vm, 0);
+        CHECK(vm_run(vm, 1000) == LC3_RUN_BUDGET && vm->instret == stopped + 1000);
+    }
+}
+
+static void test_headless()
+{
+    printf("headless run\n");
+    const char* source = ".ORIG x3000\nLOOP IN\nADD R1, R0, #-10\nBRnp LOOP\nLEA R0, MSG\nPUTS\nHALT\nMSG .STRINGZ \"ok\"\n.END\n";
+    char output[8];
+    struct lc3_buffer_io buffers = { "ab\n", 3, 0, output, sizeof(output), 0 };
+    struct lc3_run_result result;
+    struct asm_error err;
+    const struct lc3_io saved = vm->io; // put back at the end, the buffers die with this frame
+    vm_reset(vm);
+    CHECK(asm_assemble(vm, source, strlen(source), &err));
+    vm_set_buffer_io(vm, &buffers);
+    vm_set_core(vm, CORE_BLOCK);
+    CHECK(vm_run_result(vm, 4, &result) == LC3_RUN_BUDGET);
+    CHECK(result.instructions == 4 && result.pc == 0x3001);
+    CHECK(vm_run_result(vm, 0, &result) == LC3_RUN_HALT);
+    CHECK(result.fault == LC3_FAULT_NONE && result.instret == 12);
+    CHECK(buffers.output_size == 10 && memcmp(output, "ab\nokHAL", 8) == 0); // echoed, no prompt; the last 2 bytes dropped
+    CHECK(buffers.input_pos == 3);
+    CHECK(strcmp(vm_fault_name(LC3_FAULT_OPCODE), "bad opcode") == 0);
+    vm_set_io(vm, &saved);
+}
+
+static void test_checkpoint()
+{
+    printf("checkpoints\n");
+    const char* fill = ".ORIG x3000\nLD R1, BASE\nLD R2, COUNT\n" // writes 3, 6, 9, ... over four pages, then one word again
+        "LOOP ADD R0, R0, #3\nSTR R0, R1, #0\nADD R1, R1, #1\nADD R2, R2, #-1\nBRp LOOP\nST R0, BASE\nHALT\n"
+        "BASE .FILL x4000\nCOUNT .FILL #1024\n.END\n";
+    char path[512];
+    snprintf(path, sizeof(path), "%s/lc3_tests_checkpoint.bin", LC3_BINARY_DIR);
+    struct asm_error err;
+    struct checkpoint_report report;
+
+    vm_reset(vm); // the run without checkpoints
+    CHECK(asm_assemble(vm, fill, strlen(fill), &err));
+    CHECK(vm_run(vm, 0) == LC3_RUN_HALT);
+    uint16_t end_reg[R_COUNT];
+    memcpy(end_reg, vm->reg, sizeof(end_reg));
+    uint64_t end_instret = vm->instret;
+
+    vm_reset(vm);
+    CHECK(asm_assemble(vm, fill, strlen(fill), &err));
+    struct lc3_checkpoint* cp = checkpoint_open(vm, path, 0);
+    CHECK(cp != NULL);
+    uint64_t full = checkpoint_bytes(cp);
+    CHECK(full < 200); // one page, mostly zero
+    CHECK(vm_run(vm, 1500) == LC3_RUN_BUDGET && checkpoint_write(cp)); // about 1.5 pages written
+    CHECK(vm_run(vm, 20) == LC3_RUN_BUDGET && checkpoint_write(cp)); // four words
+    uint64_t small = checkpoint_bytes(cp);
+    CHECK(checkpoint_write(cp)); // nothing changed: the state alone
+    CHECK(checkpoint_bytes(cp) - small < 64);
+    checkpoint_close(cp);
+
+    struct lc3_vm* other = vm_create();
+    CHECK(checkpoint_load(other, path, &report) && report.records == 4 && !report.truncated);
+    CHECK(other->instret == 1520 && memcmp(other->reg, vm->reg, sizeof(vm->reg)) == 0);
+    for(int a = 0; a < MEMORY_MAX; a++)
+    {
+        if(mem_peek(other, a) != mem_peek(vm, a))
+        {
+            CHECK(mem_peek(other, a) == mem_peek(vm, a));
+            break;
+        }
+    }
+    for(int c = 0; c < CORE_TOTAL; c++) // a resumed run ends where the run without checkpoints did
+    {
+        struct lc3_vm* resumed = vm_create();
+        CHECK(checkpoint_load(resumed, path, &report));
+        vm_set_core(resumed, cores[c]);
+        CHECK(vm_run(resumed, 0) == LC3_RUN_HALT);
+        CHECK(resumed->instret == end_instret && memcmp(resumed->reg, end_reg, sizeof(end_reg)) == 0);
+        CHECK(mem_peek(resumed, 0x43FF) == (uint16_t)(3 * 1024));
+        vm_destroy(resumed);
+    }
+
+    FILE* f = fopen(path, "r+b"); // a worker died halfway through the last record
+    CHECK(f != NULL);
+    if(f)
+    {
+        fseek(f, (long)small + 3, SEEK_SET);
+        fputc('X', f);
+        fclose(f);
+    }
+    CHECK(checkpoint_load(other, path, &report) && report.records == 3 && report.truncated);
+    CHECK(other->instret == 1520);
+
+    f = fopen(path, "wb");
+    if(f)
+    {
+        fputs("not a checkpoint", f);
+        fclose(f);
+    }
+    CHECK(!checkpoint_load(other, path, &report) && report.records == 0);
+    vm_destroy(other);
+    remove(path);
+}
+
+static void test_stats()
+{
+    const char* source = ".ORIG x3000\nLD R1, COUNT\n"
+        "LOOP LDI R2, KBSRP\nADD R0, R0, #1\nOUT\n" // a device read, a trap and an output byte per round
+        "LEA R3, PATCH\nLD R4, NOPW\nSTR R4, R3, #0\nPATCH ADD R5, R5, #1\n" // overwrites its own block
+        "ADD R1, R1, #-1\nBRp LOOP\nSTI R0, DDRP\nHALT\n"
+        "KBSRP .FILL xFE00\nDDRP .FILL xFE06\nNOPW .FILL x0000\nCOUNT .FILL #5\n.END\n";
+    struct asm_error err;
+    struct lc3_stats first;
+    const struct lc3_io saved = vm->io; // put back after each run, the buffers die with the loop body
+    for(int c = 0; c < CORE_TOTAL; c++)
+    {
+        for(int slice = 0; slice <= 7; slice += 7) // in one go, and stopped every few instructions
+        {
+            printf("stats on %s core, budget %d\n", core_names[c], slice);
+            char output[16];
+            struct lc3_buffer_io buffers = { "", 0, 0, output, sizeof(output), 0 };
+            struct lc3_stats stats;
+            vm_reset(vm);
+            CHECK(asm_assemble(vm, source, strlen(source), &err));
+            vm_set_buffer_io(vm, &buffers);
+            vm_set_core(vm, cores[c]);
+            int run;
+            while((run = vm_run(vm, slice)) == LC3_RUN_BUDGET)
+            {
+            }
+            CHECK(run == LC3_RUN_HALT);
+            vm_stats(vm, &stats);
+            uint64_t sum = 0;
+            for(int op = 0; op < 16; op++)
+            {
+                sum += stats.opcodes[op];
+            }
+            CHECK(stats.instructions == vm->instret && sum == vm->instret);
+            CHECK(stats.opcodes[OP_LDI] == 5 && stats.opcodes[OP_STR] == 5 && stats.opcodes[OP_TRAP] == 6);
+            CHECK(stats.loads == 2 * 5 + 5 + 1 + 1 && stats.stores == 5 + 1); // STI reads its pointer too
+            CHECK(stats.traps[TRAP_OUT] == 5 && stats.traps[TRAP_HALT] == 1);
+            CHECK(stats.device_reads >= 5 && stats.device_writes >= 1);
+            CHECK(stats.output_bytes == buffers.output_size && stats.input_bytes == 0);
+            if(c == 0 && slice == 0)
+            {
+                first = stats;
+            }
+            else
+            {
+                CHECK(memcmp(stats.opcodes, first.opcodes, sizeof(first.opcodes)) == 0);
+                CHECK(memcmp(stats.traps, first.traps, sizeof(first.traps)) == 0);
+                CHECK(stats.device_reads == first.device_reads && stats.device_writes == first.device_writes);
+            }
+            vm_set_io(vm, &saved);
+        }
+    }
+    vm_reset(vm);
+    struct lc3_stats cleared;
+    vm_stats(vm, &cleared);
+    CHECK(cleared.instructions == 0 && cleared.opcodes[OP_LDI] == 0 && cleared.traps[TRAP_OUT] == 0);
+}
+
+static uint32_t program_hash(uint16_t from, uint16_t to) // registers and a range of memory
+{
+    uint32_t h = 2166136261u;
+    for(int i = 0; i < R_COUNT; i++)
+    {
+        h = (h ^ vm->reg[i]) * 16777619u;
+    }
+    for(uint16_t a = from; a < to; a++)
+    {
+        h = (h ^ mem_peek(vm, a)) * 16777619u;
+    }
+    return h;
+}
+
+static void test_undo()
+{
+    printf("undo log\n");
+    const char* source = ".ORIG x3000\nLD R1, COUNT\n"
+        "LOOP ADD R0, R0, #2\nST R0, DATA\n"
+        "LEA R2, PATCH\nLDR R3, R2, #0\nADD R3, R3, #1\nSTR R3, R2, #0\nPATCH ADD R4, R4, #1\n" // a bigger immediate every round
+        "ADD R1, R1, #-1\nBRp LOOP\nHALT\nDATA .FILL #0\nCOUNT .FILL #6\n.END\n";
+    struct asm_error err;
+    vm_reset(vm);
+    CHECK(asm_assemble(vm, source, strlen(source), &err));
+    vm_set_core(vm, CORE_THREADED);
+    CHECK(vm_run(vm, 0) == LC3_RUN_HALT);
+    uint32_t end_hash = program_hash(0x3000, 0x3010);
+    uint64_t end_instret = vm->instret;
+
+    uint32_t hashes[128];
+    vm_reset(vm);
+    CHECK(asm_assemble(vm, source, strlen(source), &err));
+    CHECK(vm_run(vm, 10) == LC3_RUN_BUDGET); // leaves predecoded copies of the code behind
+    CHECK(undo_open(vm, 1 << 20));
+    uint16_t watched = 0;
+    debug_open(vm);
+    debug_set(vm, 0x300B, CODE_WATCH, 1); // DATA
+    while(vm->running && vm->instret < 128)
+    {
+        hashes[vm->instret] = program_hash(0x3000, 0x3010);
+        vm_run(vm, 1);
+    }
+    CHECK(!vm->running && vm->instret == end_instret && program_hash(0x3000, 0x3010) == end_hash);
+    CHECK(undo_depth(vm) == end_instret - 10);
+    int watches = 0;
+    for(;;)
+    {
+        int status = undo_step(vm, &watched);
+        if(status == UNDO_NONE)
+        {
+            break;
+        }
+        watches += status == UNDO_WATCH && watched == 0x300B;
+        if(program_hash(0x3000, 0x3010) != hashes[vm->instret])
+        {
+            CHECK(program_hash(0x3000, 0x3010) == hashes[vm->instret]);
+            break;
+        }
+    }
+    CHECK(vm->instret == 10 && vm->running && watches == 5 && mem_peek(vm, 0x3007) == 0x1921 + 1); // one round in, its ST not undone
+    debug_close(vm);
+    undo_close(vm);
+    CHECK(vm_run(vm, 0) == LC3_RUN_HALT); // the threaded core must not run the stale predecoded PATCH
+    CHECK(vm->instret == end_instret && program_hash(0x3000, 0x3010) == end_hash);
+
+    vm_reset(vm); // a small log keeps the newest instructions
+    CHECK(asm_assemble(vm, source, strlen(source), &err));
+    CHECK(undo_open(vm, 256));
+    CHECK(vm_run(vm, 0) == LC3_RUN_HALT);
+    uint64_t depth = undo_depth(vm);
+    CHECK(depth > 10 && depth < end_instret);
+    while(undo_step(vm, &watched) != UNDO_NONE)
+    {
+    }
+    CHECK(vm->instret == end_instret - depth && program_hash(0x3000, 0x3010) == hashes[vm->instret]);
+    vm_reset(vm);
+    CHECK(undo_depth(vm) == 0);
+    undo_close(vm);
+}
+
+static void test_disasm()
+{
+    printf("disassembler and control flow\n");
+    const struct { uint16_t instr; const char* text; } cases[] =
+    {
+        { 0x1261, "ADD R1, R1, #1" }, { 0x1A7F, "ADD R5, R1, #-1" }, { 0x5042, "AND R0, R1, R2" }, { 0x923F, "NOT R1, R0" },
+        { 0x0403, "BRz x3004" }, { 0x0FFF, "BRnzp x3000" }, { 0x0000, "NOP" }, { 0xC1C0, "RET" }, { 0xC080, "JMP R2" },
+        { 0x4FFF, "JSR x3000" }, { 0x4080, "JSRR R2" }, { 0x2201, "LD R1, x3002" }, { 0xA5FF, "LDI R2, x3000" },
+        { 0x6E7E, "LDR R7, R1, #-2" }, { 0x7440, "STR R2, R1, #0" }, { 0xE010, "LEA R0, x3011" }, { 0x3000, "ST R0, x3001" },
+        { 0xB1FE, "STI R0, x2FFF" }, { 0xF025, "HALT" }, { 0xF023, "IN" }, { 0xF030, "TRAP x30" }, { 0x8000, "RTI" },
+        { 0xD123, ".FILL xD123" }
+    };
+    char text[32];
+    for(size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+    {
+        disasm_instr(0x3000, cases[i].instr, text, sizeof(text));
+        if(strcmp(text, cases[i].text) != 0)
+        {
+            printf("  x%04X: got '%s', expected '%s'\n", cases[i].instr, text, cases[i].text);
+            CHECK(strcmp(text, cases[i].text) == 0);
+        }
+    }
+
+    const char* source = ".ORIG x3000\nLD R1, COUNT\nLOOP JSR DOUBLE\nADD R1, R1, #-1\nBRp LOOP\nHALT\n"
+        "COUNT .FILL #3\nDOUBLE ADD R0, R0, R0\nRET\n.END\n";
+    struct asm_error err;
+    vm_reset(vm);
+    CHECK(asm_assemble(vm, source, strlen(source), &err));
+    mem_poke(vm, 0x3000 - 1, 1); // not reachable, must not count
+    struct lc3_cfg* cfg = cfg_build_loaded(vm);
+    CHECK(cfg != NULL);
+    if(!cfg)
+    {
+        return;
+    }
+    CHECK(cfg->block_count == 5 && cfg->sub_count == 2);
+    CHECK(!(cfg->word[0x3005] & CFG_CODE) && !(cfg->word[0x2FFF] & CFG_CODE) && (cfg->word[0x3006] & CFG_ENTRY));
+    const uint16_t starts[] = { 0x3000, 0x3001, 0x3002, 0x3004, 0x3006 };
+    const uint8_t ends[] = { CFG_END_FALL, CFG_END_CALL, CFG_END_BRANCH, CFG_END_HALT, CFG_END_RETURN };
+    for(int i = 0; i < 5 && i < cfg->block_count; i++)
+    {
+        CHECK(cfg->blocks[i].start == starts[i] && cfg->blocks[i].end == ends[i]);
+        CHECK(cfg->blocks[i].sub == (i == 4 ? 0x3006 : 0x3000));
+    }
+    CHECK(cfg->blocks[1].call == 0x3006 && cfg->blocks[2].next_count == 2 && cfg->blocks[2].next[1] == 0x3001);
+
+    vm_set_core(vm, CORE_BLOCK); // every block the run needs is there before it starts
+    CHECK(cfg_translate_blocks(vm, cfg) == 5);
+    CHECK(vm_run(vm, 0) == LC3_RUN_HALT && vm->reg[R_R0] == 0 && vm->reg[R_R1] == 0);
+    CHECK(vm->blocks->used == 5);
+    cfg_free(cfg);
+
+    // a resumed run is translated from the restored PC: x3003 on, not the BR or the HALT before it
+    const char* skip = ".ORIG x3000\nADD R0, R0, #1\nBRnzp SKIP\nHALT\nSKIP ADD R1, R1, #1\nHALT\n.END\n";
+    char path[512];
+    snprintf(path, sizeof(path), "%s/lc3_tests_resume.bin", LC3_BINARY_DIR);
+    struct checkpoint_report report;
+    for(int system = 0; system <= 1; system++)
+    {
+        vm_reset(vm);
+        vm_set_system(vm, system);
+        CHECK(asm_assemble(vm, skip, strlen(skip), &err));
+        vm_set_core(vm, CORE_THREADED);
+        CHECK(vm_run(vm, 2) == LC3_RUN_BUDGET && vm->reg[R_PC] == 0x3003);
+        struct lc3_checkpoint* cp = checkpoint_open(vm, path, 0);
+        CHECK(cp != NULL);
+        checkpoint_close(cp);
+
+        vm_set_system(vm, 0);
+        vm_reset(vm);
+        vm_set_core(vm, CORE_BLOCK);
+        CHECK(checkpoint_load(vm, path, &report) && vm->reg[R_PC] == 0x3003 && vm->system.enabled == system);
+        if(system) // the switch core runs full-system mode, nothing to translate for
+        {
+            CHECK(cfg_translate_loaded(vm) == 0 && (!vm->blocks || vm->blocks->used == 0));
+        }
+        else
+        {
+            CHECK(cfg_translate_loaded(vm) == 1 && vm->blocks->index[0x3003] && !vm->blocks->index[0x3000] && !vm->blocks->index[0x3002]);
+            CHECK(vm_run(vm, 0) == LC3_RUN_HALT && vm->reg[R_R1] == 1 && vm->instret == 4);
+        }
+    }
+    vm_set_system(vm, 0);
+}
+
+static uint64_t fake_ms;
+
+static uint64_t fake_clock(void* ctx) // 10 ms pass with every reading
+{
+    return fake_ms += 10;
+}
+
+static int run_system(const char* source, const char* input, char* output, size_t output_cap, struct lc3_buffer_io* buffers)
+{
+    struct asm_error err;
+    CHECK(load_image("lc3os.asm"));
+    CHECK(asm_assemble(vm, source, strlen(source), &err));
+    struct lc3_buffer_io io = { input, strlen(input), 0, output, output_cap, 0 };
+    *buffers = io;
+    vm_set_buffer_io(vm, buffers);
+    vm->io.clock = fake_clock;
+    return vm_run(vm, 1000000);
+}
+
+static void test_system()
+{
+    printf("full-system mode\n");
+    const char* hello = ".ORIG x3000\nLEA R0, MSG\nPUTS\nLD R0, BANG\nOUT\nLEA R0, PACKED\nPUTSP\nHALT\n"
+        "MSG .STRINGZ \"hi\"\nBANG .FILL x21\nPACKED .FILL x6261\n.FILL x0063\n.FILL 0\n.END\n";
+    char fast[32], full[32];
+    struct lc3_buffer_io buffers;
+    CHECK(run_system(hello, "", fast, sizeof(fast), &buffers) == LC3_RUN_HALT); // the OS is loaded but not used
+    size_t fast_size = buffers.output_size;
+    vm_set_system(vm, 1);
+    CHECK(run_system(hello, "", full, sizeof(full), &buffers) == LC3_RUN_HALT);
+    CHECK(buffers.output_size == fast_size && fast_size == 11 && memcmp(fast, full, fast_size) == 0); // "hi!abcHALT\n"
+    CHECK(!(vm->system.psr & PSR_USER)); // halted inside the OS
+
+    const char* keyboard = // a keyboard interrupt handler stores the key and the PSR it ran with
+        ".ORIG x3000\nLD R0, HADDR\nSTI R0, IVEC\nLD R6, USTACK\nLD R0, IE\nSTI R0, KBSR\n"
+        "WAIT LD R0, GOT\nBRz WAIT\nST R6, SAVED\nHALT\n"
+        "HANDLER LDI R1, KBDR\nST R1, GOT\nLDI R1, PSR\nST R1, INPSR\nRTI\n"
+        "HADDR .FILL HANDLER\nIVEC .FILL x0180\nUSTACK .FILL x4000\nIE .FILL x4000\nKBSR .FILL xFE00\nKBDR .FILL xFE02\nPSR .FILL xFFFC\n"
+        "GOT .FILL 0\nINPSR .FILL 0\nSAVED .FILL 0\n.END\n";
+    CHECK(run_system(keyboard, "k", full, sizeof(full), &buffers) == LC3_RUN_HALT);
+    CHECK(mem_peek(vm, 0x3015) == 'k'); // GOT
+    CHECK((mem_peek(vm, 0x3016) & ~PSR_COND) == PL_KEYBOARD << 8); // supervisor mode, priority 4
+    CHECK(mem_peek(vm, 0x3017) == 0x4000); // the user stack came back
+    CHECK(vm->instret > SYSTEM_POLL_INTERVAL); // the first sample after interrupts were enabled
+
+    const char* timer = ".ORIG x3000\nLD R0, HADDR\nSTI R0, IVEC\nAND R0, R0, #0\nADD R0, R0, #5\nSTI R0, TMI\nLD R0, IE\nSTI R0, TMR\n"
+        "WAIT ADD R2, R2, #1\nLD R0, GOT\nBRz WAIT\nHALT\n"
+        "HANDLER LDI R1, TMR\nST R1, GOT\nRTI\n"
+        "HADDR .FILL HANDLER\nIVEC .FILL x0181\nIE .FILL x4000\nTMR .FILL xFE08\nTMI .FILL xFE0A\nGOT .FILL 0\n.END\n";
+    CHECK(run_system(timer, "", full, sizeof(full), &buffers) == LC3_RUN_HALT);
+    CHECK(mem_peek(vm, 0x3013) == (DEVICE_READY | DEVICE_IE)); // what the handler read from TMR
+
+    CHECK(run_system(".ORIG x3000\nRTI\n.END\n", "", full, sizeof(full), &buffers) == LC3_RUN_HALT); // the OS handles the exception
+    CHECK(buffers.output_size > 26 && memcmp(full, "\nprivilege mode exception\n", 26) == 0);
+
+    vm_reset(vm); // no OS: the trap vector table is empty
+    CHECK(vm_run(vm, 0) == LC3_RUN_FAULT && vm->fault == LC3_FAULT_VECTOR);
+    vm_set_system(vm, 0);
+}
+
+int main()
+{
+    vm = vm_create();
+    if(!vm)
+    {
+        printf("out of memory\n");
+        return 1;
+    }
+
+    test_images();
+    test_self_modifying_code();
+    test_mcr_halt();
+    test_flags();
+    test_budget();
+    test_fault();
+    test_fork();
+    test_assembler_matches_images();
+    test_assembler();
+    test_image_loader();
+    test_batch_manifest();
+    test_replay();
+    test_idle();
+    test_debugger();
+    test_profile();
+    test_deadline();
+    test_headless();
+    test_checkpoint();
+    test_stats();
+    test_undo();
+    test_disasm();
+    test_system();
+    vm_destroy(vm);
+
+    if(failures)
+    {
+        printf("%d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("all tests passed\n");
+    return 0;
+}